@@ -1,44 +0,0 @@
-const uint32_t triangle_spv[] = 
-{
-    0x07230203, 0x00010500, 0x00000028, 0x0000003d, 0x00000000, 0x00020011, 0x00000001, 0x0003000e, 0x00000000, 
-    0x00000001, 0x0008000f, 0x00000000, 0x00000002, 0x74726576, 0x00007865, 0x0000002d, 0x00000030, 0x00000012, 
-    0x0008000f, 0x00000004, 0x00000033, 0x67617266, 0x746e656d, 0x00000000, 0x0000003a, 0x00000037, 0x00030010, 
-    0x00000033, 0x00000007, 0x00030003, 0x0000000b, 0x00000001, 0x000a0005, 0x00000030, 0x72746e65, 0x696f5079, 
-    0x6150746e, 0x5f6d6172, 0x74726576, 0x432e7865, 0x726f6c6f, 0x00000000, 0x00040005, 0x00000002, 0x74726576, 
-    0x00007865, 0x00040005, 0x00000037, 0x6f6c6f63, 0x00000072, 0x00090005, 0x0000003a, 0x72746e65, 0x696f5079, 
-    0x6150746e, 0x5f6d6172, 0x67617266, 0x746e656d, 0x00000000, 0x00050005, 0x00000033, 0x67617266, 0x746e656d, 
-    0x00000000, 0x00040047, 0x00000005, 0x00000006, 0x00000008, 0x00040047, 0x0000000c, 0x00000006, 0x0000000c, 
-    0x00040047, 0x00000012, 0x0000000b, 0x0000002a, 0x00040047, 0x0000002d, 0x0000000b, 0x00000000, 0x00040047, 
-    0x00000030, 0x0000001e, 0x00000000, 0x00040047, 0x00000037, 0x0000001e, 0x00000000, 0x00040047, 0x0000003a, 
-    0x0000001e, 0x00000000, 0x00020013, 0x00000001, 0x00030021, 0x00000003, 0x00000001, 0x00030016, 0x00000006, 
-    0x00000020, 0x00040017, 0x00000007, 0x00000006, 0x00000002, 0x00040015, 0x00000008, 0x00000020, 0x00000001, 
-    0x0004002b, 0x00000008, 0x00000009, 0x00000003, 0x0004001c, 0x00000005, 0x00000007, 0x00000009, 0x00040020, 
-    0x0000000a, 0x00000007, 0x00000005, 0x00040017, 0x0000000d, 0x00000006, 0x00000003, 0x0004001c, 0x0000000c, 
-    0x0000000d, 0x00000009, 0x00040020, 0x0000000e, 0x00000007, 0x0000000c, 0x00040020, 0x00000011, 0x00000001, 
-    0x00000008, 0x00040015, 0x00000013, 0x00000020, 0x00000000, 0x0004002b, 0x00000006, 0x00000017, 0x00000000, 
-    0x0004002b, 0x00000006, 0x00000018, 0xbf000000, 0x0005002c, 0x00000007, 0x00000016, 0x00000017, 0x00000018, 
-    0x0004002b, 0x00000006, 0x0000001a, 0x3f000000, 0x0005002c, 0x00000007, 0x00000019, 0x0000001a, 0x0000001a, 
-    0x0005002c, 0x00000007, 0x0000001b, 0x00000018, 0x0000001a, 0x0006002c, 0x00000005, 0x00000015, 0x00000016, 
-    0x00000019, 0x0000001b, 0x00040020, 0x0000001d, 0x00000007, 0x00000007, 0x0004002b, 0x00000006, 0x00000021, 
-    0x3f800000, 0x0005002c, 0x00000007, 0x00000020, 0x00000021, 0x00000021, 0x00040017, 0x00000022, 0x00000006, 
-    0x00000004, 0x0006002c, 0x0000000d, 0x00000025, 0x00000021, 0x00000017, 0x00000017, 0x0006002c, 0x0000000d, 
-    0x00000026, 0x00000017, 0x00000021, 0x00000017, 0x0006002c, 0x0000000d, 0x00000027, 0x00000017, 0x00000017, 
-    0x00000021, 0x0006002c, 0x0000000c, 0x00000024, 0x00000025, 0x00000026, 0x00000027, 0x00040020, 0x00000029, 
-    0x00000007, 0x0000000d, 0x00040020, 0x0000002c, 0x00000003, 0x00000022, 0x00040020, 0x0000002f, 0x00000003, 
-    0x0000000d, 0x00040020, 0x00000036, 0x00000001, 0x0000000d, 0x0004003b, 0x00000011, 0x00000012, 0x00000001, 
-    0x0004003b, 0x0000002c, 0x0000002d, 0x00000003, 0x0004003b, 0x0000002f, 0x00000030, 0x00000003, 0x0004003b, 
-    0x00000036, 0x00000037, 0x00000001, 0x0004003b, 0x0000002c, 0x0000003a, 0x00000003, 0x00050036, 0x00000001, 
-    0x00000002, 0x00000000, 0x00000003, 0x000200f8, 0x00000004, 0x0004003b, 0x0000000a, 0x0000000b, 0x00000007, 
-    0x0004003b, 0x0000000e, 0x0000000f, 0x00000007, 0x0004003d, 0x00000008, 0x00000010, 0x00000012, 0x0004007c, 
-    0x00000013, 0x00000014, 0x00000010, 0x0003003e, 0x0000000b, 0x00000015, 0x00050041, 0x0000001d, 0x0000001e, 
-    0x0000000b, 0x00000014, 0x0004003d, 0x00000007, 0x0000001f, 0x0000001e, 0x00050050, 0x00000022, 0x00000023, 
-    0x0000001f, 0x00000020, 0x0003003e, 0x0000000f, 0x00000024, 0x00050041, 0x00000029, 0x0000002a, 0x0000000f, 
-    0x00000014, 0x0004003d, 0x0000000d, 0x0000002b, 0x0000002a, 0x0003003e, 0x0000002d, 0x00000023, 0x0003003e, 
-    0x00000030, 0x0000002b, 0x000100fd, 0x00010038, 0x00050036, 0x00000001, 0x00000033, 0x00000000, 0x00000003, 
-    0x000200f8, 0x00000034, 0x0004003d, 0x0000000d, 0x00000035, 0x00000037, 0x0008004f, 0x0000000d, 0x00000038, 
-    0x00000035, 0x00000035, 0x00000000, 0x00000001, 0x00000002, 0x00050050, 0x00000022, 0x00000039, 0x00000038, 
-    0x00000021, 0x0003003e, 0x0000003a, 0x00000039, 0x000100fd, 0x00010038, 
-};
-
-const size_t triangle_spv_sizeInBytes = 1356;
-
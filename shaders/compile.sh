@@ -1,3 +1,16 @@
 #!/usr/bin/env bash
 
-/opt/shader-slang-bin/bin/slangc -target spirv -emit-spirv-directly -fvk-use-entrypoint-name -source-embed-style u32 -source-embed-name triangle_spv -o shaders/bin/triangle.h $(dirname "$0")/src/triangle.slang
\ No newline at end of file
+# Every shaders/src/<name>.slang becomes shaders/bin/<name>.h with the SPIR-V in <name>_spv, and
+# shaders/bin/<name>_reflection.h with its interface, written by the shader_reflect tool.
+# CMake runs this before building the renderer and passes both tools. Run by hand, set SHADER_REFLECT
+# to the built shader_reflect unless it is on the PATH, and SLANGC if slangc is installed elsewhere.
+SHADER_REFLECT=${SHADER_REFLECT:-shader_reflect}
+SLANGC=${SLANGC:-/opt/shader-slang-bin/bin/slangc}
+mkdir -p $(dirname "$0")/bin
+for source in $(dirname "$0")/src/*.slang; do
+    name=$(basename "$source" .slang)
+    "$SLANGC" -target spirv -emit-spirv-directly -fvk-use-entrypoint-name -source-embed-style u32 -source-embed-name ${name}_spv -o $(dirname "$0")/bin/${name}.h "$source" || exit 1
+    "$SLANGC" -target spirv -emit-spirv-directly -fvk-use-entrypoint-name -o $(dirname "$0")/bin/${name}.spv "$source" || exit 1
+    "$SHADER_REFLECT" ${name} $(dirname "$0")/bin/${name}.spv $(dirname "$0")/bin/${name}_reflection.h || exit 1
+    rm $(dirname "$0")/bin/${name}.spv
+done
@@ -0,0 +1,277 @@
+#include "allocator.h"
+
+#include "util.h"
+
+
+static VkDeviceSize align_up(VkDeviceSize p_value, VkDeviceSize p_alignment) {
+    return (p_value + p_alignment - 1) / p_alignment * p_alignment;
+}
+
+
+bool DeviceAllocator::initialize(VkPhysicalDevice p_physical_device, VkDevice p_device, VkDeviceSize p_block_size) {
+    device = p_device;
+    block_size = p_block_size;
+    vkGetPhysicalDeviceMemoryProperties(p_physical_device, &memory_properties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(p_physical_device, &properties);
+    max_allocation_count = properties.limits.maxMemoryAllocationCount;
+
+    return true;
+}
+
+
+void DeviceAllocator::cleanup() {
+    for (Block &block : blocks) {
+        if (block.memory != VK_NULL_HANDLE) {
+            vkFreeMemory(device, block.memory, nullptr);
+        }
+    }
+    blocks.clear();
+}
+
+
+bool DeviceAllocator::create_block(uint32_t p_memory_type, VkDeviceSize p_size, AllocationStrategy p_strategy, ResourceKind p_kind, bool p_dedicated, uint32_t &r_block_index) {
+    uint32_t allocation_count {0};
+    r_block_index = static_cast<uint32_t>(blocks.size());
+    for (uint32_t i = 0; i < blocks.size(); i++) {
+        if (blocks[i].memory != VK_NULL_HANDLE) {
+            allocation_count++;
+        } else if (r_block_index == blocks.size()) {
+            r_block_index = i;
+        }
+    }
+    if (allocation_count >= max_allocation_count) {
+        print("Reached maxMemoryAllocationCount (%u)!", max_allocation_count);
+        return false;
+    }
+
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = p_size;
+    alloc_info.memoryTypeIndex = p_memory_type;
+
+    Block block;
+    if (vkAllocateMemory(device, &alloc_info, nullptr, &block.memory) != VK_SUCCESS) {
+        return false;
+    }
+    if (memory_properties.memoryTypes[p_memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped) != VK_SUCCESS) {
+            vkFreeMemory(device, block.memory, nullptr);
+            return false;
+        }
+    }
+    block.size = p_size;
+    block.memory_type = p_memory_type;
+    block.strategy = p_strategy;
+    block.kind = p_kind;
+    block.dedicated = p_dedicated;
+    block.free_ranges.push_back({0, p_size});
+
+    if (r_block_index == blocks.size()) {
+        blocks.push_back(std::move(block));
+    } else {
+        blocks[r_block_index] = std::move(block);
+    }
+
+    return true;
+}
+
+
+bool DeviceAllocator::allocate_from_block(Block &p_block, VkDeviceSize p_size, VkDeviceSize p_alignment, VkDeviceSize &r_offset) {
+    if (p_block.strategy == AllocationStrategy::LINEAR) {
+        VkDeviceSize offset = align_up(p_block.linear_offset, p_alignment);
+        if (offset + p_size > p_block.size) {
+            return false;
+        }
+        p_block.linear_offset = offset + p_size;
+        r_offset = offset;
+        return true;
+    }
+
+    for (size_t i = 0; i < p_block.free_ranges.size(); i++) {
+        FreeRange range = p_block.free_ranges[i];
+        VkDeviceSize offset = align_up(range.offset, p_alignment);
+        VkDeviceSize padding = offset - range.offset;
+        if (range.size < padding + p_size) {
+            continue;
+        }
+
+        // Keep the alignment padding in front and the remainder behind as separate free ranges.
+        VkDeviceSize remainder = range.size - padding - p_size;
+        p_block.free_ranges.erase(p_block.free_ranges.begin() + i);
+        if (remainder > 0) {
+            p_block.free_ranges.insert(p_block.free_ranges.begin() + i, {offset + p_size, remainder});
+        }
+        if (padding > 0) {
+            p_block.free_ranges.insert(p_block.free_ranges.begin() + i, {range.offset, padding});
+        }
+
+        r_offset = offset;
+        return true;
+    }
+
+    return false;
+}
+
+
+bool DeviceAllocator::allocate(const VkMemoryRequirements &p_requirements, VkMemoryPropertyFlags p_properties, AllocationStrategy p_strategy, ResourceKind p_kind, Allocation &r_allocation) {
+    // Large resources get their own block instead of fragmenting a shared one.
+    bool dedicated = p_requirements.size > block_size / 2;
+
+    for (uint32_t type = 0; type < memory_properties.memoryTypeCount; type++) {
+        if (!(p_requirements.memoryTypeBits & (1u << type))
+            || (memory_properties.memoryTypes[type].propertyFlags & p_properties) != p_properties) {
+            continue;
+        }
+
+        uint32_t block_index = UINT32_MAX;
+        VkDeviceSize offset {0};
+        if (!dedicated) {
+            for (uint32_t i = 0; i < blocks.size(); i++) {
+                Block &block = blocks[i];
+                if (block.memory == VK_NULL_HANDLE || block.dedicated || block.memory_type != type
+                    || block.strategy != p_strategy || block.kind != p_kind) {
+                    continue;
+                }
+                if (allocate_from_block(block, p_requirements.size, p_requirements.alignment, offset)) {
+                    block_index = i;
+                    break;
+                }
+            }
+        }
+
+        if (block_index == UINT32_MAX) {
+            uint32_t new_block_index;
+            VkDeviceSize size = dedicated ? p_requirements.size : block_size;
+            if (!create_block(type, size, p_strategy, p_kind, dedicated, new_block_index)) {
+                continue;
+            }
+            if (!allocate_from_block(blocks[new_block_index], p_requirements.size, p_requirements.alignment, offset)) {
+                continue;
+            }
+            block_index = new_block_index;
+        }
+
+        Block &block = blocks[block_index];
+        block.live_allocations++;
+        r_allocation.memory = block.memory;
+        r_allocation.offset = offset;
+        r_allocation.size = p_requirements.size;
+        r_allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+        r_allocation.block_index = block_index;
+        return true;
+    }
+
+    return false;
+}
+
+
+void DeviceAllocator::free(Allocation &r_allocation) {
+    if (r_allocation.block_index >= blocks.size()) {
+        return;
+    }
+
+    Block &block = blocks[r_allocation.block_index];
+    block.live_allocations--;
+
+    if (block.dedicated) {
+        vkFreeMemory(device, block.memory, nullptr);
+        block = Block();
+    } else if (block.strategy == AllocationStrategy::LINEAR) {
+        if (block.live_allocations == 0) {
+            block.linear_offset = 0;
+        }
+    } else {
+        // Insert sorted and merge with the neighbours on both sides.
+        size_t i = 0;
+        while (i < block.free_ranges.size() && block.free_ranges[i].offset < r_allocation.offset) {
+            i++;
+        }
+        block.free_ranges.insert(block.free_ranges.begin() + i, {r_allocation.offset, r_allocation.size});
+
+        if (i + 1 < block.free_ranges.size()
+            && block.free_ranges[i].offset + block.free_ranges[i].size == block.free_ranges[i + 1].offset) {
+            block.free_ranges[i].size += block.free_ranges[i + 1].size;
+            block.free_ranges.erase(block.free_ranges.begin() + i + 1);
+        }
+        if (i > 0 && block.free_ranges[i - 1].offset + block.free_ranges[i - 1].size == block.free_ranges[i].offset) {
+            block.free_ranges[i - 1].size += block.free_ranges[i].size;
+            block.free_ranges.erase(block.free_ranges.begin() + i);
+        }
+    }
+
+    r_allocation = Allocation();
+}
+
+
+bool DeviceAllocator::create_buffer(VkDeviceSize p_size, VkBufferUsageFlags p_usage, VkMemoryPropertyFlags p_properties, AllocationStrategy p_strategy, VkBuffer &r_buffer, Allocation &r_allocation) {
+    return create_buffer(p_size, p_usage, p_properties, p_strategy, {}, r_buffer, r_allocation);
+}
+
+
+bool DeviceAllocator::create_buffer(VkDeviceSize p_size, VkBufferUsageFlags p_usage, VkMemoryPropertyFlags p_properties, AllocationStrategy p_strategy,
+    const std::vector<uint32_t> &p_queue_families, VkBuffer &r_buffer, Allocation &r_allocation) {
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = p_size;
+    buffer_info.usage = p_usage;
+    buffer_info.sharingMode = p_queue_families.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+    buffer_info.queueFamilyIndexCount = p_queue_families.size() > 1 ? static_cast<uint32_t>(p_queue_families.size()) : 0;
+    buffer_info.pQueueFamilyIndices = p_queue_families.data();
+
+    if (vkCreateBuffer(device, &buffer_info, nullptr, &r_buffer) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, r_buffer, &requirements);
+
+    if (!allocate(requirements, p_properties, p_strategy, ResourceKind::LINEAR, r_allocation)
+        || vkBindBufferMemory(device, r_buffer, r_allocation.memory, r_allocation.offset) != VK_SUCCESS) {
+        destroy_buffer(r_buffer, r_allocation);
+        return false;
+    }
+
+    return true;
+}
+
+
+void DeviceAllocator::destroy_buffer(VkBuffer &r_buffer, Allocation &r_allocation) {
+    // Buffers that were never created, e.g. after a failed initialization.
+    if (r_buffer == VK_NULL_HANDLE) {
+        return;
+    }
+    vkDestroyBuffer(device, r_buffer, nullptr);
+    r_buffer = VK_NULL_HANDLE;
+    free(r_allocation);
+}
+
+
+bool DeviceAllocator::create_image(const VkImageCreateInfo &p_create_info, VkMemoryPropertyFlags p_properties, VkImage &r_image, Allocation &r_allocation) {
+    if (vkCreateImage(device, &p_create_info, nullptr, &r_image) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device, r_image, &requirements);
+
+    ResourceKind kind = p_create_info.tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceKind::OPTIMAL_IMAGE : ResourceKind::LINEAR;
+    if (!allocate(requirements, p_properties, AllocationStrategy::POOL, kind, r_allocation)
+        || vkBindImageMemory(device, r_image, r_allocation.memory, r_allocation.offset) != VK_SUCCESS) {
+        destroy_image(r_image, r_allocation);
+        return false;
+    }
+
+    return true;
+}
+
+
+void DeviceAllocator::destroy_image(VkImage &r_image, Allocation &r_allocation) {
+    if (r_image == VK_NULL_HANDLE) {
+        return;
+    }
+    vkDestroyImage(device, r_image, nullptr);
+    r_image = VK_NULL_HANDLE;
+    free(r_allocation);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+enum class AllocationStrategy {
+    // Bump allocation. Space is reclaimed only once every allocation in the block has been freed.
+    LINEAR,
+    // First-fit free list with coalescing, for resources with independent lifetimes.
+    POOL,
+};
+
+// Buffers and linear images must not share pages with optimal-tiling images
+// (bufferImageGranularity), so the two kinds live in separate blocks.
+enum class ResourceKind {
+    LINEAR,
+    OPTIMAL_IMAGE,
+};
+
+struct Allocation {
+    VkDeviceMemory memory{ VK_NULL_HANDLE };
+    VkDeviceSize offset{ 0 };
+    VkDeviceSize size{ 0 };
+    // Host-visible blocks are mapped once for their whole lifetime.
+    void* mapped{ nullptr };
+    uint32_t block_index{ UINT32_MAX };
+};
+
+// Suballocates resources from a few large VkDeviceMemory blocks, which keeps us far
+// below maxMemoryAllocationCount and avoids a driver allocation per resource.
+class DeviceAllocator {
+
+private:
+    struct FreeRange {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+    };
+
+    struct Block {
+        VkDeviceMemory memory{ VK_NULL_HANDLE };
+        VkDeviceSize size{ 0 };
+        uint32_t memory_type{ 0 };
+        AllocationStrategy strategy{ AllocationStrategy::POOL };
+        ResourceKind kind{ ResourceKind::LINEAR };
+        bool dedicated{ false };
+        void* mapped{ nullptr };
+        uint32_t live_allocations{ 0 };
+        VkDeviceSize linear_offset{ 0 };
+        // Sorted by offset, never adjacent.
+        std::vector<FreeRange> free_ranges;
+    };
+
+    VkDevice device{ VK_NULL_HANDLE };
+    VkPhysicalDeviceMemoryProperties memory_properties{};
+    uint32_t max_allocation_count{ 0 };
+    VkDeviceSize block_size{ 0 };
+    std::vector<Block> blocks;
+
+    bool create_block(uint32_t p_memory_type, VkDeviceSize p_size, AllocationStrategy p_strategy, ResourceKind p_kind, bool p_dedicated, uint32_t &r_block_index);
+    bool allocate_from_block(Block &p_block, VkDeviceSize p_size, VkDeviceSize p_alignment, VkDeviceSize &r_offset);
+
+public:
+    bool initialize(VkPhysicalDevice p_physical_device, VkDevice p_device, VkDeviceSize p_block_size = 64ull * 1024 * 1024);
+    void cleanup();
+
+    bool allocate(const VkMemoryRequirements &p_requirements, VkMemoryPropertyFlags p_properties, AllocationStrategy p_strategy, ResourceKind p_kind, Allocation &r_allocation);
+    void free(Allocation &r_allocation);
+
+    bool create_buffer(VkDeviceSize p_size, VkBufferUsageFlags p_usage, VkMemoryPropertyFlags p_properties, AllocationStrategy p_strategy, VkBuffer &r_buffer, Allocation &r_allocation);
+    // With more than one queue family the buffer is shared concurrently and needs no ownership transfers.
+    bool create_buffer(VkDeviceSize p_size, VkBufferUsageFlags p_usage, VkMemoryPropertyFlags p_properties, AllocationStrategy p_strategy,
+        const std::vector<uint32_t> &p_queue_families, VkBuffer &r_buffer, Allocation &r_allocation);
+    void destroy_buffer(VkBuffer &r_buffer, Allocation &r_allocation);
+    bool create_image(const VkImageCreateInfo &p_create_info, VkMemoryPropertyFlags p_properties, VkImage &r_image, Allocation &r_allocation);
+    void destroy_image(VkImage &r_image, Allocation &r_allocation);
+
+    uint32_t get_block_count() const { return static_cast<uint32_t>(blocks.size()); }
+
+    DeviceAllocator() {};
+    ~DeviceAllocator() {};
+};
@@ -0,0 +1,149 @@
+#include "benchmark.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+#include "util.h"
+
+
+static void write_summary(std::ofstream &p_file, const char* p_name, const TimeSummary &p_summary) {
+    p_file << "  \"" << p_name << "\": {"
+           << "\"min\": " << p_summary.min_ms
+           << ", \"mean\": " << p_summary.mean_ms
+           << ", \"p50\": " << p_summary.p50_ms
+           << ", \"p95\": " << p_summary.p95_ms
+           << ", \"p99\": " << p_summary.p99_ms
+           << ", \"max\": " << p_summary.max_ms << "}";
+}
+
+
+static void print_summary(const char* p_name, const TimeSummary &p_summary) {
+    print("  %-6s min %.3f  mean %.3f  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f ms", p_name,
+        p_summary.min_ms, p_summary.mean_ms, p_summary.p50_ms, p_summary.p95_ms, p_summary.p99_ms, p_summary.max_ms);
+}
+
+
+TimeSummary Benchmark::summarize(std::vector<double> p_samples) {
+    TimeSummary summary;
+    if (p_samples.empty()) {
+        return summary;
+    }
+    std::sort(p_samples.begin(), p_samples.end());
+
+    // Nearest-rank percentiles, so every reported value is a frame that actually happened.
+    auto percentile = [&p_samples](double p_percent) {
+        size_t rank = (size_t)std::ceil(p_percent * 0.01 * double(p_samples.size()));
+        return p_samples[std::min(p_samples.size(), std::max<size_t>(rank, 1)) - 1];
+    };
+
+    double sum {0.0};
+    for (double sample : p_samples) {
+        sum += sample;
+    }
+
+    summary.min_ms = p_samples.front();
+    summary.mean_ms = sum / double(p_samples.size());
+    summary.p50_ms = percentile(50.0);
+    summary.p95_ms = percentile(95.0);
+    summary.p99_ms = percentile(99.0);
+    summary.max_ms = p_samples.back();
+    return summary;
+}
+
+
+void Benchmark::start(const BenchmarkSettings &p_settings) {
+    settings = p_settings;
+    warmup_remaining = settings.warmup_frames;
+    frame_times_ms.clear();
+    cpu_times_ms.clear();
+    gpu_times_ms.clear();
+    frame_times_ms.reserve(settings.frames);
+    cpu_times_ms.reserve(settings.frames);
+    gpu_times_ms.reserve(settings.frames);
+    start_ns = SDL_GetTicksNS();
+    end_ns = start_ns;
+
+    if (settings.duration_s > 0.0) {
+        print("Benchmark: %u warm-up frames, then %.1f s", settings.warmup_frames, settings.duration_s);
+    } else {
+        print("Benchmark: %u warm-up frames, then %u frames", settings.warmup_frames, settings.frames);
+    }
+}
+
+
+bool Benchmark::add_frame(double p_frame_ms, double p_cpu_ms, double p_gpu_ms) {
+    uint64_t now = SDL_GetTicksNS();
+    if (warmup_remaining > 0) {
+        warmup_remaining--;
+        start_ns = now;
+        end_ns = now;
+        return true;
+    }
+
+    frame_times_ms.push_back(p_frame_ms);
+    cpu_times_ms.push_back(p_cpu_ms);
+    if (p_gpu_ms >= 0.0) {
+        gpu_times_ms.push_back(p_gpu_ms);
+    }
+    end_ns = now;
+
+    if (settings.duration_s > 0.0) {
+        return double(now - start_ns) * 0.000000001 < settings.duration_s;
+    }
+    return frame_times_ms.size() < settings.frames;
+}
+
+
+bool Benchmark::report(const Renderer &p_renderer) const {
+    const RendererSettings &renderer_settings = p_renderer.get_settings();
+    TimeSummary frame_summary = summarize(frame_times_ms);
+    TimeSummary cpu_summary = summarize(cpu_times_ms);
+    TimeSummary gpu_summary = summarize(gpu_times_ms);
+    double elapsed_s = double(end_ns - start_ns) * 0.000000001;
+
+    print("Benchmark results: %u frames in %.3f s on %s", (uint32_t)frame_times_ms.size(), elapsed_s, p_renderer.get_device_name().c_str());
+    print_summary("frame", frame_summary);
+    print_summary("cpu", cpu_summary);
+    if (!gpu_times_ms.empty()) {
+        print_summary("gpu", gpu_summary);
+    }
+
+    if (settings.output_path.empty()) {
+        return true;
+    }
+    std::ofstream file(settings.output_path);
+    if (!file.is_open()) {
+        print("Could not open file '%s'!", settings.output_path.c_str());
+        return false;
+    }
+
+    file << "{\n";
+    file << "  \"device\": \"" << p_renderer.get_device_name() << "\",\n";
+    file << "  \"headless\": " << (renderer_settings.headless ? "true" : "false") << ",\n";
+    file << "  \"present_mode\": \"" << p_renderer.get_present_mode_name() << "\",\n";
+    file << "  \"frames_in_flight\": " << renderer_settings.frames_in_flight << ",\n";
+    file << "  \"recording_threads\": " << renderer_settings.recording_threads << ",\n";
+    file << "  \"draws\": " << renderer_settings.draw_count << ",\n";
+    file << "  \"instances\": " << renderer_settings.instance_count << ",\n";
+    file << "  \"warmup_frames\": " << settings.warmup_frames << ",\n";
+    file << "  \"frames\": " << frame_times_ms.size() << ",\n";
+    file << "  \"duration_s\": " << elapsed_s << ",\n";
+    write_summary(file, "frame_time_ms", frame_summary);
+    file << ",\n";
+    write_summary(file, "cpu_time_ms", cpu_summary);
+    file << ",\n";
+    if (gpu_times_ms.empty()) {
+        file << "  \"gpu_time_ms\": null\n";
+    } else {
+        write_summary(file, "gpu_time_ms", gpu_summary);
+        file << "\n";
+    }
+    file << "}\n";
+
+    if (!file.good()) {
+        return false;
+    }
+    print("Wrote benchmark results to '%s'", settings.output_path.c_str());
+    return true;
+}
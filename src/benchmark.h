@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "renderer.h"
+
+struct BenchmarkSettings {
+    // Frames rendered before measuring, to get past pipeline creation, first uploads and clock ramp-up.
+    uint32_t warmup_frames{ 60 };
+    uint32_t frames{ 600 };
+    // Measure for this many seconds instead of a fixed number of frames when non-zero.
+    double duration_s{ 0.0 };
+    std::string output_path{ "benchmark.json" };
+};
+
+struct TimeSummary {
+    double min_ms{ 0.0 };
+    double mean_ms{ 0.0 };
+    double p50_ms{ 0.0 };
+    double p95_ms{ 0.0 };
+    double p99_ms{ 0.0 };
+    double max_ms{ 0.0 };
+};
+
+// Collects per-frame timings after a warm-up phase and reports their distribution,
+// both as a log summary and as JSON for tracking regressions between runs.
+class Benchmark {
+
+private:
+    BenchmarkSettings settings;
+    uint32_t warmup_remaining{ 0 };
+    uint64_t start_ns{ 0 };
+    uint64_t end_ns{ 0 };
+    // Time between the starts of consecutive frames.
+    std::vector<double> frame_times_ms;
+    // Time spent inside Renderer::draw().
+    std::vector<double> cpu_times_ms;
+    std::vector<double> gpu_times_ms;
+
+    static TimeSummary summarize(std::vector<double> p_samples);
+
+public:
+    void start(const BenchmarkSettings &p_settings);
+    // Returns false once enough frames have been measured. A negative p_gpu_ms means no GPU time.
+    bool add_frame(double p_frame_ms, double p_cpu_ms, double p_gpu_ms);
+    bool is_warming_up() const { return warmup_remaining > 0; }
+    // Logs the summary and writes the JSON report.
+    bool report(const Renderer &p_renderer) const;
+
+    Benchmark() {};
+    ~Benchmark() {};
+};
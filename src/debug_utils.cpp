@@ -0,0 +1,124 @@
+#include "debug_utils.h"
+
+#include <cstring>
+#include <vector>
+
+#include "util.h"
+
+static PFN_vkSetDebugUtilsObjectNameEXT set_object_name{ nullptr };
+static PFN_vkCmdBeginDebugUtilsLabelEXT cmd_begin_label{ nullptr };
+static PFN_vkCmdEndDebugUtilsLabelEXT cmd_end_label{ nullptr };
+
+
+static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT p_severity,
+    VkDebugUtilsMessageTypeFlagsEXT p_types, const VkDebugUtilsMessengerCallbackDataEXT* p_data, void* p_user_data) {
+    const char* severity = "info";
+    if (p_severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+        severity = "error";
+    } else if (p_severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+        severity = "warning";
+    }
+    print("Vulkan %s: %s", severity, p_data->pMessage);
+    // Never abort the call that triggered the message.
+    return VK_FALSE;
+}
+
+
+bool has_instance_layer(const char* p_name) {
+    uint32_t count {0};
+    vkEnumerateInstanceLayerProperties(&count, nullptr);
+    std::vector<VkLayerProperties> layers(count);
+    vkEnumerateInstanceLayerProperties(&count, layers.data());
+    for (const VkLayerProperties &layer : layers) {
+        if (strcmp(layer.layerName, p_name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool has_instance_extension(const char* p_name) {
+    uint32_t count {0};
+    vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+    std::vector<VkExtensionProperties> extensions(count);
+    vkEnumerateInstanceExtensionProperties(nullptr, &count, extensions.data());
+    for (const VkExtensionProperties &extension : extensions) {
+        if (strcmp(extension.extensionName, p_name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+VkDebugUtilsMessengerCreateInfoEXT get_debug_messenger_info() {
+    VkDebugUtilsMessengerCreateInfoEXT messenger_info = {};
+    messenger_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+    messenger_info.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    messenger_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
+        | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    messenger_info.pfnUserCallback = debug_callback;
+    return messenger_info;
+}
+
+
+bool load_debug_utils(VkInstance p_instance) {
+    // Extension commands are not exported by the loader, so they are looked up here.
+    set_object_name = (PFN_vkSetDebugUtilsObjectNameEXT)vkGetInstanceProcAddr(p_instance, "vkSetDebugUtilsObjectNameEXT");
+    cmd_begin_label = (PFN_vkCmdBeginDebugUtilsLabelEXT)vkGetInstanceProcAddr(p_instance, "vkCmdBeginDebugUtilsLabelEXT");
+    cmd_end_label = (PFN_vkCmdEndDebugUtilsLabelEXT)vkGetInstanceProcAddr(p_instance, "vkCmdEndDebugUtilsLabelEXT");
+    if (set_object_name == nullptr || cmd_begin_label == nullptr || cmd_end_label == nullptr) {
+        set_object_name = nullptr;
+        cmd_begin_label = nullptr;
+        cmd_end_label = nullptr;
+        return false;
+    }
+    return true;
+}
+
+
+bool create_debug_messenger(VkInstance p_instance, VkDebugUtilsMessengerEXT &r_messenger) {
+    auto create = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(p_instance, "vkCreateDebugUtilsMessengerEXT");
+    VkDebugUtilsMessengerCreateInfoEXT messenger_info = get_debug_messenger_info();
+    return create != nullptr && create(p_instance, &messenger_info, nullptr, &r_messenger) == VK_SUCCESS;
+}
+
+
+void destroy_debug_messenger(VkInstance p_instance, VkDebugUtilsMessengerEXT p_messenger) {
+    auto destroy = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(p_instance, "vkDestroyDebugUtilsMessengerEXT");
+    if (destroy != nullptr && p_messenger != VK_NULL_HANDLE) {
+        destroy(p_instance, p_messenger, nullptr);
+    }
+}
+
+
+void set_debug_name(VkDevice p_device, VkObjectType p_type, uint64_t p_handle, const char* p_name) {
+    if (set_object_name == nullptr || p_handle == 0) {
+        return;
+    }
+    VkDebugUtilsObjectNameInfoEXT name_info = {};
+    name_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+    name_info.objectType = p_type;
+    name_info.objectHandle = p_handle;
+    name_info.pObjectName = p_name;
+    set_object_name(p_device, &name_info);
+}
+
+
+void begin_debug_label(VkCommandBuffer p_command_buffer, const char* p_name) {
+    if (cmd_begin_label == nullptr) {
+        return;
+    }
+    VkDebugUtilsLabelEXT label = {};
+    label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+    label.pLabelName = p_name;
+    cmd_begin_label(p_command_buffer, &label);
+}
+
+
+void end_debug_label(VkCommandBuffer p_command_buffer) {
+    if (cmd_end_label != nullptr) {
+        cmd_end_label(p_command_buffer);
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// Validation and VK_EXT_debug_utils, only compiled in with the VULKAN_DEBUG CMake option.
+// Without it the macros below expand to nothing, arguments included, so release builds do
+// not even format the names they would pass.
+#ifdef VULKAN_DEBUG
+
+constexpr const char* VALIDATION_LAYER_NAME{ "VK_LAYER_KHRONOS_validation" };
+
+bool has_instance_layer(const char* p_name);
+bool has_instance_extension(const char* p_name);
+// Also chained into VkInstanceCreateInfo, so instance creation itself is covered.
+VkDebugUtilsMessengerCreateInfoEXT get_debug_messenger_info();
+// Loads the debug_utils entry points. Names and labels stay no-ops until this succeeded.
+bool load_debug_utils(VkInstance p_instance);
+bool create_debug_messenger(VkInstance p_instance, VkDebugUtilsMessengerEXT &r_messenger);
+void destroy_debug_messenger(VkInstance p_instance, VkDebugUtilsMessengerEXT p_messenger);
+void set_debug_name(VkDevice p_device, VkObjectType p_type, uint64_t p_handle, const char* p_name);
+void begin_debug_label(VkCommandBuffer p_command_buffer, const char* p_name);
+void end_debug_label(VkCommandBuffer p_command_buffer);
+
+// p_handle must be a raw Vulkan handle, not a UniqueHandle.
+#define DEBUG_NAME(p_device, p_type, p_handle, p_name) set_debug_name(p_device, p_type, (uint64_t)(p_handle), p_name)
+#define DEBUG_LABEL_BEGIN(p_command_buffer, p_name) begin_debug_label(p_command_buffer, p_name)
+#define DEBUG_LABEL_END(p_command_buffer) end_debug_label(p_command_buffer)
+
+#else
+
+#define DEBUG_NAME(p_device, p_type, p_handle, p_name) ((void)0)
+#define DEBUG_LABEL_BEGIN(p_command_buffer, p_name) ((void)0)
+#define DEBUG_LABEL_END(p_command_buffer) ((void)0)
+
+#endif
@@ -0,0 +1,24 @@
+#include "deletion_queue.h"
+
+#include <utility>
+
+
+void DeletionQueue::push(uint64_t p_last_submit, std::function<void()> p_destroy) {
+    entries.push_back({p_last_submit, std::move(p_destroy)});
+}
+
+
+void DeletionQueue::collect(uint64_t p_completed_submit) {
+    while (!entries.empty() && entries.front().last_submit <= p_completed_submit) {
+        entries.front().destroy();
+        entries.pop_front();
+    }
+}
+
+
+void DeletionQueue::flush() {
+    for (Entry &entry : entries) {
+        entry.destroy();
+    }
+    entries.clear();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+#include "vulkan_handle.h"
+
+// Destroys objects once the GPU is done with them instead of idling the device. Every entry
+// is tagged with the last submission that may still use the object and runs once the fence
+// of that submission has signalled. Submissions are numbered in order, so the queue stays
+// sorted and collecting only ever looks at its front.
+class DeletionQueue {
+
+private:
+    struct Entry {
+        uint64_t last_submit;
+        std::function<void()> destroy;
+    };
+
+    std::deque<Entry> entries;
+
+public:
+    void push(uint64_t p_last_submit, std::function<void()> p_destroy);
+
+    template <typename T, DestroyFunction<T> DESTROY>
+    void push(uint64_t p_last_submit, UniqueHandle<T, DESTROY> &&p_handle) {
+        VkDevice device = p_handle.get_device();
+        T handle = p_handle.release();
+        if (handle != VK_NULL_HANDLE) {
+            push(p_last_submit, [device, handle]() { DESTROY(device, handle, nullptr); });
+        }
+    }
+
+    // Destroys everything whose last submission is at or before p_completed_submit.
+    void collect(uint64_t p_completed_submit);
+    // Destroys everything. Only valid once the device is idle.
+    void flush();
+
+    size_t size() const { return entries.size(); }
+
+    DeletionQueue() {};
+    ~DeletionQueue() {};
+};
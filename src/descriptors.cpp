@@ -0,0 +1,276 @@
+#include "descriptors.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+bool UniformRing::initialize(VkPhysicalDevice p_physical_device, VkDevice p_device, DeviceAllocator &p_allocator, VkDeviceSize p_capacity, uint32_t p_frame_count) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(p_physical_device, &properties);
+    alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 16);
+    capacity = (p_capacity + alignment - 1) / alignment * alignment;
+    frames.resize(p_frame_count);
+
+    VkMemoryPropertyFlags host_memory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (FrameBuffer &frame : frames) {
+        if (!p_allocator.create_buffer(capacity, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, host_memory, AllocationStrategy::POOL, frame.buffer, frame.allocation)) {
+            return false;
+        }
+    }
+
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = 1;
+    layout_info.pBindings = &binding;
+
+    if (vkCreateDescriptorSetLayout(p_device, &layout_info, nullptr, set_layout.put(p_device)) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkDescriptorPoolSize pool_size = {};
+    pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    pool_size.descriptorCount = p_frame_count;
+
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = p_frame_count;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+
+    if (vkCreateDescriptorPool(p_device, &pool_info, nullptr, descriptor_pool.put(p_device)) != VK_SUCCESS) {
+        return false;
+    }
+
+    for (FrameBuffer &frame : frames) {
+        VkDescriptorSetAllocateInfo alloc_info = {};
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = descriptor_pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = set_layout.address();
+
+        if (vkAllocateDescriptorSets(p_device, &alloc_info, &frame.set) != VK_SUCCESS) {
+            return false;
+        }
+
+        VkDescriptorBufferInfo buffer_info = {};
+        buffer_info.buffer = frame.buffer;
+        buffer_info.offset = 0;
+        buffer_info.range = MAX_UNIFORM_BLOCK_SIZE;
+
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = frame.set;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        write.pBufferInfo = &buffer_info;
+        vkUpdateDescriptorSets(p_device, 1, &write, 0, nullptr);
+    }
+
+    begin(0);
+    return true;
+}
+
+
+void UniformRing::cleanup(DeviceAllocator &p_allocator) {
+    for (FrameBuffer &frame : frames) {
+        if (frame.buffer != VK_NULL_HANDLE) {
+            p_allocator.destroy_buffer(frame.buffer, frame.allocation);
+        }
+    }
+    frames.clear();
+    descriptor_pool.reset();
+    set_layout.reset();
+    mapped = nullptr;
+}
+
+
+void UniformRing::begin(uint32_t p_slot) {
+    current_slot = p_slot;
+    mapped = static_cast<uint8_t*>(frames[p_slot].allocation.mapped);
+    head.store(0, std::memory_order_relaxed);
+}
+
+
+bool UniformRing::push(const void* p_data, VkDeviceSize p_size, uint32_t &r_offset) {
+    if (p_size > MAX_UNIFORM_BLOCK_SIZE) {
+        return false;
+    }
+
+    VkDeviceSize size = (p_size + alignment - 1) / alignment * alignment;
+    VkDeviceSize offset = head.fetch_add(size, std::memory_order_relaxed);
+    // The descriptor always covers MAX_UNIFORM_BLOCK_SIZE bytes, which must stay inside the buffer.
+    if (offset + MAX_UNIFORM_BLOCK_SIZE > capacity) {
+        return false;
+    }
+
+    memcpy(mapped + offset, p_data, p_size);
+    r_offset = static_cast<uint32_t>(offset);
+    return true;
+}
+
+
+bool BindlessSet::initialize(VkDevice p_device, uint32_t p_texture_count, uint32_t p_sampler_count, uint32_t p_storage_buffer_count) {
+    device = p_device;
+    capacities[BINDLESS_TEXTURES] = p_texture_count;
+    capacities[BINDLESS_SAMPLERS] = p_sampler_count;
+    capacities[BINDLESS_STORAGE_BUFFERS] = p_storage_buffer_count;
+
+    const VkDescriptorType types[BINDLESS_BINDING_COUNT] = {
+        VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+        VK_DESCRIPTOR_TYPE_SAMPLER,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    };
+
+    VkDescriptorSetLayoutBinding bindings[BINDLESS_BINDING_COUNT] = {};
+    VkDescriptorBindingFlags binding_flags[BINDLESS_BINDING_COUNT] = {};
+    VkDescriptorPoolSize pool_sizes[BINDLESS_BINDING_COUNT] = {};
+    for (uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = types[i];
+        bindings[i].descriptorCount = capacities[i];
+        bindings[i].stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT;
+        // Unused slots may stay empty, and slots can be filled while earlier frames are still in flight.
+        binding_flags[i] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+            | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+        pool_sizes[i].type = types[i];
+        pool_sizes[i].descriptorCount = capacities[i];
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info = {};
+    flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    flags_info.bindingCount = BINDLESS_BINDING_COUNT;
+    flags_info.pBindingFlags = binding_flags;
+
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.pNext = &flags_info;
+    layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layout_info.bindingCount = BINDLESS_BINDING_COUNT;
+    layout_info.pBindings = bindings;
+
+    if (vkCreateDescriptorSetLayout(device, &layout_info, nullptr, set_layout.put(device)) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = BINDLESS_BINDING_COUNT;
+    pool_info.pPoolSizes = pool_sizes;
+
+    if (vkCreateDescriptorPool(device, &pool_info, nullptr, descriptor_pool.put(device)) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = descriptor_pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = set_layout.address();
+
+    return vkAllocateDescriptorSets(device, &alloc_info, &set) == VK_SUCCESS;
+}
+
+
+void BindlessSet::cleanup() {
+    descriptor_pool.reset();
+    set_layout.reset();
+    set = VK_NULL_HANDLE;
+}
+
+
+uint32_t BindlessSet::allocate_index(BindlessBinding p_binding) {
+    std::vector<uint32_t> &free_list = free_indices[p_binding];
+    if (!free_list.empty()) {
+        uint32_t index = free_list.back();
+        free_list.pop_back();
+        return index;
+    }
+    if (next_indices[p_binding] == capacities[p_binding]) {
+        return BINDLESS_INVALID_INDEX;
+    }
+    return next_indices[p_binding]++;
+}
+
+
+uint32_t BindlessSet::add_texture(VkImageView p_image_view, VkImageLayout p_layout) {
+    uint32_t index = allocate_index(BINDLESS_TEXTURES);
+    if (index == BINDLESS_INVALID_INDEX) {
+        return index;
+    }
+
+    VkDescriptorImageInfo image_info = {};
+    image_info.imageView = p_image_view;
+    image_info.imageLayout = p_layout;
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set;
+    write.dstBinding = BINDLESS_TEXTURES;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    write.pImageInfo = &image_info;
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    return index;
+}
+
+
+uint32_t BindlessSet::add_sampler(VkSampler p_sampler) {
+    uint32_t index = allocate_index(BINDLESS_SAMPLERS);
+    if (index == BINDLESS_INVALID_INDEX) {
+        return index;
+    }
+
+    VkDescriptorImageInfo image_info = {};
+    image_info.sampler = p_sampler;
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set;
+    write.dstBinding = BINDLESS_SAMPLERS;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+    write.pImageInfo = &image_info;
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    return index;
+}
+
+
+uint32_t BindlessSet::add_storage_buffer(VkBuffer p_buffer, VkDeviceSize p_offset, VkDeviceSize p_range) {
+    uint32_t index = allocate_index(BINDLESS_STORAGE_BUFFERS);
+    if (index == BINDLESS_INVALID_INDEX) {
+        return index;
+    }
+
+    VkDescriptorBufferInfo buffer_info = {};
+    buffer_info.buffer = p_buffer;
+    buffer_info.offset = p_offset;
+    buffer_info.range = p_range;
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set;
+    write.dstBinding = BINDLESS_STORAGE_BUFFERS;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &buffer_info;
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    return index;
+}
+
+
+void BindlessSet::release(BindlessBinding p_binding, uint32_t p_index) {
+    // The stale descriptor stays in place; it is partially bound and no shader indexes it any more.
+    free_indices[p_binding].push_back(p_index);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "allocator.h"
+#include "vulkan_handle.h"
+
+// Largest block one dynamic offset can expose. 256 bytes is the worst minUniformBufferOffsetAlignment.
+constexpr VkDeviceSize MAX_UNIFORM_BLOCK_SIZE{ 256 };
+constexpr uint32_t BINDLESS_INVALID_INDEX{ UINT32_MAX };
+
+// The bindings of the global set, matching shaders/src/triangle.slang.
+enum BindlessBinding {
+    BINDLESS_TEXTURES,
+    BINDLESS_SAMPLERS,
+    BINDLESS_STORAGE_BUFFERS,
+    BINDLESS_BINDING_COUNT,
+};
+
+// Per-draw constants in a persistently mapped buffer per frame slot, exposed through a single
+// VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC descriptor. Pushing a block only bumps an atomic
+// offset, so recording threads can push without locks, and the descriptor set never changes:
+// draws only pass a different dynamic offset.
+class UniformRing {
+
+private:
+    struct FrameBuffer {
+        VkBuffer buffer{ VK_NULL_HANDLE };
+        Allocation allocation;
+        VkDescriptorSet set{ VK_NULL_HANDLE };
+    };
+
+    VkDeviceSize alignment{ 0 };
+    VkDeviceSize capacity{ 0 };
+    std::vector<FrameBuffer> frames;
+    UniqueDescriptorSetLayout set_layout;
+    UniqueDescriptorPool descriptor_pool;
+    uint32_t current_slot{ 0 };
+    uint8_t* mapped{ nullptr };
+    std::atomic<VkDeviceSize> head{ 0 };
+
+public:
+    bool initialize(VkPhysicalDevice p_physical_device, VkDevice p_device, DeviceAllocator &p_allocator, VkDeviceSize p_capacity, uint32_t p_frame_count);
+    void cleanup(DeviceAllocator &p_allocator);
+
+    // The fence of p_slot has signalled, so its buffer can be overwritten from the start.
+    void begin(uint32_t p_slot);
+    // Thread-safe. Copies p_size bytes, at most MAX_UNIFORM_BLOCK_SIZE, and returns the dynamic
+    // offset to bind them with. Returns false when this frame's buffer is full.
+    bool push(const void* p_data, VkDeviceSize p_size, uint32_t &r_offset);
+
+    VkDescriptorSetLayout get_set_layout() const { return set_layout; }
+    VkDescriptorSet get_set() const { return frames[current_slot].set; }
+
+    UniformRing() {};
+    ~UniformRing() {};
+};
+
+// One global, update-after-bind descriptor set with large partially bound arrays of textures,
+// samplers and storage buffers (descriptor indexing, core in Vulkan 1.2). It is bound once per
+// command buffer and shaders pick resources by index, so draws never rebind sets. Render thread only.
+class BindlessSet {
+
+private:
+    VkDevice device{ VK_NULL_HANDLE };
+    UniqueDescriptorSetLayout set_layout;
+    UniqueDescriptorPool descriptor_pool;
+    VkDescriptorSet set{ VK_NULL_HANDLE };
+    uint32_t capacities[BINDLESS_BINDING_COUNT]{};
+    uint32_t next_indices[BINDLESS_BINDING_COUNT]{};
+    std::vector<uint32_t> free_indices[BINDLESS_BINDING_COUNT];
+
+    uint32_t allocate_index(BindlessBinding p_binding);
+
+public:
+    bool initialize(VkDevice p_device, uint32_t p_texture_count, uint32_t p_sampler_count, uint32_t p_storage_buffer_count);
+    void cleanup();
+
+    // Return the index shaders use to reach the resource, or BINDLESS_INVALID_INDEX when the array is full.
+    uint32_t add_texture(VkImageView p_image_view, VkImageLayout p_layout);
+    uint32_t add_sampler(VkSampler p_sampler);
+    uint32_t add_storage_buffer(VkBuffer p_buffer, VkDeviceSize p_offset, VkDeviceSize p_range);
+    // Only once no frame in flight can use p_index any more, e.g. from the deletion queue.
+    void release(BindlessBinding p_binding, uint32_t p_index);
+
+    VkDescriptorSetLayout get_set_layout() const { return set_layout; }
+    VkDescriptorSet get_set() const { return set; }
+
+    BindlessSet() {};
+    ~BindlessSet() {};
+};
@@ -0,0 +1,66 @@
+#include "job_system.h"
+
+
+void JobSystem::worker_loop(uint32_t p_worker_index, uint64_t p_generation) {
+    // Start from the generation at spawn time, so a restarted pool never re-runs an old job.
+    uint64_t seen_generation {p_generation};
+
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        work_available.wait(lock, [&] { return stopping || generation != seen_generation; });
+        if (stopping) {
+            return;
+        }
+        seen_generation = generation;
+        const std::function<void(uint32_t)>* current_job = job;
+        lock.unlock();
+
+        (*current_job)(p_worker_index);
+
+        lock.lock();
+        if (--pending == 0) {
+            work_done.notify_one();
+        }
+    }
+}
+
+
+void JobSystem::start(uint32_t p_worker_count) {
+    stop();
+
+    stopping = false;
+    workers.reserve(p_worker_count);
+    for (uint32_t i = 0; i < p_worker_count; i++) {
+        workers.emplace_back(&JobSystem::worker_loop, this, i, generation);
+    }
+}
+
+
+void JobSystem::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+
+void JobSystem::run(const std::function<void(uint32_t)> &p_job) {
+    if (workers.empty()) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    job = &p_job;
+    pending = static_cast<uint32_t>(workers.size());
+    generation++;
+    work_available.notify_all();
+
+    work_done.wait(lock, [this] { return pending == 0; });
+    job = nullptr;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that all run the same job, each with its own worker index.
+// The index is stable per thread, so per-worker resources like command pools are never shared.
+class JobSystem {
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::condition_variable work_done;
+    const std::function<void(uint32_t)>* job{ nullptr };
+    uint64_t generation{ 0 };
+    uint32_t pending{ 0 };
+    bool stopping{ false };
+
+    void worker_loop(uint32_t p_worker_index, uint64_t p_generation);
+
+public:
+    void start(uint32_t p_worker_count);
+    void stop();
+    // Runs p_job(worker_index) once on every worker and returns when all of them are done.
+    void run(const std::function<void(uint32_t)> &p_job);
+    uint32_t get_worker_count() const { return static_cast<uint32_t>(workers.size()); }
+
+    JobSystem() {};
+    ~JobSystem() { stop(); };
+};
@@ -5,18 +5,74 @@
 
 #include <string>
 #include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
 
 
 
 #include "util.h"
 #include "renderer.h"
+#include "benchmark.h"
+#include "triple_buffer.h"
 
-SDL_Window* gWindow{ nullptr };
+// Views of the same scene, all drawn by one device. Empty when headless.
+std::vector<SDL_Window*> gWindows;
+uint32_t window_count {1};
 
 Uint64 previous_time {0};
 double delta {0.0};
 
+// Quit after this many frames when non-zero, so headless runs terminate on their own.
+uint64_t frame_limit {0};
+uint64_t frame_count {0};
+std::string output_path;
+
+constexpr uint32_t RECORD_BENCHMARK_ITERATIONS{ 200 };
+bool record_benchmark {false};
+
+// 2D quads submitted through the primitive batch every frame, as a stress test.
+uint32_t primitive_count {0};
+
+bool run_benchmark {false};
+BenchmarkSettings benchmark_settings;
+Benchmark gBenchmark;
+
 Renderer gRenderer;
+// False until initialize() succeeded; a partly initialized renderer is never drawn with, only cleaned up.
+bool renderer_initialized {false};
+
+// Everything a frame needs from the main thread. Built by SDL_AppIterate and never changed
+// afterwards, so the render thread can read it without locks.
+struct FrameSnapshot {
+    // SDL_GetTicksNS() of the oldest input event this snapshot is the first to reflect, 0 if none.
+    uint64_t input_ns{ 0 };
+    double time{ 0.0 };
+    // Per window.
+    int width[MAX_WINDOWS]{ VIEWPORT_WIDTH };
+    int height[MAX_WINDOWS]{ VIEWPORT_HEIGHT };
+    // Incremented by every resize event, so a resize survives snapshots the render thread skips.
+    uint32_t resize_count[MAX_WINDOWS]{};
+};
+
+// Draw on a thread of its own, so a blocking acquire or present never holds up event handling.
+bool use_render_thread {true};
+// How often SDL_AppIterate publishes a snapshot while the render thread draws.
+constexpr const char* SNAPSHOT_RATE_HZ{ "1000" };
+TripleBuffer<FrameSnapshot> snapshots;
+std::thread render_thread;
+std::atomic<bool> render_thread_stopping {false};
+// The render thread reached the frame limit or the end of the benchmark.
+std::atomic<bool> render_thread_finished {false};
+// Main thread only.
+uint32_t resize_count[MAX_WINDOWS] {};
+uint64_t pending_input_ns {0};
+uint64_t published_input_ns {0};
+// Render thread only, or the main thread without one.
+uint32_t handled_resize_count[MAX_WINDOWS] {};
 
 
 
@@ -39,54 +95,286 @@ static std::vector<char> read_file(const std::string& file_path) {
 
 
 
-SDL_AppResult SDL_AppInit(void **appstate, int argc, char **argv) {
+static RendererSettings parse_settings(int argc, char **argv) {
+    RendererSettings settings;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--frames-in-flight") == 0 && has_value) {
+            settings.frames_in_flight = (uint32_t)std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--windows") == 0 && has_value) {
+            window_count = std::clamp((uint32_t)std::max(1, atoi(argv[++i])), 1u, MAX_WINDOWS);
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            settings.headless = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && has_value) {
+            frame_limit = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--pipeline-cache") == 0 && has_value) {
+            settings.pipeline_cache_path = argv[++i];
+        } else if (strcmp(argv[i], "--no-pipeline-cache") == 0) {
+            settings.pipeline_cache_path.clear();
+        } else if (strcmp(argv[i], "--pipeline-threads") == 0 && has_value) {
+            settings.pipeline_threads = (uint32_t)std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--no-prewarm") == 0) {
+            settings.prewarm_pipelines = false;
+        } else if (strcmp(argv[i], "--no-validation") == 0) {
+            settings.validation = false;
+        } else if (strcmp(argv[i], "--no-debug-utils") == 0) {
+            settings.debug_utils = false;
+        } else if (strcmp(argv[i], "--dump-render-graph") == 0) {
+            settings.dump_render_graph = true;
+        } else if (strcmp(argv[i], "--recording-threads") == 0 && has_value) {
+            settings.recording_threads = (uint32_t)std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--draws") == 0 && has_value) {
+            settings.draw_count = (uint32_t)std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--primitives") == 0 && has_value) {
+            primitive_count = (uint32_t)std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--batch-arena-mb") == 0 && has_value) {
+            settings.batch_arena_size = VkDeviceSize(std::max(1, atoi(argv[++i]))) * 1024 * 1024;
+        } else if (strcmp(argv[i], "--instances") == 0 && has_value) {
+            settings.instance_count = (uint32_t)std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--texture") == 0 && has_value) {
+            settings.texture_paths.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--texture-budget") == 0 && has_value) {
+            settings.texture_budget = VkDeviceSize(std::max(1, atoi(argv[++i]))) * 1024 * 1024;
+        } else if (strcmp(argv[i], "--particles") == 0 && has_value) {
+            settings.particle_count = (uint32_t)std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--particle-substeps") == 0 && has_value) {
+            settings.particle_substeps = (uint32_t)std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--mesh") == 0 && has_value) {
+            settings.mesh_path = argv[++i];
+        } else if (strcmp(argv[i], "--no-cluster-culling") == 0) {
+            settings.cluster_culling = false;
+        } else if (strcmp(argv[i], "--no-gpu-culling") == 0) {
+            settings.gpu_culling = false;
+        } else if (strcmp(argv[i], "--present-mode") == 0 && has_value) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "immediate") == 0) {
+                settings.present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            } else if (strcmp(mode, "mailbox") == 0) {
+                settings.present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+            } else if (strcmp(mode, "fifo-relaxed") == 0) {
+                settings.present_mode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+            } else {
+                settings.present_mode = VK_PRESENT_MODE_FIFO_KHR;
+            }
+        } else if (strcmp(argv[i], "--low-latency") == 0) {
+            settings.low_latency = true;
+        } else if (strcmp(argv[i], "--log-latency") == 0) {
+            settings.log_latency = true;
+        } else if (strcmp(argv[i], "--profile") == 0 && has_value) {
+            settings.profile_output_path = argv[++i];
+        } else if (strcmp(argv[i], "--no-render-thread") == 0) {
+            use_render_thread = false;
+        } else if (strcmp(argv[i], "--record-benchmark") == 0) {
+            record_benchmark = true;
+        } else if (strcmp(argv[i], "--device") == 0 && has_value) {
+            settings.device = argv[++i];
+        } else if (strcmp(argv[i], "--no-async-queues") == 0) {
+            settings.async_queues = false;
+        } else if (strcmp(argv[i], "--benchmark") == 0) {
+            run_benchmark = true;
+        } else if (strcmp(argv[i], "--benchmark-frames") == 0 && has_value) {
+            benchmark_settings.frames = (uint32_t)std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--benchmark-seconds") == 0 && has_value) {
+            benchmark_settings.duration_s = std::max(0.0, atof(argv[++i]));
+        } else if (strcmp(argv[i], "--warmup-frames") == 0 && has_value) {
+            benchmark_settings.warmup_frames = (uint32_t)std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--benchmark-output") == 0 && has_value) {
+            benchmark_settings.output_path = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && has_value) {
+            output_path = argv[++i];
+        } else {
+            print("Ignoring unknown argument '%s'.", argv[i]);
+        }
+    }
+
+    return settings;
+}
+
+
 
+static bool create_windows() {
     // Initialize app
     if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMEPAD)) {
         SDL_Log("SDL could not initialize! SDL error: %s\n", SDL_GetError());
-        return SDL_APP_FAILURE;
+        return false;
     }
 
     // Load Vulkan driver
     if(!SDL_Vulkan_LoadLibrary(nullptr)) {
         SDL_Log("Could not load Vulkan library! SDL error: %s\n", SDL_GetError());
-        return SDL_APP_FAILURE;
+        return false;
     }
 
-    // Create window
-    SDL_PropertiesID window_props {SDL_CreateProperties()};
-    SDL_SetNumberProperty(window_props, SDL_PROP_WINDOW_CREATE_WIDTH_NUMBER, 800);
-    SDL_SetNumberProperty(window_props, SDL_PROP_WINDOW_CREATE_HEIGHT_NUMBER, 800);
-    SDL_SetBooleanProperty(window_props, SDL_PROP_WINDOW_CREATE_BORDERLESS_BOOLEAN, false);
-    SDL_SetBooleanProperty(window_props, SDL_PROP_WINDOW_CREATE_RESIZABLE_BOOLEAN, false);
-    SDL_SetBooleanProperty(window_props, SDL_PROP_WINDOW_CREATE_VULKAN_BOOLEAN, true);
-    SDL_SetStringProperty(window_props, SDL_PROP_WINDOW_CREATE_TITLE_STRING, "Vulkan Triangle");
-    gWindow = SDL_CreateWindowWithProperties(window_props);
-    if (gWindow == nullptr) {
-        SDL_Log("Window could not be created! SDL error: %s\n", SDL_GetError());
-        return SDL_APP_FAILURE;
+    // Create windows
+    for (uint32_t i = 0; i < window_count; i++) {
+        std::string title = i == 0 ? "Vulkan Triangle" : "Vulkan Triangle (view " + std::to_string(i + 1) + ")";
+        SDL_PropertiesID window_props {SDL_CreateProperties()};
+        SDL_SetNumberProperty(window_props, SDL_PROP_WINDOW_CREATE_WIDTH_NUMBER, 800);
+        SDL_SetNumberProperty(window_props, SDL_PROP_WINDOW_CREATE_HEIGHT_NUMBER, 800);
+        SDL_SetBooleanProperty(window_props, SDL_PROP_WINDOW_CREATE_BORDERLESS_BOOLEAN, false);
+        SDL_SetBooleanProperty(window_props, SDL_PROP_WINDOW_CREATE_RESIZABLE_BOOLEAN, true);
+        SDL_SetBooleanProperty(window_props, SDL_PROP_WINDOW_CREATE_VULKAN_BOOLEAN, true);
+        SDL_SetStringProperty(window_props, SDL_PROP_WINDOW_CREATE_TITLE_STRING, title.c_str());
+        SDL_Window* window = SDL_CreateWindowWithProperties(window_props);
+        SDL_DestroyProperties(window_props);
+        if (window == nullptr) {
+            SDL_Log("Window could not be created! SDL error: %s\n", SDL_GetError());
+            return false;
+        }
+        gWindows.push_back(window);
     }
 
-    uint32_t sdl_extension_count;
-    const char* const* sdl_extension_names = SDL_Vulkan_GetInstanceExtensions(&sdl_extension_count);
-    
+    return true;
+}
 
-    // Initialize Vulkan
-    gRenderer = Renderer();
-    gRenderer.initialize(sdl_extension_count, sdl_extension_names, gWindow);
 
-    return SDL_APP_CONTINUE;
+
+static void submit_primitives(const FrameSnapshot &p_snapshot, uint32_t p_count) {
+    // Laid out for the first window; the others draw the same batch.
+    int width = p_snapshot.width[0];
+    int height = p_snapshot.height[0];
+
+    // A grid of small quads that fills the window, with a wave running through it.
+    uint32_t columns = std::max(1u, (uint32_t)std::ceil(std::sqrt(double(p_count) * width / std::max(1, height))));
+    float cell = float(width) / float(columns);
+    PrimitiveBatch &batch = gRenderer.get_primitive_batch();
+    for (uint32_t i = 0; i < p_count; i++) {
+        uint32_t column = i % columns;
+        uint32_t row = i / columns;
+        float wave = 0.5f + 0.5f * std::sin(float(p_snapshot.time) * 3.0f + float(column + row) * 0.1f);
+        uint32_t color = pack_color(uint8_t(column * 255 / columns), uint8_t(wave * 255.0f), uint8_t(255 - column * 255 / columns));
+        batch.add_quad(float(column) * cell, float(row) * cell, cell * (0.5f + 0.4f * wave), cell * 0.9f, color);
+    }
+    batch.add_line(0.0f, 0.0f, float(width), float(height), pack_color(255, 255, 255));
 }
 
 
-SDL_AppResult SDL_AppIterate(void *appstate) {
+static FrameSnapshot build_snapshot() {
+    FrameSnapshot snapshot;
+    snapshot.time = double(SDL_GetTicksNS()) * 0.000000001;
+    for (size_t i = 0; i < gWindows.size(); i++) {
+        SDL_GetWindowSizeInPixels(gWindows[i], &snapshot.width[i], &snapshot.height[i]);
+        snapshot.resize_count[i] = resize_count[i];
+    }
+
+    // The previous snapshot may still be replaced unread, so its input is carried over. If the render
+    // thread takes it in the meantime, the latency of this snapshot is overstated, never understated.
+    snapshot.input_ns = pending_input_ns;
+    if (use_render_thread && snapshots.has_unread() && published_input_ns != 0) {
+        snapshot.input_ns = published_input_ns;
+    }
+    pending_input_ns = 0;
+    published_input_ns = snapshot.input_ns;
+    return snapshot;
+}
+
+
+static void publish_snapshot() {
+    snapshots.get_back() = build_snapshot();
+    snapshots.publish();
+}
+
+
+// Draws one frame. p_new_snapshot is false when the render thread draws a snapshot again, whose
+// input was already measured. Returns false once the frame limit or the benchmark is done.
+static bool render_frame(const FrameSnapshot &p_snapshot, bool p_new_snapshot) {
     // Delta
     Uint64 current_time = SDL_GetTicksNS();
     delta = double(current_time - previous_time) * 0.000000001;
     previous_time = current_time;
 
-    gRenderer.draw();
-    
+    for (uint32_t i = 0; i < gWindows.size(); i++) {
+        if (p_snapshot.resize_count[i] != handled_resize_count[i]) {
+            handled_resize_count[i] = p_snapshot.resize_count[i];
+            gRenderer.notify_resized(i, p_snapshot.width[i], p_snapshot.height[i]);
+        }
+    }
+    if (primitive_count > 0) {
+        submit_primitives(p_snapshot, primitive_count);
+    }
+    gRenderer.draw(p_new_snapshot ? p_snapshot.input_ns : 0);
+
+    if (run_benchmark) {
+        double cpu_ms = double(SDL_GetTicksNS() - current_time) * 0.000001;
+        if (!gBenchmark.add_frame(delta * 1000.0, cpu_ms, gRenderer.get_last_gpu_time_ms())) {
+            return false;
+        }
+    }
+
+    frame_count++;
+    return frame_limit == 0 || frame_count < frame_limit;
+}
+
+
+static void render_thread_loop() {
+    while (!render_thread_stopping.load(std::memory_order_acquire)) {
+        bool new_snapshot = snapshots.update();
+        if (!render_frame(snapshots.get_front(), new_snapshot)) {
+            render_thread_finished.store(true, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+
+
+SDL_AppResult SDL_AppInit(void **appstate, int argc, char **argv) {
+    RendererSettings settings = parse_settings(argc, argv);
+
+    uint32_t sdl_extension_count {0};
+    const char* const* sdl_extension_names {nullptr};
+
+    if (settings.headless) {
+        // No window, surface or video driver: render straight into offscreen images.
+        if (!SDL_Init(SDL_INIT_EVENTS)) {
+            SDL_Log("SDL could not initialize! SDL error: %s\n", SDL_GetError());
+            return SDL_APP_FAILURE;
+        }
+    } else {
+        if (!create_windows()) {
+            return SDL_APP_FAILURE;
+        }
+        sdl_extension_names = SDL_Vulkan_GetInstanceExtensions(&sdl_extension_count);
+    }
+
+    // Initialize Vulkan
+    if (!gRenderer.initialize(sdl_extension_count, sdl_extension_names, gWindows, settings)) {
+        print("Could not initialize renderer!");
+        return SDL_APP_FAILURE;
+    }
+    renderer_initialized = true;
+
+    if (record_benchmark) {
+        gRenderer.benchmark_recording(RECORD_BENCHMARK_ITERATIONS);
+        return SDL_APP_SUCCESS;
+    }
+
+    if (run_benchmark) {
+        gBenchmark.start(benchmark_settings);
+    }
+    previous_time = SDL_GetTicksNS();
+
+    if (use_render_thread) {
+        // Polling input more often than the display refreshes keeps snapshots fresh without spinning.
+        SDL_SetHint(SDL_HINT_MAIN_CALLBACK_RATE, SNAPSHOT_RATE_HZ);
+        publish_snapshot();
+        render_thread = std::thread(render_thread_loop);
+    }
+
+    return SDL_APP_CONTINUE;
+}
+
+
+SDL_AppResult SDL_AppIterate(void *appstate) {
+    if (!use_render_thread) {
+        return render_frame(build_snapshot(), true) ? SDL_APP_CONTINUE : SDL_APP_SUCCESS;
+    }
+
+    if (render_thread_finished.load(std::memory_order_acquire)) {
+        return SDL_APP_SUCCESS;
+    }
+    publish_snapshot();
     return SDL_APP_CONTINUE;
 }
 
@@ -95,11 +383,58 @@ SDL_AppResult SDL_AppEvent(void *appsatte, SDL_Event *event) {
     if (event->type == SDL_EVENT_QUIT) {
         return SDL_APP_SUCCESS;
     }
+    // Windows cannot be removed from the renderer, so closing any of them quits.
+    if (event->type == SDL_EVENT_WINDOW_CLOSE_REQUESTED) {
+        return SDL_APP_SUCCESS;
+    }
+    if (event->type == SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED) {
+        SDL_Window* window = SDL_GetWindowFromID(event->window.windowID);
+        auto found = std::find(gWindows.begin(), gWindows.end(), window);
+        if (found != gWindows.end()) {
+            resize_count[found - gWindows.begin()]++;
+        }
+    }
+
+    switch (event->type) {
+        case SDL_EVENT_KEY_DOWN:
+        case SDL_EVENT_KEY_UP:
+        case SDL_EVENT_MOUSE_MOTION:
+        case SDL_EVENT_MOUSE_BUTTON_DOWN:
+        case SDL_EVENT_MOUSE_BUTTON_UP:
+        case SDL_EVENT_MOUSE_WHEEL:
+        case SDL_EVENT_GAMEPAD_AXIS_MOTION:
+        case SDL_EVENT_GAMEPAD_BUTTON_DOWN:
+        case SDL_EVENT_GAMEPAD_BUTTON_UP:
+        case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
+            // Event timestamps come from the SDL_GetTicksNS() clock.
+            if (pending_input_ns == 0) {
+                pending_input_ns = event->common.timestamp;
+            }
+            break;
+        default:
+            break;
+    }
 
     return SDL_APP_CONTINUE;
 }
 
 
 void SDL_AppQuit(void *appstate, SDL_AppResult result) {
+    if (!renderer_initialized) {
+        // Releases whatever initialize() got to, and the windows. SDL_Quit runs after this.
+        gRenderer.cleanup();
+        return;
+    }
+    // The renderer belongs to the render thread until it has finished its frame.
+    if (render_thread.joinable()) {
+        render_thread_stopping.store(true, std::memory_order_release);
+        render_thread.join();
+    }
+    if (run_benchmark && !gBenchmark.is_warming_up()) {
+        gBenchmark.report(gRenderer);
+    }
+    if (!output_path.empty()) {
+        gRenderer.save_last_frame(output_path.c_str());
+    }
     gRenderer.cleanup();
 }
@@ -0,0 +1,71 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+bool MappedFile::open(const std::string &p_path) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(p_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    HANDLE mapping = GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0
+        ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    void* view = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (view == nullptr) {
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return false;
+    }
+    file_handle = file;
+    mapping_handle = mapping;
+    data = static_cast<const uint8_t*>(view);
+    size = static_cast<size_t>(file_size.QuadPart);
+#else
+    int file = ::open(p_path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    struct stat file_stat;
+    void* view = fstat(file, &file_stat) == 0 && file_stat.st_size > 0
+        ? mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+    // The mapping keeps the file alive on its own.
+    ::close(file);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    data = static_cast<const uint8_t*>(view);
+    size = static_cast<size_t>(file_stat.st_size);
+#endif
+    return true;
+}
+
+
+void MappedFile::close() {
+    if (data == nullptr) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+    file_handle = nullptr;
+    mapping_handle = nullptr;
+#else
+    munmap(const_cast<uint8_t*>(data), size);
+#endif
+    data = nullptr;
+    size = 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A read-only memory mapping of a whole file. Pages are only read from disk when they are
+// touched, so large assets can be opened without reading them.
+class MappedFile {
+
+private:
+    const uint8_t* data{ nullptr };
+    size_t size{ 0 };
+#ifdef _WIN32
+    void* file_handle{ nullptr };
+    void* mapping_handle{ nullptr };
+#endif
+
+public:
+    bool open(const std::string &p_path);
+    void close();
+
+    const uint8_t* get_data() const { return data; }
+    size_t get_size() const { return size; }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile() {};
+    ~MappedFile() { close(); };
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+// Binary meshes written by tools/meshconv and loaded by the renderer. The file is a header
+// followed by sections that are copied into GPU buffers as they are, so loading a mesh is one
+// memory mapping and a memcpy per section. All values are little endian.
+constexpr uint32_t MESH_FILE_MAGIC{ 0x4853454d }; // "MESH"
+constexpr uint32_t MESH_FILE_VERSION{ 1 };
+// Sections start at multiples of this.
+constexpr uint64_t MESH_SECTION_ALIGNMENT{ 16 };
+// Meshlet limits, the usual ones for mesh shaders so the clusters stay useful for them.
+constexpr uint32_t MESHLET_MAX_VERTICES{ 64 };
+constexpr uint32_t MESHLET_MAX_TRIANGLES{ 124 };
+
+// Matches VSInput in shaders/src/mesh.slang.
+struct MeshVertex {
+    // R16G16B16A16_UNORM within the bounds of the mesh, see MeshFileHeader. w is unused.
+    uint16_t position[4];
+    // R8G8B8A8_SNORM. w is unused.
+    int8_t normal[4];
+    // R16G16_SFLOAT, with v pointing down as in Vulkan.
+    uint16_t uv[2];
+};
+static_assert(sizeof(MeshVertex) == 16);
+
+// A cluster of consecutive triangles of the index buffer, drawable with a single indexed draw.
+struct Meshlet {
+    uint32_t first_index;
+    uint32_t index_count;
+    uint32_t vertex_count;
+    // Bounding sphere, in the unquantized space of the source mesh.
+    float center[3];
+    float radius;
+    // Normal cone: every triangle faces away from a camera at p when
+    // dot(normalize(cone_apex - p), cone_axis) >= cone_cutoff. A cutoff of 1 never culls.
+    float cone_apex[3];
+    float cone_axis[3];
+    float cone_cutoff;
+};
+static_assert(sizeof(Meshlet) == 56);
+
+struct MeshFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t meshlet_count;
+    // 2 for uint16_t indices, 4 for uint32_t.
+    uint32_t index_size;
+    // position = bounds_min + unorm_position * bounds_extent
+    float bounds_min[3];
+    float bounds_extent[3];
+    // Byte offsets from the start of the file, MESH_SECTION_ALIGNMENT aligned.
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t meshlet_offset;
+    uint64_t file_size;
+};
+static_assert(sizeof(MeshFileHeader) == 80);
@@ -0,0 +1,204 @@
+#include "pipeline_library.h"
+
+#include <algorithm>
+
+
+bool PipelineKey::operator==(const PipelineKey &p_other) const {
+    return shader == p_other.shader && layout == p_other.layout
+        && state.vertex_layout == p_other.state.vertex_layout && state.topology == p_other.state.topology
+        && state.cull_mode == p_other.state.cull_mode && state.front_face == p_other.state.front_face && state.alpha_blend == p_other.state.alpha_blend
+        && state.color_format == p_other.state.color_format && state.depth_format == p_other.state.depth_format
+        && state.specialization == p_other.state.specialization;
+}
+
+
+uint64_t PipelineKey::hash() const {
+    // FNV-1a over the fields rather than the struct bytes, so padding never leaks into the hash.
+    uint64_t values[] = {
+        shader, layout, static_cast<uint64_t>(state.vertex_layout), static_cast<uint64_t>(state.topology),
+        state.cull_mode, static_cast<uint64_t>(state.front_face), state.alpha_blend, static_cast<uint64_t>(state.color_format), static_cast<uint64_t>(state.depth_format),
+        state.specialization.mask,
+    };
+    uint64_t result = 14695981039346656037ull;
+    auto add = [&](uint64_t p_value) {
+        for (int i = 0; i < 8; i++) {
+            result ^= (p_value >> (i * 8)) & 0xff;
+            result *= 1099511628211ull;
+        }
+    };
+    for (uint64_t value : values) {
+        add(value);
+    }
+    for (uint32_t value : state.specialization.values) {
+        add(value);
+    }
+    return result;
+}
+
+
+void PipelineLibrary::start(uint32_t p_thread_count, PipelineCompileFunction p_compile) {
+    stop();
+
+    compile = std::move(p_compile);
+    stopping = false;
+    for (uint32_t i = 0; i < std::max(1u, p_thread_count); i++) {
+        threads.emplace_back(&PipelineLibrary::thread_loop, this);
+    }
+}
+
+
+void PipelineLibrary::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    job_available.notify_all();
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+    idle.notify_all();
+}
+
+
+void PipelineLibrary::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    retired.clear();
+}
+
+
+uint16_t PipelineLibrary::add_shader(const uint32_t p_code[], size_t p_code_size, const ShaderReflection &p_reflection) {
+    std::lock_guard<std::mutex> lock(mutex);
+    shaders.push_back(std::make_shared<const std::vector<uint32_t>>(p_code, p_code + p_code_size / sizeof(uint32_t)));
+    reflections.push_back(&p_reflection);
+    return static_cast<uint16_t>(shaders.size() - 1);
+}
+
+
+uint16_t PipelineLibrary::add_layout(VkPipelineLayout p_layout) {
+    std::lock_guard<std::mutex> lock(mutex);
+    layouts.push_back(p_layout);
+    return static_cast<uint16_t>(layouts.size() - 1);
+}
+
+
+void PipelineLibrary::thread_loop() {
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        job_available.wait(lock, [&] { return stopping || !jobs.empty(); });
+        if (stopping) {
+            return;
+        }
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        running_jobs++;
+        lock.unlock();
+
+        run_job(job);
+
+        lock.lock();
+        running_jobs--;
+        if (running_jobs == 0 && jobs.empty()) {
+            idle.notify_all();
+        }
+    }
+}
+
+
+void PipelineLibrary::run_job(const Job &p_job) {
+    std::vector<UniquePipeline> pipelines(p_job.keys.size());
+    bool success = true;
+    for (size_t i = 0; i < p_job.keys.size() && success; i++) {
+        const PipelineKey &key = p_job.keys[i];
+        std::shared_ptr<const std::vector<uint32_t>> code;
+        const ShaderReflection* reflection;
+        VkPipelineLayout layout;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            code = shaders[key.shader];
+            reflection = reflections[key.shader];
+            layout = layouts[key.layout];
+        }
+        success = compile(key.state, *reflection, code->data(), code->size() * sizeof(uint32_t), layout, pipelines[i]);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < p_job.keys.size(); i++) {
+        Entry &entry = entries[p_job.keys[i]];
+        if (p_job.replace) {
+            if (success) {
+                retired.push_back(std::move(entry.pipeline));
+                entry.pipeline = std::move(pipelines[i]);
+                entry.state = EntryState::READY;
+            }
+        } else if (entry.state == EntryState::PENDING) {
+            // A reload may have finished first, with newer code; then this result is stale.
+            entry.pipeline = std::move(pipelines[i]);
+            entry.state = success ? EntryState::READY : EntryState::FAILED;
+        }
+    }
+}
+
+
+VkPipeline PipelineLibrary::get(const PipelineKey &p_key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto [iterator, inserted] = entries.try_emplace(p_key);
+    if (inserted) {
+        jobs.push_back({{p_key}, false});
+        job_available.notify_one();
+    }
+    return iterator->second.state == EntryState::READY ? VkPipeline(iterator->second.pipeline) : VK_NULL_HANDLE;
+}
+
+
+void PipelineLibrary::prewarm(const std::vector<PipelineKey> &p_keys) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const PipelineKey &key : p_keys) {
+        if (entries.try_emplace(key).second) {
+            jobs.push_back({{key}, false});
+        }
+    }
+    job_available.notify_all();
+}
+
+
+void PipelineLibrary::wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [&] { return threads.empty() || (jobs.empty() && running_jobs == 0); });
+}
+
+
+void PipelineLibrary::reload_shader(uint16_t p_shader, const std::vector<uint32_t> &p_spirv) {
+    std::lock_guard<std::mutex> lock(mutex);
+    shaders[p_shader] = std::make_shared<const std::vector<uint32_t>>(p_spirv);
+
+    Job job;
+    job.replace = true;
+    for (const auto &[key, entry] : entries) {
+        if (key.shader == p_shader) {
+            job.keys.push_back(key);
+        }
+    }
+    if (!job.keys.empty()) {
+        jobs.push_back(std::move(job));
+        job_available.notify_one();
+    }
+}
+
+
+void PipelineLibrary::collect_retired(DeletionQueue &r_deletion_queue, uint64_t p_last_submit) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (UniquePipeline &pipeline : retired) {
+        r_deletion_queue.push(p_last_submit, std::move(pipeline));
+    }
+    retired.clear();
+}
+
+
+size_t PipelineLibrary::get_pipeline_count() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "vulkan_handle.h"
+#include "deletion_queue.h"
+#include "shader_reflection.h"
+
+// Format of the swapchain and offscreen images, which pipelines render to by default.
+constexpr VkFormat COLOR_FORMAT{ VK_FORMAT_B8G8R8A8_SRGB };
+
+enum class VertexLayout : uint8_t {
+    // Vertices are generated in the shader.
+    NONE,
+    VERTEX,
+    BATCH_VERTEX,
+    // MeshVertex from src/mesh_format.h.
+    MESH_VERTEX,
+};
+
+// The fixed-function state that differs between our graphics pipelines.
+struct GraphicsPipelineState {
+    VertexLayout vertex_layout{ VertexLayout::NONE };
+    VkPrimitiveTopology topology{ VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST };
+    VkCullModeFlags cull_mode{ VK_CULL_MODE_BACK_BIT };
+    VkFrontFace front_face{ VK_FRONT_FACE_CLOCKWISE };
+    bool alpha_blend{ false };
+    VkFormat color_format{ COLOR_FORMAT };
+    // Depth test and write against an attachment of this format. UNDEFINED renders without depth.
+    VkFormat depth_format{ VK_FORMAT_UNDEFINED };
+    // Branch-free variants of the shader, compiled as separate pipelines.
+    SpecializationValues specialization;
+};
+
+// Everything a graphics pipeline is built from. Shaders and layouts are registered with the
+// PipelineLibrary once and referenced by index, which keeps keys small and cheap to compare.
+struct PipelineKey {
+    uint16_t shader{ 0 };
+    uint16_t layout{ 0 };
+    GraphicsPipelineState state;
+
+    bool operator==(const PipelineKey &p_other) const;
+    uint64_t hash() const;
+};
+
+struct PipelineKeyHash {
+    size_t operator()(const PipelineKey &p_key) const { return static_cast<size_t>(p_key.hash()); }
+};
+
+using PipelineCompileFunction = std::function<bool(const GraphicsPipelineState&, const ShaderReflection&, const uint32_t*, size_t, VkPipelineLayout, UniquePipeline&)>;
+
+// Graphics pipelines by key. A key that is not in the library yet is compiled on one of the
+// library's threads, and get() returns VK_NULL_HANDLE until it is done, so the render thread
+// never waits for a compile. Known keys can be prewarmed at startup.
+class PipelineLibrary {
+
+private:
+    enum class EntryState {
+        PENDING,
+        READY,
+        FAILED,
+    };
+
+    struct Entry {
+        EntryState state{ EntryState::PENDING };
+        UniquePipeline pipeline;
+    };
+
+    struct Job {
+        std::vector<PipelineKey> keys;
+        // Rebuilds keys that may already be ready. All of them are swapped in together or not at all.
+        bool replace{ false };
+    };
+
+    PipelineCompileFunction compile;
+    std::vector<std::shared_ptr<const std::vector<uint32_t>>> shaders;
+    // Reloads keep the interface, so these stay valid for the new code too.
+    std::vector<const ShaderReflection*> reflections;
+    std::vector<VkPipelineLayout> layouts;
+    std::unordered_map<PipelineKey, Entry, PipelineKeyHash> entries;
+    // Pipelines replaced by a reload, destroyed once the frames that used them are done.
+    std::vector<UniquePipeline> retired;
+    std::deque<Job> jobs;
+    uint32_t running_jobs{ 0 };
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable job_available;
+    std::condition_variable idle;
+    bool stopping{ false };
+
+    void thread_loop();
+    void run_job(const Job &p_job);
+
+public:
+    void start(uint32_t p_thread_count, PipelineCompileFunction p_compile);
+    // Drops queued compiles and joins the threads.
+    void stop();
+    // Destroys every pipeline. Only valid once the device is idle.
+    void clear();
+
+    // p_reflection must outlive the library, e.g. one generated into shaders/bin.
+    uint16_t add_shader(const uint32_t p_code[], size_t p_code_size, const ShaderReflection &p_reflection);
+    uint16_t add_layout(VkPipelineLayout p_layout);
+
+    // Thread-safe. Never blocks on a compile: queues missing keys and returns VK_NULL_HANDLE.
+    VkPipeline get(const PipelineKey &p_key);
+    // Queues every key that is not in the library yet, one compile per key, spread over the threads.
+    void prewarm(const std::vector<PipelineKey> &p_keys);
+    // Blocks until nothing is queued or compiling. For startup only.
+    void wait_idle();
+    // Replaces the code of p_shader and rebuilds every pipeline made from it in the background.
+    // The new code must have the same interface, see same_interface().
+    void reload_shader(uint16_t p_shader, const std::vector<uint32_t> &p_spirv);
+    // Hands replaced pipelines to the deletion queue, tagged with the last submission that may use them.
+    void collect_retired(DeletionQueue &r_deletion_queue, uint64_t p_last_submit);
+
+    size_t get_pipeline_count();
+
+    PipelineLibrary() {};
+    ~PipelineLibrary() { stop(); };
+};
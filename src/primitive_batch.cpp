@@ -0,0 +1,145 @@
+#include "primitive_batch.h"
+
+#include <algorithm>
+
+#include "util.h"
+
+
+bool PrimitiveBatch::initialize(DeviceAllocator &p_allocator, uint32_t p_frame_count, VkDeviceSize p_arena_size) {
+    VkDeviceSize chunk_size = VkDeviceSize(BATCH_CHUNK_VERTICES) * sizeof(BatchVertex);
+    chunk_count = static_cast<uint32_t>(std::max<VkDeviceSize>(1, p_arena_size / chunk_size));
+    for (std::vector<Run> &type_runs : runs) {
+        type_runs.reserve(chunk_count);
+    }
+
+    // Written once per frame and read once by the GPU, so host memory beats a copy to device-local memory.
+    arenas.resize(p_frame_count);
+    VkMemoryPropertyFlags host_memory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (Arena &arena : arenas) {
+        if (!p_allocator.create_buffer(chunk_count * chunk_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, host_memory, AllocationStrategy::POOL, arena.buffer, arena.allocation)) {
+            return false;
+        }
+    }
+
+    VkDeviceSize index_size = VkDeviceSize(chunk_count) * BATCH_CHUNK_VERTICES / 4 * 6 * sizeof(uint32_t);
+    return p_allocator.create_buffer(index_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationStrategy::POOL, quad_index_buffer, quad_index_allocation);
+}
+
+
+void PrimitiveBatch::cleanup(DeviceAllocator &p_allocator) {
+    for (Arena &arena : arenas) {
+        if (arena.buffer != VK_NULL_HANDLE) {
+            p_allocator.destroy_buffer(arena.buffer, arena.allocation);
+        }
+    }
+    arenas.clear();
+    if (quad_index_buffer != VK_NULL_HANDLE) {
+        p_allocator.destroy_buffer(quad_index_buffer, quad_index_allocation);
+    }
+    open = false;
+}
+
+
+std::vector<uint32_t> PrimitiveBatch::build_quad_indices() const {
+    uint32_t quad_count = chunk_count * BATCH_CHUNK_VERTICES / 4;
+    std::vector<uint32_t> indices(size_t(quad_count) * 6);
+    for (uint32_t quad = 0; quad < quad_count; quad++) {
+        uint32_t vertex = quad * 4;
+        uint32_t* index = &indices[size_t(quad) * 6];
+        index[0] = vertex;
+        index[1] = vertex + 1;
+        index[2] = vertex + 2;
+        index[3] = vertex + 2;
+        index[4] = vertex + 3;
+        index[5] = vertex;
+    }
+    return indices;
+}
+
+
+void PrimitiveBatch::begin(uint32_t p_slot) {
+    open = true;
+    current_slot = p_slot;
+    vertices = static_cast<BatchVertex*>(arenas[p_slot].allocation.mapped);
+    next_chunk = 0;
+    for (uint32_t type = 0; type < PRIMITIVE_TYPE_COUNT; type++) {
+        write_vertex[type] = 0;
+        end_vertex[type] = 0;
+        runs[type].clear();
+    }
+}
+
+
+bool PrimitiveBatch::next_chunk_for(PrimitiveType p_type) {
+    if (!open || next_chunk == chunk_count) {
+        return false;
+    }
+
+    uint32_t first_vertex = next_chunk * BATCH_CHUNK_VERTICES;
+    next_chunk++;
+    // Directly behind the chunk this type just filled, so it continues the same draw.
+    if (!runs[p_type].empty() && end_vertex[p_type] == first_vertex) {
+        end_vertex[p_type] += BATCH_CHUNK_VERTICES;
+        return true;
+    }
+
+    if (!runs[p_type].empty()) {
+        runs[p_type].back().end_vertex = write_vertex[p_type];
+    }
+    runs[p_type].push_back({first_vertex, first_vertex});
+    write_vertex[p_type] = first_vertex;
+    end_vertex[p_type] = first_vertex + BATCH_CHUNK_VERTICES;
+    return true;
+}
+
+
+void PrimitiveBatch::record(VkCommandBuffer p_command_buffer, VkPipelineLayout p_layout, VkPipeline p_triangle_pipeline, VkPipeline p_line_pipeline, VkExtent2D p_extent) {
+    if (!open || next_chunk == 0) {
+        return;
+    }
+    for (uint32_t type = 0; type < PRIMITIVE_TYPE_COUNT; type++) {
+        if (!runs[type].empty()) {
+            runs[type].back().end_vertex = write_vertex[type];
+        }
+    }
+
+    float pixel_to_clip[2] = {2.0f / float(p_extent.width), 2.0f / float(p_extent.height)};
+    VkBuffer buffer = arenas[current_slot].buffer;
+    VkDeviceSize offset {0};
+    vkCmdBindVertexBuffers(p_command_buffer, 0, 1, &buffer, &offset);
+
+    if (!runs[TRIANGLES].empty() || !runs[QUADS].empty()) {
+        vkCmdBindPipeline(p_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_triangle_pipeline);
+        vkCmdPushConstants(p_command_buffer, p_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pixel_to_clip), pixel_to_clip);
+        for (const Run &run : runs[TRIANGLES]) {
+            vkCmdDraw(p_command_buffer, run.end_vertex - run.first_vertex, 1, run.first_vertex, 0);
+        }
+        if (!runs[QUADS].empty()) {
+            vkCmdBindIndexBuffer(p_command_buffer, quad_index_buffer, 0, VK_INDEX_TYPE_UINT32);
+            for (const Run &run : runs[QUADS]) {
+                vkCmdDrawIndexed(p_command_buffer, (run.end_vertex - run.first_vertex) / 4 * 6, 1, 0, int32_t(run.first_vertex), 0);
+            }
+        }
+    }
+
+    if (!runs[LINES].empty()) {
+        vkCmdBindPipeline(p_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p_line_pipeline);
+        vkCmdPushConstants(p_command_buffer, p_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pixel_to_clip), pixel_to_clip);
+        for (const Run &run : runs[LINES]) {
+            vkCmdDraw(p_command_buffer, run.end_vertex - run.first_vertex, 1, run.first_vertex, 0);
+        }
+    }
+}
+
+
+void PrimitiveBatch::end() {
+    open = false;
+}
+
+
+uint64_t PrimitiveBatch::take_dropped_primitives() {
+    uint64_t dropped = dropped_primitives;
+    dropped_primitives = 0;
+    return dropped;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "allocator.h"
+
+// Matches VSInput in shaders/src/primitives.slang.
+struct BatchVertex {
+    float position[2];
+    // R8G8B8A8_UNORM, see pack_color().
+    uint32_t color;
+};
+
+constexpr uint32_t pack_color(uint8_t p_r, uint8_t p_g, uint8_t p_b, uint8_t p_a = 255) {
+    return uint32_t(p_r) | uint32_t(p_g) << 8 | uint32_t(p_b) << 16 | uint32_t(p_a) << 24;
+}
+
+// Arenas are handed out in chunks of this many vertices. It divides by 3, 4 and 2, so
+// triangles, quads and lines never straddle two chunks.
+constexpr uint32_t BATCH_CHUNK_VERTICES{ 12288 };
+
+// Colored 2D triangles, quads and lines in pixel coordinates, written straight into a
+// persistently mapped vertex arena per frame slot. Every primitive type fills its own chunks
+// of the arena, so the primitives end up sorted by type without a sort pass, and adjacent
+// chunks of one type merge into a single draw. Triangles and quads share a pipeline and are
+// drawn before lines; order is only kept within a type.
+class PrimitiveBatch {
+
+private:
+    enum PrimitiveType {
+        TRIANGLES,
+        QUADS,
+        LINES,
+        PRIMITIVE_TYPE_COUNT,
+    };
+
+    // Vertices [first_vertex, end_vertex) of the arena, drawn with one call.
+    struct Run {
+        uint32_t first_vertex;
+        uint32_t end_vertex;
+    };
+
+    struct Arena {
+        VkBuffer buffer{ VK_NULL_HANDLE };
+        Allocation allocation;
+    };
+
+    std::vector<Arena> arenas;
+    uint32_t chunk_count{ 0 };
+    // Indices of two triangles per quad, relative to the first vertex of a run.
+    VkBuffer quad_index_buffer{ VK_NULL_HANDLE };
+    Allocation quad_index_allocation;
+
+    bool open{ false };
+    uint32_t current_slot{ 0 };
+    BatchVertex* vertices{ nullptr };
+    uint32_t next_chunk{ 0 };
+    uint32_t write_vertex[PRIMITIVE_TYPE_COUNT]{};
+    uint32_t end_vertex[PRIMITIVE_TYPE_COUNT]{};
+    std::vector<Run> runs[PRIMITIVE_TYPE_COUNT];
+    uint64_t dropped_primitives{ 0 };
+
+    bool next_chunk_for(PrimitiveType p_type);
+
+    BatchVertex* allocate(PrimitiveType p_type, uint32_t p_vertex_count) {
+        if (write_vertex[p_type] + p_vertex_count > end_vertex[p_type] && !next_chunk_for(p_type)) {
+            dropped_primitives++;
+            return nullptr;
+        }
+        BatchVertex* allocated = vertices + write_vertex[p_type];
+        write_vertex[p_type] += p_vertex_count;
+        return allocated;
+    }
+
+public:
+    bool initialize(DeviceAllocator &p_allocator, uint32_t p_frame_count, VkDeviceSize p_arena_size);
+    void cleanup(DeviceAllocator &p_allocator);
+    // Index data for quad_index_buffer, which the caller uploads once.
+    std::vector<uint32_t> build_quad_indices() const;
+    VkBuffer get_quad_index_buffer() const { return quad_index_buffer; }
+
+    // The arena of p_slot must no longer be read by the GPU.
+    void begin(uint32_t p_slot);
+    // Everything since begin() is drawn with as few draws as the chunk layout allows.
+    void record(VkCommandBuffer p_command_buffer, VkPipelineLayout p_layout, VkPipeline p_triangle_pipeline, VkPipeline p_line_pipeline, VkExtent2D p_extent);
+    // Call after the frame that recorded the batch was submitted.
+    void end();
+    bool is_open() const { return open; }
+    // Primitives that did not fit into their arena since the last call.
+    uint64_t take_dropped_primitives();
+
+    // Return false if the arena is full. Colors come from pack_color().
+    bool add_triangle(float p_x0, float p_y0, float p_x1, float p_y1, float p_x2, float p_y2, uint32_t p_color) {
+        BatchVertex* vertex = allocate(TRIANGLES, 3);
+        if (vertex == nullptr) {
+            return false;
+        }
+        vertex[0] = {{p_x0, p_y0}, p_color};
+        vertex[1] = {{p_x1, p_y1}, p_color};
+        vertex[2] = {{p_x2, p_y2}, p_color};
+        return true;
+    }
+
+    bool add_quad(float p_x, float p_y, float p_width, float p_height, uint32_t p_color) {
+        BatchVertex* vertex = allocate(QUADS, 4);
+        if (vertex == nullptr) {
+            return false;
+        }
+        vertex[0] = {{p_x, p_y}, p_color};
+        vertex[1] = {{p_x + p_width, p_y}, p_color};
+        vertex[2] = {{p_x + p_width, p_y + p_height}, p_color};
+        vertex[3] = {{p_x, p_y + p_height}, p_color};
+        return true;
+    }
+
+    bool add_line(float p_x0, float p_y0, float p_x1, float p_y1, uint32_t p_color) {
+        BatchVertex* vertex = allocate(LINES, 2);
+        if (vertex == nullptr) {
+            return false;
+        }
+        vertex[0] = {{p_x0, p_y0}, p_color};
+        vertex[1] = {{p_x1, p_y1}, p_color};
+        return true;
+    }
+
+    PrimitiveBatch() {};
+    ~PrimitiveBatch() {};
+};
@@ -0,0 +1,214 @@
+#include "profiler.h"
+
+#include <cstring>
+#include <fstream>
+
+#include "util.h"
+
+
+bool Profiler::initialize(VkPhysicalDevice p_physical_device, VkDevice p_device, uint32_t p_queue_family_index, uint32_t p_frame_count) {
+    device = p_device;
+    origin_ns = SDL_GetTicksNS();
+    frames.resize(p_frame_count);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(p_physical_device, &properties);
+
+    uint32_t queue_family_count {0};
+    vkGetPhysicalDeviceQueueFamilyProperties(p_physical_device, &queue_family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(p_physical_device, &queue_family_count, queue_families.data());
+
+    uint32_t valid_bits = p_queue_family_index < queue_family_count ? queue_families[p_queue_family_index].timestampValidBits : 0;
+    gpu_timestamps = valid_bits > 0 && properties.limits.timestampPeriod > 0.0f;
+    if (!gpu_timestamps) {
+        print("GPU timestamps are not supported, only CPU scopes will be profiled.");
+        return true;
+    }
+    timestamp_period_ns = properties.limits.timestampPeriod;
+    timestamp_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+    for (FrameQueries &queries : frames) {
+        VkQueryPoolCreateInfo pool_info = {};
+        pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        pool_info.queryCount = MAX_GPU_QUERIES;
+
+        if (vkCreateQueryPool(device, &pool_info, nullptr, &queries.query_pool) != VK_SUCCESS) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void Profiler::cleanup() {
+    for (FrameQueries &queries : frames) {
+        vkDestroyQueryPool(device, queries.query_pool, nullptr);
+    }
+    frames.clear();
+    events.clear();
+}
+
+
+double Profiler::begin_frame(uint32_t p_slot, uint64_t p_frame) {
+    current_slot = p_slot;
+    current_frame = p_frame;
+    FrameQueries &queries = frames[p_slot];
+    double gpu_ms {-1.0};
+    last_scope_ms.clear();
+
+    if (gpu_timestamps && queries.query_count > 0) {
+        std::vector<uint64_t> timestamps(queries.query_count);
+        // No WAIT flag: the fence has signalled, and a frame that was never submitted is simply skipped.
+        VkResult result = vkGetQueryPoolResults(device, queries.query_pool, 0, queries.query_count,
+            timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+        if (result == VK_SUCCESS) {
+            uint64_t gpu_origin = timestamps[queries.scopes[0].begin_query] & timestamp_mask;
+            for (size_t i = 0; i < queries.scopes.size(); i++) {
+                const GpuScope &scope = queries.scopes[i];
+                if (scope.end_query == UINT32_MAX) {
+                    continue;
+                }
+                uint64_t begin = timestamps[scope.begin_query] & timestamp_mask;
+                uint64_t end = timestamps[scope.end_query] & timestamp_mask;
+                uint64_t duration_ns = uint64_t(double((end - begin) & timestamp_mask) * timestamp_period_ns);
+                if (i == 0) {
+                    gpu_ms = double(duration_ns) * 0.000001;
+                }
+                last_scope_ms.push_back({scope.name, double(duration_ns) * 0.000001});
+                if (capture) {
+                    // The clocks are not calibrated against each other, so the GPU track starts at the submit.
+                    uint64_t offset_ns = uint64_t(double((begin - gpu_origin) & timestamp_mask) * timestamp_period_ns);
+                    events.push_back({scope.name, queries.frame, queries.cpu_submit_ns + offset_ns, duration_ns, true});
+                }
+            }
+        }
+    }
+
+    queries.scopes.clear();
+    queries.query_count = 0;
+    queries.frame = p_frame;
+    return gpu_ms;
+}
+
+
+double Profiler::get_scope_ms(const char* p_name) const {
+    for (const auto &[name, ms] : last_scope_ms) {
+        if (strcmp(name, p_name) == 0) {
+            return ms;
+        }
+    }
+    return -1.0;
+}
+
+
+void Profiler::reset_queries(VkCommandBuffer p_command_buffer) {
+    FrameQueries &queries = frames[current_slot];
+    queries.scopes.clear();
+    queries.query_count = 0;
+    open_gpu_scopes.clear();
+
+    if (gpu_timestamps) {
+        vkCmdResetQueryPool(p_command_buffer, queries.query_pool, 0, MAX_GPU_QUERIES);
+    }
+}
+
+
+void Profiler::mark_submit() {
+    frames[current_slot].cpu_submit_ns = SDL_GetTicksNS() - origin_ns;
+}
+
+
+void Profiler::begin_gpu_scope(VkCommandBuffer p_command_buffer, const char* p_name) {
+    FrameQueries &queries = frames[current_slot];
+
+    // Keep a query in reserve for the end of every open scope.
+    if (!gpu_timestamps || queries.query_count + open_gpu_scopes.size() + 2 > MAX_GPU_QUERIES) {
+        open_gpu_scopes.push_back(UINT32_MAX);
+        return;
+    }
+
+    uint32_t query = queries.query_count++;
+    vkCmdWriteTimestamp(p_command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries.query_pool, query);
+    queries.scopes.push_back({p_name, query, UINT32_MAX});
+    open_gpu_scopes.push_back(static_cast<uint32_t>(queries.scopes.size() - 1));
+}
+
+
+void Profiler::end_gpu_scope(VkCommandBuffer p_command_buffer) {
+    if (open_gpu_scopes.empty()) {
+        return;
+    }
+    uint32_t scope_index = open_gpu_scopes.back();
+    open_gpu_scopes.pop_back();
+    if (scope_index == UINT32_MAX) {
+        return;
+    }
+
+    FrameQueries &queries = frames[current_slot];
+    uint32_t query = queries.query_count++;
+    vkCmdWriteTimestamp(p_command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries.query_pool, query);
+    queries.scopes[scope_index].end_query = query;
+}
+
+
+void Profiler::begin_cpu_scope(const char* p_name) {
+    open_cpu_scopes.push_back({p_name, SDL_GetTicksNS() - origin_ns});
+}
+
+
+void Profiler::end_cpu_scope() {
+    if (open_cpu_scopes.empty()) {
+        return;
+    }
+    OpenCpuScope scope = open_cpu_scopes.back();
+    open_cpu_scopes.pop_back();
+
+    if (capture) {
+        uint64_t now = SDL_GetTicksNS() - origin_ns;
+        events.push_back({scope.name, current_frame, scope.start_ns, now - scope.start_ns, false});
+    }
+}
+
+
+bool Profiler::write_chrome_trace(const std::string &p_path) const {
+    std::ofstream file(p_path);
+    if (!file.is_open()) {
+        print("Could not open file '%s'!", p_path.c_str());
+        return false;
+    }
+
+    // Trace Event Format, loadable in chrome://tracing and Perfetto. Timestamps are in microseconds.
+    file << "{\"traceEvents\":[\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+    for (const ProfileEvent &event : events) {
+        file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << (event.gpu ? "gpu" : "cpu")
+             << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (event.gpu ? 2 : 1)
+             << ",\"ts\":" << double(event.start_ns) * 0.001 << ",\"dur\":" << double(event.duration_ns) * 0.001
+             << ",\"args\":{\"frame\":" << event.frame << "}}";
+    }
+    file << "\n]}\n";
+
+    return file.good();
+}
+
+
+bool Profiler::write_csv(const std::string &p_path) const {
+    std::ofstream file(p_path);
+    if (!file.is_open()) {
+        print("Could not open file '%s'!", p_path.c_str());
+        return false;
+    }
+
+    file << "frame,track,name,start_ms,duration_ms\n";
+    for (const ProfileEvent &event : events) {
+        file << event.frame << "," << (event.gpu ? "gpu" : "cpu") << "," << event.name << ","
+             << double(event.start_ns) * 0.000001 << "," << double(event.duration_ns) * 0.000001 << "\n";
+    }
+
+    return file.good();
+}
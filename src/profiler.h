@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+constexpr uint32_t MAX_GPU_QUERIES{ 64 };
+
+struct ProfileEvent {
+    const char* name;
+    uint64_t frame;
+    // Nanoseconds since the profiler was initialized, on the CPU clock.
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    bool gpu;
+};
+
+// Timestamp queries around named GPU scopes plus plain CPU scopes. Every frame slot owns its
+// query pool, and results are read after that slot's fence has signalled, i.e. when they are
+// frames_in_flight frames old, so reading them never stalls.
+class Profiler {
+
+private:
+    struct GpuScope {
+        const char* name;
+        uint32_t begin_query;
+        uint32_t end_query;
+    };
+
+    struct FrameQueries {
+        VkQueryPool query_pool{ VK_NULL_HANDLE };
+        std::vector<GpuScope> scopes;
+        uint32_t query_count{ 0 };
+        uint64_t frame{ 0 };
+        // CPU time of the submit, which the GPU track of this frame is anchored to.
+        uint64_t cpu_submit_ns{ 0 };
+    };
+
+    struct OpenCpuScope {
+        const char* name;
+        uint64_t start_ns;
+    };
+
+    VkDevice device{ VK_NULL_HANDLE };
+    bool gpu_timestamps{ false };
+    double timestamp_period_ns{ 1.0 };
+    uint64_t timestamp_mask{ ~0ull };
+    std::vector<FrameQueries> frames;
+    uint32_t current_slot{ 0 };
+    uint64_t current_frame{ 0 };
+    std::vector<uint32_t> open_gpu_scopes;
+    std::vector<OpenCpuScope> open_cpu_scopes;
+    uint64_t origin_ns{ 0 };
+    bool capture{ false };
+    std::vector<ProfileEvent> events;
+    // GPU time of every scope of the frame read back last.
+    std::vector<std::pair<const char*, double>> last_scope_ms;
+
+public:
+    bool initialize(VkPhysicalDevice p_physical_device, VkDevice p_device, uint32_t p_queue_family_index, uint32_t p_frame_count);
+    void cleanup();
+    // Keep every scope in memory for write_chrome_trace() / write_csv().
+    void set_capture(bool p_capture) { capture = p_capture; }
+
+    // Call once the fence of p_slot has signalled. Returns the GPU time of the first scope
+    // of the frame this slot recorded last, or a negative value if there is none.
+    double begin_frame(uint32_t p_slot, uint64_t p_frame);
+    // GPU time of the named scope in the frame begin_frame() read back, or a negative value if it had none.
+    double get_scope_ms(const char* p_name) const;
+    // Must be recorded outside of a render pass, before the first GPU scope of the frame.
+    void reset_queries(VkCommandBuffer p_command_buffer);
+    // Call right before the frame's vkQueueSubmit.
+    void mark_submit();
+    void begin_gpu_scope(VkCommandBuffer p_command_buffer, const char* p_name);
+    void end_gpu_scope(VkCommandBuffer p_command_buffer);
+    void begin_cpu_scope(const char* p_name);
+    void end_cpu_scope();
+
+    bool write_chrome_trace(const std::string &p_path) const;
+    bool write_csv(const std::string &p_path) const;
+
+    Profiler() {};
+    ~Profiler() {};
+};
@@ -0,0 +1,609 @@
+#include "render_graph.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "util.h"
+#include "debug_utils.h"
+
+constexpr VkAccessFlags2 WRITE_ACCESS_MASK{ VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+    | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+    | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT };
+constexpr VkImageUsageFlags ATTACHMENT_USAGE_MASK{ VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+    | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT };
+
+struct UsageInfo {
+    VkPipelineStageFlags2 stage;
+    VkAccessFlags2 access;
+    VkImageLayout layout;
+    VkImageUsageFlags image_usage;
+};
+
+
+static UsageInfo usage_info(ResourceUsage p_usage) {
+    switch (p_usage) {
+        case ResourceUsage::COLOR_ATTACHMENT:
+            return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT};
+        case ResourceUsage::DEPTH_ATTACHMENT:
+            return {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+        case ResourceUsage::SAMPLED:
+            return {VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT};
+        case ResourceUsage::STORAGE_READ:
+            return {VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT};
+        case ResourceUsage::STORAGE_WRITE:
+            return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT};
+        case ResourceUsage::INDIRECT_READ:
+            return {VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0};
+        case ResourceUsage::TRANSFER_SRC:
+            return {VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT};
+        case ResourceUsage::TRANSFER_DST:
+            return {VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT};
+        // Presentation is ordered by a semaphore, so the barrier only transitions the layout.
+        case ResourceUsage::PRESENT:
+            return {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 0};
+        case ResourceUsage::HOST_READ:
+            return {VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, 0};
+        default:
+            return {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED, 0};
+    }
+}
+
+
+static const char* layout_name(VkImageLayout p_layout) {
+    switch (p_layout) {
+        case VK_IMAGE_LAYOUT_UNDEFINED: return "UNDEFINED";
+        case VK_IMAGE_LAYOUT_GENERAL: return "GENERAL";
+        case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: return "COLOR_ATTACHMENT";
+        case VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL: return "DEPTH_ATTACHMENT";
+        case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: return "SHADER_READ_ONLY";
+        case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: return "TRANSFER_SRC";
+        case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: return "TRANSFER_DST";
+        case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: return "PRESENT_SRC";
+        default: return "OTHER";
+    }
+}
+
+
+RenderResource RenderGraph::import_image(const std::string &p_name, VkImageLayout p_initial_layout, VkPipelineStageFlags2 p_initial_stage,
+    ResourceUsage p_final_usage, VkImageAspectFlags p_aspect) {
+    Resource resource;
+    resource.name = p_name;
+    resource.imported = true;
+    resource.aspect = p_aspect;
+    resource.initial_layout = p_initial_layout;
+    resource.initial_stage = p_initial_stage;
+    resource.final_usage = p_final_usage;
+    resources.push_back(std::move(resource));
+    compiled = false;
+    return static_cast<RenderResource>(resources.size() - 1);
+}
+
+
+RenderResource RenderGraph::import_buffer(const std::string &p_name, ResourceUsage p_final_usage, VkPipelineStageFlags2 p_initial_stage) {
+    Resource resource;
+    resource.name = p_name;
+    resource.is_image = false;
+    resource.imported = true;
+    resource.initial_stage = p_initial_stage;
+    resource.final_usage = p_final_usage;
+    resources.push_back(std::move(resource));
+    compiled = false;
+    return static_cast<RenderResource>(resources.size() - 1);
+}
+
+
+RenderResource RenderGraph::create_image(const std::string &p_name, const TransientImageInfo &p_info, VkImageAspectFlags p_aspect) {
+    Resource resource;
+    resource.name = p_name;
+    resource.aspect = p_aspect;
+    resource.info = p_info;
+    resources.push_back(std::move(resource));
+    compiled = false;
+    return static_cast<RenderResource>(resources.size() - 1);
+}
+
+
+void RenderGraph::set_extent(RenderResource p_resource, VkExtent2D p_extent) {
+    resources[p_resource].info.extent = p_extent;
+    compiled = false;
+}
+
+
+void RenderGraph::set_image(RenderResource p_resource, VkImage p_image, VkImageView p_image_view) {
+    resources[p_resource].image = p_image;
+    resources[p_resource].image_view = p_image_view;
+}
+
+
+void RenderGraph::set_buffer(RenderResource p_resource, VkBuffer p_buffer) {
+    resources[p_resource].buffer = p_buffer;
+}
+
+
+uint32_t RenderGraph::add_pass(const std::string &p_name, std::function<void(VkCommandBuffer)> p_record) {
+    Pass pass;
+    pass.name = p_name;
+    pass.record = std::move(p_record);
+    passes.push_back(std::move(pass));
+    compiled = false;
+    return static_cast<uint32_t>(passes.size() - 1);
+}
+
+
+void RenderGraph::add_access(uint32_t p_pass, RenderResource p_resource, ResourceUsage p_usage, VkPipelineStageFlags2 p_stages, bool p_write) {
+    VkPipelineStageFlags2 stages = p_stages != VK_PIPELINE_STAGE_2_NONE ? p_stages : usage_info(p_usage).stage;
+    compiled = false;
+    // One access per resource and pass, so a pass never waits on itself.
+    for (Access &access : passes[p_pass].accesses) {
+        if (access.resource == p_resource) {
+            if (resources[p_resource].is_image && usage_info(access.usage).layout != usage_info(p_usage).layout) {
+                print("Render graph: pass '%s' uses '%s' in two layouts!", passes[p_pass].name.c_str(), resources[p_resource].name.c_str());
+            }
+            access.stages |= stages;
+            access.write = access.write || p_write;
+            if (p_write) {
+                access.usage = p_usage;
+            }
+            return;
+        }
+    }
+    passes[p_pass].accesses.push_back({p_resource, p_usage, stages, p_write});
+}
+
+
+void RenderGraph::read(uint32_t p_pass, RenderResource p_resource, ResourceUsage p_usage, VkPipelineStageFlags2 p_stages) {
+    add_access(p_pass, p_resource, p_usage, p_stages, false);
+}
+
+
+void RenderGraph::write(uint32_t p_pass, RenderResource p_resource, ResourceUsage p_usage, VkPipelineStageFlags2 p_stages) {
+    add_access(p_pass, p_resource, p_usage, p_stages, true);
+}
+
+
+bool RenderGraph::compile() {
+    final_barriers.clear();
+    for (Resource &resource : resources) {
+        resource.usage = 0;
+        resource.first_pass = UINT32_MAX;
+        resource.last_pass = 0;
+    }
+
+    // Walk backwards: a pass survives if it has side effects or writes something that leaves the
+    // graph or that a surviving pass reads.
+    std::vector<bool> needed(resources.size(), false);
+    for (uint32_t i = static_cast<uint32_t>(passes.size()); i-- > 0;) {
+        Pass &pass = passes[i];
+        pass.barriers.clear();
+        pass.culled = !pass.side_effects;
+        for (const Access &access : pass.accesses) {
+            if (access.write && (resources[access.resource].imported || needed[access.resource])) {
+                pass.culled = false;
+            }
+        }
+        if (pass.culled) {
+            continue;
+        }
+        for (const Access &access : pass.accesses) {
+            if (!access.write) {
+                needed[access.resource] = true;
+            }
+        }
+    }
+
+    // What the next barrier on a resource has to wait for and make visible.
+    struct ResourceState {
+        VkImageLayout layout;
+        // Stages of the last write or layout transition, and the writes not made available yet.
+        VkPipelineStageFlags2 write_stage;
+        VkAccessFlags2 pending_access;
+        // Reads since then, which a later write has to wait for.
+        VkPipelineStageFlags2 read_stages;
+        // Where the last write is already visible, so further reads there need no barrier.
+        VkPipelineStageFlags2 visible_stages;
+        VkAccessFlags2 visible_access;
+    };
+    std::vector<ResourceState> states(resources.size());
+    for (size_t i = 0; i < resources.size(); i++) {
+        states[i] = {resources[i].initial_layout, resources[i].initial_stage, VK_ACCESS_2_NONE, VK_PIPELINE_STAGE_2_NONE, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE};
+    }
+
+    auto apply = [&](std::vector<GraphBarrier> &r_barriers, RenderResource p_resource, ResourceUsage p_usage, VkPipelineStageFlags2 p_stages, bool p_write) {
+        ResourceState &state = states[p_resource];
+        UsageInfo info = usage_info(p_usage);
+        VkImageLayout layout = resources[p_resource].is_image ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+        bool layout_change = resources[p_resource].is_image && layout != state.layout;
+
+        if (p_write || layout_change) {
+            // Write after write, write after read, or a layout transition, which is a write too.
+            VkPipelineStageFlags2 src_stage = state.write_stage | state.read_stages;
+            if (layout_change || src_stage != VK_PIPELINE_STAGE_2_NONE) {
+                r_barriers.push_back({p_resource, src_stage, state.pending_access, p_stages, info.access, state.layout, layout});
+            }
+            state.layout = layout;
+            state.write_stage = p_stages;
+            state.pending_access = p_write ? info.access & WRITE_ACCESS_MASK : VK_ACCESS_2_NONE;
+            state.read_stages = p_write ? VK_PIPELINE_STAGE_2_NONE : p_stages;
+            state.visible_stages = p_stages;
+            state.visible_access = info.access;
+            return;
+        }
+
+        // Read after write, unless an earlier barrier already made the write visible here.
+        bool visible = (p_stages & ~state.visible_stages) == 0 && (info.access & ~state.visible_access) == 0;
+        if (state.write_stage != VK_PIPELINE_STAGE_2_NONE && !visible) {
+            r_barriers.push_back({p_resource, state.write_stage, state.pending_access, p_stages, info.access, layout, layout});
+            state.pending_access = VK_ACCESS_2_NONE;
+            state.visible_stages |= p_stages;
+            state.visible_access |= info.access;
+        }
+        state.read_stages |= p_stages;
+    };
+
+    for (uint32_t i = 0; i < passes.size(); i++) {
+        Pass &pass = passes[i];
+        if (pass.culled) {
+            continue;
+        }
+        for (const Access &access : pass.accesses) {
+            Resource &resource = resources[access.resource];
+            resource.usage |= usage_info(access.usage).image_usage;
+            resource.first_pass = std::min(resource.first_pass, i);
+            resource.last_pass = i;
+            apply(pass.barriers, access.resource, access.usage, access.stages, access.write);
+        }
+    }
+
+    for (size_t i = 0; i < resources.size(); i++) {
+        Resource &resource = resources[i];
+        if (resource.imported && resource.final_usage != ResourceUsage::NONE) {
+            apply(final_barriers, static_cast<RenderResource>(i), resource.final_usage, usage_info(resource.final_usage).stage, false);
+        }
+        // For the next image placed in the same memory.
+        resource.last_stage = states[i].write_stage | states[i].read_stages;
+        resource.last_write_access = states[i].pending_access;
+    }
+
+    compiled = true;
+    return true;
+}
+
+
+VkDeviceSize RenderGraph::plan_memory(const std::vector<VkMemoryRequirements> &p_requirements) {
+    struct Placement {
+        uint32_t resource;
+        VkDeviceSize size;
+        VkDeviceSize alignment;
+    };
+    std::vector<Placement> placements;
+    size_t transient_index = 0;
+    for (uint32_t i = 0; i < resources.size(); i++) {
+        Resource &resource = resources[i];
+        if (resource.imported) {
+            continue;
+        }
+        const VkMemoryRequirements &requirements = p_requirements[transient_index++];
+        resource.memory_offset = 0;
+        resource.memory_size = requirements.size;
+        if (resource.first_pass != UINT32_MAX && !resource.lazily_allocated) {
+            placements.push_back({i, requirements.size, std::max<VkDeviceSize>(requirements.alignment, 1)});
+        }
+    }
+
+    // Largest first, each at the lowest offset that does not overlap an image alive at the same time.
+    std::sort(placements.begin(), placements.end(), [](const Placement &p_a, const Placement &p_b) { return p_a.size > p_b.size; });
+    heap_size = 0;
+    std::vector<uint32_t> placed;
+    for (const Placement &placement : placements) {
+        Resource &resource = resources[placement.resource];
+        std::vector<std::pair<VkDeviceSize, VkDeviceSize>> occupied;
+        for (uint32_t other_index : placed) {
+            const Resource &other = resources[other_index];
+            if (other.first_pass <= resource.last_pass && resource.first_pass <= other.last_pass) {
+                occupied.push_back({other.memory_offset, other.memory_offset + other.memory_size});
+            }
+        }
+        std::sort(occupied.begin(), occupied.end());
+
+        VkDeviceSize offset {0};
+        for (const auto &[begin, end] : occupied) {
+            if (offset + placement.size <= begin) {
+                break;
+            }
+            offset = std::max(offset, (end + placement.alignment - 1) / placement.alignment * placement.alignment);
+        }
+        resource.memory_offset = offset;
+        heap_size = std::max(heap_size, offset + placement.size);
+        placed.push_back(placement.resource);
+    }
+
+    // An image that reuses memory must wait until the images there before it are done: earlier
+    // ones in this frame, and the later ones and itself in the previous frame, which used the same
+    // memory. Its first access always transitions from UNDEFINED, so that barrier already exists.
+    // Lazily allocated images only share memory with themselves.
+    for (uint32_t i = 0; i < resources.size(); i++) {
+        if (!resources[i].imported && resources[i].first_pass != UINT32_MAX && resources[i].lazily_allocated) {
+            placed.push_back(i);
+        }
+    }
+    for (uint32_t resource_index : placed) {
+        Resource &resource = resources[resource_index];
+        for (uint32_t other_index : placed) {
+            const Resource &other = resources[other_index];
+            bool overlaps = other.memory_offset < resource.memory_offset + resource.memory_size
+                && resource.memory_offset < other.memory_offset + other.memory_size;
+            if (other_index != resource_index && (!overlaps || resource.lazily_allocated || other.lazily_allocated)) {
+                continue;
+            }
+            for (GraphBarrier &barrier : passes[resource.first_pass].barriers) {
+                if (barrier.resource == resource_index) {
+                    barrier.src_stage |= other.last_stage;
+                    barrier.src_access |= other.last_write_access;
+                }
+            }
+        }
+    }
+    return heap_size;
+}
+
+
+bool RenderGraph::allocate(VkDevice p_device, DeviceAllocator &p_allocator) {
+    if (!compiled && !compile()) {
+        return false;
+    }
+    cleanup(p_allocator);
+
+    std::vector<VkMemoryRequirements> requirements;
+    VkMemoryRequirements heap_requirements = {};
+    heap_requirements.memoryTypeBits = ~0u;
+    heap_requirements.alignment = 1;
+    for (Resource &resource : resources) {
+        if (resource.imported) {
+            continue;
+        }
+        requirements.push_back({});
+        if (resource.first_pass == UINT32_MAX) {
+            continue;
+        }
+
+        // Attachments that are never copied or sampled can live in tile memory on tilers.
+        bool attachment_only = (resource.usage & ~ATTACHMENT_USAGE_MASK) == 0;
+        VkImageCreateInfo image_info = {};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = resource.info.format;
+        image_info.extent = {resource.info.extent.width, resource.info.extent.height, 1};
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = resource.info.samples;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = resource.usage | (attachment_only ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0);
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (vkCreateImage(p_device, &image_info, nullptr, resource.owned_image.put(p_device)) != VK_SUCCESS) {
+            print("Could not create transient image '%s'!", resource.name.c_str());
+            return false;
+        }
+        vkGetImageMemoryRequirements(p_device, resource.owned_image, &requirements.back());
+
+        // Lazily allocated memory is only committed if the tile contents ever have to be spilled.
+        resource.lazily_allocated = attachment_only && p_allocator.allocate(requirements.back(),
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, AllocationStrategy::POOL, ResourceKind::OPTIMAL_IMAGE, resource.lazy_allocation);
+        if (!resource.lazily_allocated) {
+            heap_requirements.memoryTypeBits &= requirements.back().memoryTypeBits;
+            heap_requirements.alignment = std::max(heap_requirements.alignment, requirements.back().alignment);
+        }
+    }
+
+    heap_requirements.size = plan_memory(requirements);
+    if (heap_requirements.size > 0
+        && !p_allocator.allocate(heap_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationStrategy::POOL, ResourceKind::OPTIMAL_IMAGE, heap_allocation)) {
+        print("Could not allocate %llu bytes for transient images!", (unsigned long long)heap_requirements.size);
+        return false;
+    }
+
+    for (Resource &resource : resources) {
+        if (resource.owned_image == VK_NULL_HANDLE) {
+            continue;
+        }
+        const Allocation &allocation = resource.lazily_allocated ? resource.lazy_allocation : heap_allocation;
+        VkDeviceSize offset = allocation.offset + (resource.lazily_allocated ? 0 : resource.memory_offset);
+        if (vkBindImageMemory(p_device, resource.owned_image, allocation.memory, offset) != VK_SUCCESS) {
+            return false;
+        }
+
+        VkImageViewCreateInfo view_info = {};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.image = resource.owned_image;
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = resource.info.format;
+        view_info.subresourceRange.aspectMask = resource.aspect;
+        view_info.subresourceRange.levelCount = 1;
+        view_info.subresourceRange.layerCount = 1;
+        if (vkCreateImageView(p_device, &view_info, nullptr, resource.owned_image_view.put(p_device)) != VK_SUCCESS) {
+            return false;
+        }
+        resource.image = resource.owned_image;
+        resource.image_view = resource.owned_image_view;
+        DEBUG_NAME(p_device, VK_OBJECT_TYPE_IMAGE, resource.image, resource.name.c_str());
+    }
+    return true;
+}
+
+
+void RenderGraph::cleanup(DeviceAllocator &p_allocator) {
+    for (Resource &resource : resources) {
+        if (resource.imported) {
+            continue;
+        }
+        resource.owned_image_view.reset();
+        resource.owned_image.reset();
+        resource.image = VK_NULL_HANDLE;
+        resource.image_view = VK_NULL_HANDLE;
+        if (resource.lazily_allocated) {
+            p_allocator.free(resource.lazy_allocation);
+            resource.lazy_allocation = Allocation();
+            resource.lazily_allocated = false;
+        }
+    }
+    p_allocator.free(heap_allocation);
+    heap_allocation = Allocation();
+}
+
+
+void RenderGraph::retire(DeletionQueue &p_deletion_queue, uint64_t p_last_submit, DeviceAllocator &p_allocator) {
+    DeviceAllocator* allocator = &p_allocator;
+    for (Resource &resource : resources) {
+        if (resource.imported) {
+            continue;
+        }
+        p_deletion_queue.push(p_last_submit, std::move(resource.owned_image_view));
+        p_deletion_queue.push(p_last_submit, std::move(resource.owned_image));
+        resource.image = VK_NULL_HANDLE;
+        resource.image_view = VK_NULL_HANDLE;
+        if (resource.lazily_allocated) {
+            Allocation lazy_allocation = resource.lazy_allocation;
+            p_deletion_queue.push(p_last_submit, [allocator, lazy_allocation]() mutable { allocator->free(lazy_allocation); });
+            resource.lazy_allocation = Allocation();
+            resource.lazily_allocated = false;
+        }
+    }
+    Allocation old_heap_allocation = heap_allocation;
+    p_deletion_queue.push(p_last_submit, [allocator, old_heap_allocation]() mutable { allocator->free(old_heap_allocation); });
+    heap_allocation = Allocation();
+}
+
+
+void RenderGraph::clear() {
+    resources.clear();
+    passes.clear();
+    final_barriers.clear();
+    heap_size = 0;
+    compiled = false;
+}
+
+
+void RenderGraph::record_barriers(VkCommandBuffer p_command_buffer, const std::vector<GraphBarrier> &p_barriers) const {
+    if (p_barriers.empty()) {
+        return;
+    }
+
+    std::vector<VkImageMemoryBarrier2> image_barriers;
+    std::vector<VkBufferMemoryBarrier2> buffer_barriers;
+    for (const GraphBarrier &graph_barrier : p_barriers) {
+        const Resource &resource = resources[graph_barrier.resource];
+        if (resource.is_image) {
+            VkImageMemoryBarrier2 barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            barrier.srcStageMask = graph_barrier.src_stage;
+            barrier.srcAccessMask = graph_barrier.src_access;
+            barrier.dstStageMask = graph_barrier.dst_stage;
+            barrier.dstAccessMask = graph_barrier.dst_access;
+            barrier.oldLayout = graph_barrier.old_layout;
+            barrier.newLayout = graph_barrier.new_layout;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = resource.image;
+            barrier.subresourceRange.aspectMask = resource.aspect;
+            barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+            barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+            image_barriers.push_back(barrier);
+        } else {
+            VkBufferMemoryBarrier2 barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+            barrier.srcStageMask = graph_barrier.src_stage;
+            barrier.srcAccessMask = graph_barrier.src_access;
+            barrier.dstStageMask = graph_barrier.dst_stage;
+            barrier.dstAccessMask = graph_barrier.dst_access;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.buffer = resource.buffer;
+            barrier.offset = 0;
+            barrier.size = VK_WHOLE_SIZE;
+            buffer_barriers.push_back(barrier);
+        }
+    }
+
+    VkDependencyInfo dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.bufferMemoryBarrierCount = static_cast<uint32_t>(buffer_barriers.size());
+    dependency_info.pBufferMemoryBarriers = buffer_barriers.data();
+    dependency_info.imageMemoryBarrierCount = static_cast<uint32_t>(image_barriers.size());
+    dependency_info.pImageMemoryBarriers = image_barriers.data();
+    vkCmdPipelineBarrier2(p_command_buffer, &dependency_info);
+}
+
+
+void RenderGraph::execute(VkCommandBuffer p_command_buffer) const {
+    for (const Pass &pass : passes) {
+        if (pass.culled) {
+            continue;
+        }
+        DEBUG_LABEL_BEGIN(p_command_buffer, pass.name.c_str());
+        record_barriers(p_command_buffer, pass.barriers);
+        pass.record(p_command_buffer);
+        DEBUG_LABEL_END(p_command_buffer);
+    }
+    record_barriers(p_command_buffer, final_barriers);
+}
+
+
+std::vector<std::string> RenderGraph::describe() const {
+    std::vector<std::string> lines;
+    char line[256];
+    auto describe_barrier = [&](const GraphBarrier &p_barrier) {
+        const Resource &resource = resources[p_barrier.resource];
+        int length = snprintf(line, sizeof(line), "    barrier '%s': stages 0x%llx -> 0x%llx, access 0x%llx -> 0x%llx", resource.name.c_str(),
+            (unsigned long long)p_barrier.src_stage, (unsigned long long)p_barrier.dst_stage,
+            (unsigned long long)p_barrier.src_access, (unsigned long long)p_barrier.dst_access);
+        if (resource.is_image && length > 0 && length < int(sizeof(line))) {
+            snprintf(line + length, sizeof(line) - length, ", %s -> %s", layout_name(p_barrier.old_layout), layout_name(p_barrier.new_layout));
+        }
+        lines.push_back(line);
+    };
+
+    size_t culled_count = 0;
+    size_t barrier_count = final_barriers.size();
+    for (const Pass &pass : passes) {
+        culled_count += pass.culled ? 1 : 0;
+        barrier_count += pass.barriers.size();
+    }
+    snprintf(line, sizeof(line), "Render graph: %zu passes (%zu culled), %zu barriers, %llu bytes of aliased transient memory",
+        passes.size(), culled_count, barrier_count, (unsigned long long)heap_size);
+    lines.push_back(line);
+
+    for (const Pass &pass : passes) {
+        snprintf(line, sizeof(line), "  pass '%s'%s", pass.name.c_str(), pass.culled ? " (culled)" : "");
+        lines.push_back(line);
+        for (const GraphBarrier &barrier : pass.barriers) {
+            describe_barrier(barrier);
+        }
+    }
+    if (!final_barriers.empty()) {
+        lines.push_back("  end of frame");
+        for (const GraphBarrier &barrier : final_barriers) {
+            describe_barrier(barrier);
+        }
+    }
+    for (const Resource &resource : resources) {
+        if (resource.imported) {
+            continue;
+        }
+        if (resource.first_pass == UINT32_MAX) {
+            snprintf(line, sizeof(line), "  image '%s': unused", resource.name.c_str());
+        } else if (resource.lazily_allocated) {
+            snprintf(line, sizeof(line), "  image '%s': passes %u-%u, lazily allocated", resource.name.c_str(), resource.first_pass, resource.last_pass);
+        } else {
+            snprintf(line, sizeof(line), "  image '%s': passes %u-%u, bytes %llu-%llu", resource.name.c_str(), resource.first_pass, resource.last_pass,
+                (unsigned long long)resource.memory_offset, (unsigned long long)(resource.memory_offset + resource.memory_size));
+        }
+        lines.push_back(line);
+    }
+    return lines;
+}
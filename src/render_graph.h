@@ -0,0 +1,166 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "allocator.h"
+#include "deletion_queue.h"
+#include "vulkan_handle.h"
+
+using RenderResource = uint32_t;
+constexpr RenderResource INVALID_RENDER_RESOURCE{ UINT32_MAX };
+
+// How a pass uses a resource. Each usage implies the pipeline stages, the access mask and, for
+// images, the layout; see usage_info() in render_graph.cpp.
+enum class ResourceUsage {
+    NONE,
+    COLOR_ATTACHMENT,
+    DEPTH_ATTACHMENT,
+    SAMPLED,
+    STORAGE_READ,
+    STORAGE_WRITE,
+    INDIRECT_READ,
+    TRANSFER_SRC,
+    TRANSFER_DST,
+    // Final usages, for resources that leave the graph.
+    PRESENT,
+    HOST_READ,
+};
+
+// An image that only lives within the frame. Its usage flags are derived from the passes.
+struct TransientImageInfo {
+    VkFormat format{ VK_FORMAT_UNDEFINED };
+    VkExtent2D extent{ 0, 0 };
+    VkSampleCountFlagBits samples{ VK_SAMPLE_COUNT_1_BIT };
+};
+
+// One barrier the graph places before a pass, or after the last one. Resources are referenced by
+// index, so the same compiled graph serves every frame while imported handles change.
+struct GraphBarrier {
+    RenderResource resource;
+    VkPipelineStageFlags2 src_stage;
+    VkAccessFlags2 src_access;
+    VkPipelineStageFlags2 dst_stage;
+    VkAccessFlags2 dst_access;
+    // Both UNDEFINED for buffers.
+    VkImageLayout old_layout;
+    VkImageLayout new_layout;
+};
+
+// A small frame graph. Passes declare which images and buffers they read and write; compile()
+// drops passes whose results are never used and derives the minimal barriers and layout
+// transitions between the rest, and allocate() places transient images with disjoint lifetimes
+// at the same offsets of one memory block. compile() and plan_memory() need no device, so a graph
+// can be inspected with describe() without rendering anything.
+class RenderGraph {
+
+private:
+    struct Resource {
+        std::string name;
+        bool is_image{ true };
+        bool imported{ false };
+        VkImage image{ VK_NULL_HANDLE };
+        VkImageView image_view{ VK_NULL_HANDLE };
+        VkBuffer buffer{ VK_NULL_HANDLE };
+        VkImageAspectFlags aspect{ VK_IMAGE_ASPECT_COLOR_BIT };
+        VkImageLayout initial_layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+        // Work outside the graph that the first access must wait for, e.g. the acquire semaphore wait.
+        VkPipelineStageFlags2 initial_stage{ VK_PIPELINE_STAGE_2_NONE };
+        ResourceUsage final_usage{ ResourceUsage::NONE };
+        // Transient images only.
+        TransientImageInfo info;
+        VkImageUsageFlags usage{ 0 };
+        uint32_t first_pass{ UINT32_MAX };
+        uint32_t last_pass{ 0 };
+        VkPipelineStageFlags2 last_stage{ VK_PIPELINE_STAGE_2_NONE };
+        VkAccessFlags2 last_write_access{ VK_ACCESS_2_NONE };
+        bool lazily_allocated{ false };
+        VkDeviceSize memory_offset{ 0 };
+        VkDeviceSize memory_size{ 0 };
+        UniqueImage owned_image;
+        UniqueImageView owned_image_view;
+        Allocation lazy_allocation;
+    };
+
+    struct Access {
+        RenderResource resource;
+        ResourceUsage usage;
+        VkPipelineStageFlags2 stages;
+        bool write;
+    };
+
+    struct Pass {
+        std::string name;
+        std::function<void(VkCommandBuffer)> record;
+        std::vector<Access> accesses;
+        bool side_effects{ false };
+        bool culled{ false };
+        std::vector<GraphBarrier> barriers;
+    };
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<GraphBarrier> final_barriers;
+    VkDeviceSize heap_size{ 0 };
+    Allocation heap_allocation;
+    bool compiled{ false };
+
+    void add_access(uint32_t p_pass, RenderResource p_resource, ResourceUsage p_usage, VkPipelineStageFlags2 p_stages, bool p_write);
+    void record_barriers(VkCommandBuffer p_command_buffer, const std::vector<GraphBarrier> &p_barriers) const;
+
+public:
+    RenderResource import_image(const std::string &p_name, VkImageLayout p_initial_layout, VkPipelineStageFlags2 p_initial_stage,
+        ResourceUsage p_final_usage, VkImageAspectFlags p_aspect = VK_IMAGE_ASPECT_COLOR_BIT);
+    // p_initial_stage is work outside the graph the first access waits for, e.g. last frame's reads of a persistent buffer.
+    RenderResource import_buffer(const std::string &p_name, ResourceUsage p_final_usage = ResourceUsage::NONE,
+        VkPipelineStageFlags2 p_initial_stage = VK_PIPELINE_STAGE_2_NONE);
+    RenderResource create_image(const std::string &p_name, const TransientImageInfo &p_info, VkImageAspectFlags p_aspect = VK_IMAGE_ASPECT_COLOR_BIT);
+    // Resizes a transient image, e.g. with the swapchain. Takes effect with the next allocate().
+    void set_extent(RenderResource p_resource, VkExtent2D p_extent);
+    // Imported handles may change every frame, e.g. the acquired swapchain image.
+    void set_image(RenderResource p_resource, VkImage p_image, VkImageView p_image_view);
+    void set_buffer(RenderResource p_resource, VkBuffer p_buffer);
+
+    uint32_t add_pass(const std::string &p_name, std::function<void(VkCommandBuffer)> p_record);
+    // p_stages narrows the stages implied by p_usage, e.g. a storage buffer only read by vertex shaders.
+    void read(uint32_t p_pass, RenderResource p_resource, ResourceUsage p_usage, VkPipelineStageFlags2 p_stages = VK_PIPELINE_STAGE_2_NONE);
+    void write(uint32_t p_pass, RenderResource p_resource, ResourceUsage p_usage, VkPipelineStageFlags2 p_stages = VK_PIPELINE_STAGE_2_NONE);
+    // Never culled, even if nothing reads what it writes.
+    void set_side_effects(uint32_t p_pass) { passes[p_pass].side_effects = true; }
+
+    // Culls passes and computes lifetimes and barriers. Passes run in the order they were added.
+    bool compile();
+    // Places the transient images given their requirements, in creation order, and adds the
+    // dependencies between images that share memory, within the frame and with the previous one.
+    // Returns the size of the shared block.
+    VkDeviceSize plan_memory(const std::vector<VkMemoryRequirements> &p_requirements);
+    // Creates the transient images and their memory. Call after compile().
+    bool allocate(VkDevice p_device, DeviceAllocator &p_allocator);
+    void cleanup(DeviceAllocator &p_allocator);
+    // Like cleanup(), but destroys the transient images and their memory once p_last_submit has
+    // finished, so frames in flight can keep using them while allocate() creates new ones.
+    void retire(DeletionQueue &p_deletion_queue, uint64_t p_last_submit, DeviceAllocator &p_allocator);
+    // Removes every pass and resource. Transient images must have been cleaned up.
+    void clear();
+
+    void execute(VkCommandBuffer p_command_buffer) const;
+
+    VkImage get_image(RenderResource p_resource) const { return resources[p_resource].image; }
+    VkImageView get_image_view(RenderResource p_resource) const { return resources[p_resource].image_view; }
+    VkBuffer get_buffer(RenderResource p_resource) const { return resources[p_resource].buffer; }
+    bool is_culled(uint32_t p_pass) const { return passes[p_pass].culled; }
+    const std::vector<GraphBarrier>& get_barriers(uint32_t p_pass) const { return passes[p_pass].barriers; }
+    const std::vector<GraphBarrier>& get_final_barriers() const { return final_barriers; }
+    VkDeviceSize get_heap_size() const { return heap_size; }
+    // Offset of a transient image in the shared block, as placed by plan_memory().
+    VkDeviceSize get_memory_offset(RenderResource p_resource) const { return resources[p_resource].memory_offset; }
+    // Passes, barriers and the memory layout in readable form, one line per entry.
+    std::vector<std::string> describe() const;
+
+    RenderGraph() {};
+    ~RenderGraph() {};
+};
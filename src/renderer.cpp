@@ -1,7 +1,28 @@
 #include "renderer.h"
 
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <thread>
+#include <random>
+#include <numeric>
+#include <cmath>
+
 #include "util.h"
 #include "shaders/triangle.h"
+#include "shaders/instanced.h"
+#include "shaders/primitives.h"
+#include "shaders/particles.h"
+#include "shaders/mesh.h"
+#include "shaders/triangle_reflection.h"
+#include "shaders/instanced_reflection.h"
+#include "shaders/primitives_reflection.h"
+#include "shaders/particles_reflection.h"
+#include "shaders/mesh_reflection.h"
 
 
 bool Renderer::create_vulkan_instance(uint32_t p_extension_count, const char* const* p_extensions) {
@@ -9,34 +30,214 @@ bool Renderer::create_vulkan_instance(uint32_t p_extension_count, const char* co
     application_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
     application_info.apiVersion = VK_API_VERSION_1_3;
 
-    const char* enabled_layers[1] = {"VK_LAYER_KHRONOS_validation"};
+    std::vector<const char*> extensions(p_extensions, p_extensions + p_extension_count);
+    std::vector<const char*> layers;
 
     VkInstanceCreateInfo create_info = {};
     create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
     create_info.pApplicationInfo = &application_info;
-    create_info.enabledExtensionCount = p_extension_count;
-    create_info.ppEnabledExtensionNames = p_extensions;
-    create_info.enabledLayerCount = 1;
-    create_info.ppEnabledLayerNames = enabled_layers;
 
-    return vkCreateInstance(&create_info, nullptr, &instance) == VK_SUCCESS;
+#ifdef VULKAN_DEBUG
+    if (settings.validation) {
+        if (has_instance_layer(VALIDATION_LAYER_NAME)) {
+            layers.push_back(VALIDATION_LAYER_NAME);
+        } else {
+            print("%s is not installed, running without validation", VALIDATION_LAYER_NAME);
+        }
+    }
+    bool debug_utils = settings.debug_utils && has_instance_extension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+    VkDebugUtilsMessengerCreateInfoEXT messenger_info = get_debug_messenger_info();
+    if (debug_utils) {
+        extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+        create_info.pNext = &messenger_info;
+    }
+#endif
+
+    create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    create_info.ppEnabledExtensionNames = extensions.data();
+    create_info.enabledLayerCount = static_cast<uint32_t>(layers.size());
+    create_info.ppEnabledLayerNames = layers.data();
+
+    if (vkCreateInstance(&create_info, nullptr, &instance) != VK_SUCCESS) {
+        return false;
+    }
+
+#ifdef VULKAN_DEBUG
+    if (debug_utils && (!load_debug_utils(instance) || !create_debug_messenger(instance, debug_messenger))) {
+        print("Could not create debug messenger!");
+    }
+#endif
+    return true;
 };
 
+static const char* device_type_name(VkPhysicalDeviceType p_type) {
+    switch (p_type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "discrete";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "virtual";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: return "cpu";
+        default: return "other";
+    }
+}
+
+int64_t Renderer::score_physical_device(VkPhysicalDevice p_physical_device) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(p_physical_device, &properties);
+
+    // Required: Vulkan 1.3 with dynamic rendering and synchronization2, and the descriptor
+    // indexing features of the bindless set.
+    if (properties.apiVersion < VK_API_VERSION_1_3) {
+        return -1;
+    }
+    VkPhysicalDeviceVulkan12Features vulkan12_features = {};
+    vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceVulkan13Features vulkan13_features = {};
+    vulkan13_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    vulkan13_features.pNext = &vulkan12_features;
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &vulkan13_features;
+    vkGetPhysicalDeviceFeatures2(p_physical_device, &features);
+    if (!vulkan13_features.dynamicRendering || !vulkan13_features.synchronization2) {
+        return -1;
+    }
+    if (!vulkan12_features.descriptorIndexing || !vulkan12_features.runtimeDescriptorArray || !vulkan12_features.descriptorBindingPartiallyBound
+        || !vulkan12_features.descriptorBindingSampledImageUpdateAfterBind || !vulkan12_features.descriptorBindingStorageBufferUpdateAfterBind
+        || !vulkan12_features.descriptorBindingUpdateUnusedWhilePending || !vulkan12_features.shaderSampledImageArrayNonUniformIndexing
+        || !vulkan12_features.shaderStorageBufferArrayNonUniformIndexing) {
+        return -1;
+    }
+
+    uint32_t queue_family_count {0};
+    vkGetPhysicalDeviceQueueFamilyProperties(p_physical_device, &queue_family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(p_physical_device, &queue_family_count, queue_families.data());
+
+    // Required: one family that does graphics and can present to all our surfaces.
+    bool graphics_queue {false};
+    for (uint32_t i = 0; i < queue_family_count && !graphics_queue; i++) {
+        if (queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+            graphics_queue = settings.headless || can_present(p_physical_device, i);
+        }
+    }
+    if (!graphics_queue) {
+        return -1;
+    }
+
+    if (!settings.headless) {
+        uint32_t extension_count {0};
+        vkEnumerateDeviceExtensionProperties(p_physical_device, nullptr, &extension_count, nullptr);
+        std::vector<VkExtensionProperties> extensions(extension_count);
+        vkEnumerateDeviceExtensionProperties(p_physical_device, nullptr, &extension_count, extensions.data());
+        bool swapchain_support = std::any_of(extensions.begin(), extensions.end(), [](const VkExtensionProperties &extension) {
+            return strcmp(extension.extensionName, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0;
+        });
+        if (!swapchain_support) {
+            return -1;
+        }
+    }
+
+    // The device type dominates, so an integrated GPU never wins over a discrete one.
+    int64_t score {0};
+    switch (properties.deviceType) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: score += 1000000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score += 100000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: score += 10000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: score += 1000; break;
+        default: break;
+    }
+
+    // Between devices of the same type prefer more device-local memory, then larger limits.
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(p_physical_device, &memory_properties);
+    VkDeviceSize device_local_size {0};
+    for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+        if (memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            device_local_size += memory_properties.memoryHeaps[i].size;
+        }
+    }
+    score += int64_t(device_local_size / (64ull * 1024 * 1024));
+    score += properties.limits.maxImageDimension2D / 1024;
+
+    return score;
+}
+
 bool Renderer::create_physical_device() {
-    uint32_t physical_device_count;
+    uint32_t physical_device_count {0};
     vkEnumeratePhysicalDevices(instance, &physical_device_count, nullptr);
     if (physical_device_count == 0) {
         print("Could not find a physical rendering device!");
         return false;
     }
 
-    VkPhysicalDevice* physical_devices = new VkPhysicalDevice[physical_device_count];
-    VkResult result = vkEnumeratePhysicalDevices(instance, &physical_device_count, physical_devices);
+    std::vector<VkPhysicalDevice> physical_devices(physical_device_count);
+    if (vkEnumeratePhysicalDevices(instance, &physical_device_count, physical_devices.data()) != VK_SUCCESS) {
+        return false;
+    }
 
-    // TODO: Choose the best graphics card by querying support for required properties.
-    physical_device = physical_devices[0];
+    // The override is either an index or a case-insensitive part of the device name.
+    std::string wanted = settings.device;
+    std::transform(wanted.begin(), wanted.end(), wanted.begin(), [](unsigned char c) { return (char)tolower(c); });
+    bool by_index = !wanted.empty() && std::all_of(wanted.begin(), wanted.end(), [](unsigned char c) { return isdigit(c) != 0; });
+
+    std::vector<int64_t> scores(physical_device_count);
+    uint32_t best_index {UINT32_MAX};
+    uint32_t wanted_index {UINT32_MAX};
+    for (uint32_t i = 0; i < physical_device_count; i++) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_devices[i], &properties);
+        scores[i] = score_physical_device(physical_devices[i]);
+        if (scores[i] < 0) {
+            print("GPU %u: %s (%s), unsuitable", i, properties.deviceName, device_type_name(properties.deviceType));
+        } else {
+            print("GPU %u: %s (%s), score %lld", i, properties.deviceName, device_type_name(properties.deviceType), (long long)scores[i]);
+        }
 
-    return result == VK_SUCCESS;
+        if (scores[i] >= 0 && (best_index == UINT32_MAX || scores[i] > scores[best_index])) {
+            best_index = i;
+        }
+
+        std::string name = properties.deviceName;
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)tolower(c); });
+        bool matches = by_index ? (uint32_t)atoi(wanted.c_str()) == i : !wanted.empty() && name.find(wanted) != std::string::npos;
+        if (matches && wanted_index == UINT32_MAX) {
+            wanted_index = i;
+        }
+    }
+
+    if (!wanted.empty()) {
+        if (wanted_index == UINT32_MAX) {
+            print("No GPU matches '%s', using the highest score instead.", settings.device.c_str());
+        } else if (scores[wanted_index] < 0) {
+            print("GPU %u lacks Vulkan 1.3 or cannot render to this surface, using the highest score instead.", wanted_index);
+        } else {
+            best_index = wanted_index;
+        }
+    }
+    if (best_index == UINT32_MAX) {
+        print("No GPU supports Vulkan 1.3 and presentation to this surface!");
+        return false;
+    }
+
+    physical_device = physical_devices[best_index];
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    device_name = properties.deviceName;
+    print("Using GPU %u: %s", best_index, device_name.c_str());
+
+    return true;
+}
+
+std::vector<uint32_t> Renderer::get_queue_families() const {
+    std::vector<uint32_t> families = {queue_family_index};
+    if (has_transfer_queue()) {
+        families.push_back(transfer_queue_family_index);
+    }
+    if (has_compute_queue() && compute_queue_family_index != transfer_queue_family_index) {
+        families.push_back(compute_queue_family_index);
+    }
+    return families;
 }
 
 bool Renderer::create_device() {
@@ -48,69 +249,274 @@ bool Renderer::create_device() {
     
     for (const VkQueueFamilyProperties &queue_family : queue_families) {
         if (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-            VkBool32 presentation_support { false };
-            vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, queue_index, surface, &presentation_support);
-            if (presentation_support) {
+            if (settings.headless) {
+                break;
+            }
+            if (can_present(physical_device, queue_index)) {
                 break;
             }
         }
         queue_index++;
     }
+    queue_family_index = queue_index;
+
+    // Transfer-only families usually map to the DMA engines, compute-only ones to async compute.
+    transfer_queue_family_index = queue_family_index;
+    compute_queue_family_index = queue_family_index;
+    if (settings.async_queues) {
+        bool transfer_found {false};
+        bool compute_found {false};
+        for (uint32_t i = 0; i < queue_family_count; i++) {
+            VkQueueFlags flags = queue_families[i].queueFlags;
+            if (!transfer_found && (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+                transfer_queue_family_index = i;
+                transfer_found = true;
+            }
+            if (!compute_found && (flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+                compute_queue_family_index = i;
+                compute_found = true;
+            }
+        }
+        // Compute families can copy too. Uploads must be done before the culling pass reads them,
+        // which the graphics queue could only guarantee by running after it.
+        if (!transfer_found && compute_found) {
+            transfer_queue_family_index = compute_queue_family_index;
+        }
+    }
 
+    std::vector<uint32_t> families = get_queue_families();
     float priority = 1.0f;
-    VkDeviceQueueCreateInfo queue_create_info = {};
-    queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queue_create_info.queueFamilyIndex = queue_index;
-    queue_create_info.queueCount = 1;
-    queue_create_info.pQueuePriorities = &priority;
+    std::vector<VkDeviceQueueCreateInfo> queue_create_infos(families.size());
+    for (size_t i = 0; i < families.size(); i++) {
+        queue_create_infos[i].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queue_create_infos[i].queueFamilyIndex = families[i];
+        queue_create_infos[i].queueCount = 1;
+        queue_create_infos[i].pQueuePriorities = &priority;
+    }
+
+    VkPhysicalDeviceVulkan12Features vulkan12_features = {};
+    vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12_features.descriptorIndexing = VK_TRUE;
+    vulkan12_features.runtimeDescriptorArray = VK_TRUE;
+    vulkan12_features.descriptorBindingPartiallyBound = VK_TRUE;
+    vulkan12_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    vulkan12_features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    vulkan12_features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    vulkan12_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    vulkan12_features.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+
+    VkPhysicalDeviceVulkan13Features vulkan13_features = {};
+    vulkan13_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    vulkan13_features.pNext = &vulkan12_features;
+    vulkan13_features.dynamicRendering = VK_TRUE;
+    vulkan13_features.synchronization2 = VK_TRUE;
+
+    // Pipeline statistics count the vertex shader invocations of the mesh pass.
+    VkPhysicalDeviceFeatures supported_features;
+    vkGetPhysicalDeviceFeatures(physical_device, &supported_features);
+    VkPhysicalDeviceFeatures enabled_features = {};
+    pipeline_statistics = !settings.mesh_path.empty() && supported_features.pipelineStatisticsQuery;
+    enabled_features.pipelineStatisticsQuery = pipeline_statistics ? VK_TRUE : VK_FALSE;
 
     const char* enabled_extensions[1] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
     VkDeviceCreateInfo create_info = {};
     create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    create_info.queueCreateInfoCount = 1;
-    create_info.pQueueCreateInfos = &queue_create_info;
-    create_info.enabledExtensionCount = 1;
+    create_info.pNext = &vulkan13_features;
+    create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
+    create_info.pQueueCreateInfos = queue_create_infos.data();
+    create_info.enabledExtensionCount = settings.headless ? 0 : 1;
     create_info.ppEnabledExtensionNames = enabled_extensions;
+    create_info.pEnabledFeatures = &enabled_features;
 
     if (vkCreateDevice(physical_device, &create_info, nullptr, &device) != VK_SUCCESS) {
         return false;
     }
 
-    vkGetDeviceQueue(device, queue_index, 0, &queue);
+    vkGetDeviceQueue(device, queue_family_index, 0, &queue);
+    vkGetDeviceQueue(device, transfer_queue_family_index, 0, &transfer_queue);
+    vkGetDeviceQueue(device, compute_queue_family_index, 0, &compute_queue);
+    print("Queue families: graphics %u, transfer %u%s, compute %u%s", queue_family_index,
+        transfer_queue_family_index, has_transfer_queue() ? " (dedicated)" : "",
+        compute_queue_family_index, has_compute_queue() ? " (async)" : "");
+    return true;
+}
+
+static const char* present_mode_name(VkPresentModeKHR p_present_mode) {
+    switch (p_present_mode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR: return "IMMEDIATE";
+        case VK_PRESENT_MODE_MAILBOX_KHR: return "MAILBOX";
+        case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+        default: return "UNKNOWN";
+    }
+}
+
+const char* Renderer::get_present_mode_name() const {
+    return settings.headless ? "NONE" : present_mode_name(windows[0].present_mode);
+}
+
+bool Renderer::can_present(VkPhysicalDevice p_physical_device, uint32_t p_queue_family) const {
+    for (const WindowSurface &window : windows) {
+        VkBool32 presentation_support { false };
+        vkGetPhysicalDeviceSurfaceSupportKHR(p_physical_device, p_queue_family, window.surface, &presentation_support);
+        if (!presentation_support) {
+            return false;
+        }
+    }
     return true;
 }
 
-bool Renderer::create_swapchain() {
+VkPresentModeKHR Renderer::choose_present_mode(const WindowSurface &p_window) {
+    uint32_t mode_count {0};
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, p_window.surface, &mode_count, nullptr);
+    std::vector<VkPresentModeKHR> supported_modes(mode_count);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, p_window.surface, &mode_count, supported_modes.data());
+
+    // Prefer the requested mode, then the others from lowest to highest latency; FIFO is always supported.
+    VkPresentModeKHR candidates[] = {settings.present_mode, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR,
+        VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_FIFO_KHR};
+    for (VkPresentModeKHR candidate : candidates) {
+        if (std::find(supported_modes.begin(), supported_modes.end(), candidate) != supported_modes.end()) {
+            return candidate;
+        }
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+VkExtent2D Renderer::choose_swapchain_extent(const WindowSurface &p_window) {
+    VkSurfaceCapabilitiesKHR capabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, p_window.surface, &capabilities);
+    if (capabilities.currentExtent.width != UINT32_MAX) {
+        return capabilities.currentExtent;
+    }
+
+    // The surface takes its size from the swapchain (e.g. on Wayland), so follow the window.
+    VkExtent2D extent = p_window.window_extent;
+    extent.width = std::clamp(extent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+    extent.height = std::clamp(extent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+    return extent;
+}
+
+bool Renderer::create_swapchain(WindowSurface &p_window) {
+    VkSurfaceCapabilitiesKHR capabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, p_window.surface, &capabilities);
+    p_window.swapchain_extent = choose_swapchain_extent(p_window);
+
+    // One image more than the minimum avoids waiting on the driver, unless latency matters more.
+    uint32_t image_count = settings.low_latency ? capabilities.minImageCount : std::max(capabilities.minImageCount + 1, 3u);
+    if (capabilities.maxImageCount > 0) {
+        image_count = std::min(image_count, capabilities.maxImageCount);
+    }
+
+    VkPresentModeKHR chosen_present_mode = choose_present_mode(p_window);
+    if (chosen_present_mode != p_window.present_mode || p_window.swapchain == VK_NULL_HANDLE) {
+        if (chosen_present_mode != settings.present_mode) {
+            print("Present mode %s is not supported, falling back to %s", present_mode_name(settings.present_mode), present_mode_name(chosen_present_mode));
+        }
+        print("Present mode: %s, %u swapchain images", present_mode_name(chosen_present_mode), image_count);
+    }
+    p_window.present_mode = chosen_present_mode;
+
     VkSwapchainCreateInfoKHR create_info = {};
     create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-    create_info.surface = surface;
-    create_info.minImageCount = 3;
-    create_info.imageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+    create_info.surface = p_window.surface;
+    create_info.minImageCount = image_count;
+    create_info.imageFormat = COLOR_FORMAT;
     create_info.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
-    create_info.imageExtent = VkExtent2D {VIEWPORT_WIDTH, VIEWPORT_HEIGHT};
+    create_info.imageExtent = p_window.swapchain_extent;
     create_info.imageArrayLayers = 1;
     create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-    create_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
-    create_info.oldSwapchain = VK_NULL_HANDLE;
+    create_info.presentMode = p_window.present_mode;
+    // Lets the driver hand resources over; the old swapchain stays valid for presents already queued.
+    create_info.oldSwapchain = p_window.swapchain;
     create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     create_info.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
     create_info.clipped = VK_TRUE;
 
-    return vkCreateSwapchainKHR(device, &create_info, nullptr, &swapchain) == VK_SUCCESS;
+    // The old swapchain is retired even if this fails, so never keep using it.
+    UniqueSwapchain new_swapchain;
+    VkResult result = vkCreateSwapchainKHR(device, &create_info, nullptr, new_swapchain.put(device));
+    deletion_queue.push(submit_count, std::move(p_window.swapchain));
+    p_window.swapchain = std::move(new_swapchain);
+    return result == VK_SUCCESS;
+}
+
+bool Renderer::create_offscreen_images(WindowSurface &p_window) {
+    // One target per frame slot, so a slot never has to wait for another slot's image.
+    p_window.swapchain_image_count = static_cast<uint32_t>(frames.size());
+    p_window.swapchain_images.assign(p_window.swapchain_image_count, VK_NULL_HANDLE);
+    p_window.offscreen_image_allocations.assign(p_window.swapchain_image_count, Allocation());
+
+    for (uint32_t i = 0; i < p_window.swapchain_image_count; i++) {
+        VkImageCreateInfo image_info = {};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = COLOR_FORMAT;
+        image_info.extent = {VIEWPORT_WIDTH, VIEWPORT_HEIGHT, 1};
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (!allocator.create_image(image_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, p_window.swapchain_images[i], p_window.offscreen_image_allocations[i])) {
+            return false;
+        }
+        DEBUG_NAME(device, VK_OBJECT_TYPE_IMAGE, p_window.swapchain_images[i], "offscreen image");
+    }
+
+    return true;
+}
+
+bool Renderer::create_readback_buffers() {
+    VkDeviceSize size = VkDeviceSize(VIEWPORT_WIDTH) * VIEWPORT_HEIGHT * 4;
+
+    for (FrameData &frame : frames) {
+        // Cached memory makes the CPU side of the readback much faster where it is available.
+        VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        VkMemoryPropertyFlags host_memory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        if (!allocator.create_buffer(size, usage, host_memory | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, AllocationStrategy::POOL, frame.readback_buffer, frame.readback_allocation)
+            && !allocator.create_buffer(size, usage, host_memory, AllocationStrategy::POOL, frame.readback_buffer, frame.readback_allocation)) {
+            return false;
+        }
+        DEBUG_NAME(device, VK_OBJECT_TYPE_BUFFER, frame.readback_buffer, "readback");
+    }
+
+    return true;
 }
 
-bool Renderer::create_image_views() {
-    vkGetSwapchainImagesKHR(device, swapchain, &swapchain_image_count, nullptr);
-    swapchain_images = new VkImage[swapchain_image_count];
-    vkGetSwapchainImagesKHR(device, swapchain, &swapchain_image_count, swapchain_images);
-    swapchain_image_views.resize(swapchain_image_count);
+bool Renderer::create_image_views(WindowSurface &p_window) {
+    if (!settings.headless) {
+        vkGetSwapchainImagesKHR(device, p_window.swapchain, &p_window.swapchain_image_count, nullptr);
+        p_window.swapchain_images.resize(p_window.swapchain_image_count);
+        vkGetSwapchainImagesKHR(device, p_window.swapchain, &p_window.swapchain_image_count, p_window.swapchain_images.data());
+        for (VkImage image : p_window.swapchain_images) {
+            DEBUG_NAME(device, VK_OBJECT_TYPE_IMAGE, image, "swapchain image");
+        }
+        // A present waits on the semaphore until its image is shown, which only the reacquisition of
+        // that image guarantees. So there is one per image, not per frame slot.
+        VkSemaphoreCreateInfo semaphore_info = {};
+        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        p_window.render_finished_semaphores.clear();
+        p_window.render_finished_semaphores.resize(p_window.swapchain_image_count);
+        for (UniqueSemaphore &semaphore : p_window.render_finished_semaphores) {
+            if (vkCreateSemaphore(device, &semaphore_info, nullptr, semaphore.put(device)) != VK_SUCCESS) {
+                return false;
+            }
+        }
+    }
+    p_window.swapchain_image_views.clear();
+    p_window.swapchain_image_views.resize(p_window.swapchain_image_count);
+    p_window.images_in_flight.assign(p_window.swapchain_image_count, VK_NULL_HANDLE);
 
-    for (size_t i = i; i < swapchain_image_count; i++) {
+    for (size_t i = 0; i < p_window.swapchain_image_count; i++) {
         VkImageViewCreateInfo create_info = {};
         create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        create_info.image = swapchain_images[i];
+        create_info.image = p_window.swapchain_images[i];
         create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        create_info.format = VK_FORMAT_B8G8R8A8_SRGB;
+        create_info.format = COLOR_FORMAT;
         create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
         create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
         create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -121,7 +527,7 @@ bool Renderer::create_image_views() {
         create_info.subresourceRange.baseArrayLayer = 0;
         create_info.subresourceRange.layerCount = 1;
 
-        if (vkCreateImageView(device, &create_info, nullptr, &swapchain_image_views[i]) != VK_SUCCESS) {
+        if (vkCreateImageView(device, &create_info, nullptr, p_window.swapchain_image_views[i].put(device)) != VK_SUCCESS) {
             return false;
         }
     }
@@ -129,60 +535,151 @@ bool Renderer::create_image_views() {
     return true;
 }
 
-bool Renderer::create_render_pass() {
-    VkAttachmentDescription color_attachement = {};
-    color_attachement.format = VK_FORMAT_B8G8R8A8_SRGB;
-    color_attachement.samples = VK_SAMPLE_COUNT_1_BIT;
-    color_attachement.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    color_attachement.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    color_attachement.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    color_attachement.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    color_attachement.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachement.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    VkAttachmentReference color_attachement_reference = {};
-    color_attachement_reference.attachment = 0;
-    color_attachement_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkSubpassDependency dependency = {};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-    VkSubpassDescription subpass = {};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &color_attachement_reference;
-
-    VkRenderPassCreateInfo render_pass_info = {};
-    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    render_pass_info.attachmentCount = 1;
-    render_pass_info.pAttachments = &color_attachement;
-    render_pass_info.subpassCount = 1;
-    render_pass_info.pSubpasses = &subpass;
-    render_pass_info.dependencyCount = 1;
-    render_pass_info.pDependencies = &dependency;
-
-    return vkCreateRenderPass(device, &render_pass_info, nullptr, &render_pass) == VK_SUCCESS;
-}
-
-
-bool Renderer::create_shader_module(const uint32_t bytes[], const size_t length, VkShaderModule &r_shader_module) {
+bool Renderer::create_parked_image(WindowSurface &p_window) {
+    VkImageCreateInfo image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = COLOR_FORMAT;
+    image_info.extent = {1, 1, 1};
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    if (!allocator.create_image(image_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, p_window.parked_image, p_window.parked_allocation)) {
+        return false;
+    }
+    DEBUG_NAME(device, VK_OBJECT_TYPE_IMAGE, p_window.parked_image, "parked image");
+
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = p_window.parked_image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = COLOR_FORMAT;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.layerCount = 1;
+
+    return vkCreateImageView(device, &view_info, nullptr, p_window.parked_image_view.put(device)) == VK_SUCCESS;
+}
+
+bool Renderer::create_shader_module(const uint32_t bytes[], const size_t length, UniqueShaderModule &r_shader_module) {
     VkShaderModuleCreateInfo create_info = {};
     create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     create_info.codeSize = length;
     create_info.pCode = bytes;
-    return vkCreateShaderModule(device, &create_info, nullptr, &r_shader_module) == VK_SUCCESS;
+    return vkCreateShaderModule(device, &create_info, nullptr, r_shader_module.put(device)) == VK_SUCCESS;
 }
 
 
-bool Renderer::create_pipeline() {
-    VkShaderModule shader_module;
+bool Renderer::read_pipeline_cache_file(std::vector<char> &r_data) {
+    std::ifstream file(settings.pipeline_cache_path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    size_t file_size = (size_t) file.tellg();
+    if (file_size < sizeof(VkPipelineCacheHeaderVersionOne)) {
+        return false;
+    }
+    r_data.resize(file_size);
+    file.seekg(0);
+    file.read(r_data.data(), file_size);
+
+    // A cache from another driver or GPU is useless at best, so only accept data this device wrote.
+    VkPipelineCacheHeaderVersionOne header;
+    memcpy(&header, r_data.data(), sizeof(header));
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    return header.headerSize >= sizeof(header)
+        && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && header.vendorID == properties.vendorID
+        && header.deviceID == properties.deviceID
+        && memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+
+bool Renderer::create_pipeline_cache(bool &r_warm) {
+    std::vector<char> data;
+    r_warm = !settings.pipeline_cache_path.empty() && read_pipeline_cache_file(data);
+    if (!r_warm) {
+        data.clear();
+    }
+
+    VkPipelineCacheCreateInfo create_info = {};
+    create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    create_info.initialDataSize = data.size();
+    create_info.pInitialData = data.data();
+
+    return vkCreatePipelineCache(device, &create_info, nullptr, pipeline_cache.put(device)) == VK_SUCCESS;
+}
 
-    if (!create_shader_module(triangle_spv, triangle_spv_sizeInBytes, shader_module)) {
+
+void Renderer::save_pipeline_cache() {
+    if (settings.pipeline_cache_path.empty() || pipeline_cache == VK_NULL_HANDLE) {
+        return;
+    }
+
+    // Another instance may have written the file since we loaded it; keep its pipelines too.
+    std::vector<char> disk_data;
+    if (read_pipeline_cache_file(disk_data)) {
+        VkPipelineCacheCreateInfo create_info = {};
+        create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        create_info.initialDataSize = disk_data.size();
+        create_info.pInitialData = disk_data.data();
+
+        UniquePipelineCache disk_cache;
+        if (vkCreatePipelineCache(device, &create_info, nullptr, disk_cache.put(device)) == VK_SUCCESS) {
+            vkMergePipelineCaches(device, pipeline_cache, 1, disk_cache.address());
+        }
+    }
+
+    size_t size {0};
+    if (vkGetPipelineCacheData(device, pipeline_cache, &size, nullptr) != VK_SUCCESS || size == 0) {
+        return;
+    }
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(device, pipeline_cache, &size, data.data()) != VK_SUCCESS) {
+        return;
+    }
+
+    // Write to a temporary file and rename it, so a crash never leaves a truncated cache behind.
+    std::string temporary_path = settings.pipeline_cache_path + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            print("Could not open file '%s'!", temporary_path.c_str());
+            return;
+        }
+        file.write(data.data(), size);
+        if (!file.good()) {
+            print("Could not write pipeline cache!");
+            return;
+        }
+    }
+    if (std::rename(temporary_path.c_str(), settings.pipeline_cache_path.c_str()) != 0) {
+        print("Could not replace pipeline cache '%s'!", settings.pipeline_cache_path.c_str());
+        std::remove(temporary_path.c_str());
+    }
+}
+
+
+bool Renderer::create_graphics_pipeline(const uint32_t p_code[], const size_t p_code_size, const ShaderReflection &p_reflection, VkPipelineLayout p_layout,
+    const GraphicsPipelineState &p_state, UniquePipeline &r_pipeline) {
+    const ShaderEntryPoint* vertex_entry_point = p_reflection.find_entry_point(VK_SHADER_STAGE_VERTEX_BIT);
+    const ShaderEntryPoint* fragment_entry_point = p_reflection.find_entry_point(VK_SHADER_STAGE_FRAGMENT_BIT);
+    if (vertex_entry_point == nullptr || fragment_entry_point == nullptr) {
+        print("'%s' needs a vertex and a fragment entry point!", p_reflection.name);
+        return false;
+    }
+    UniqueShaderModule shader_module;
+
+    if (!create_shader_module(p_code, p_code_size, shader_module)) {
         print("Could not create shader modules!");
         return false;
     }
@@ -191,26 +688,82 @@ bool Renderer::create_pipeline() {
     vert_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
     vert_shader_stage_info.module = shader_module;
-    vert_shader_stage_info.pName = "vertex";
+    vert_shader_stage_info.pName = vertex_entry_point->name;
 
     VkPipelineShaderStageCreateInfo frag_shader_stage_info {};
     frag_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
     frag_shader_stage_info.module = shader_module;
-    frag_shader_stage_info.pName = "fragment";
+    frag_shader_stage_info.pName = fragment_entry_point->name;
+
+    // Both stages see the same constants; a stage that does not declare one ignores its entry.
+    VkSpecializationMapEntry specialization_entries[MAX_SPECIALIZATION_CONSTANTS];
+    VkSpecializationInfo specialization_info = {};
+    vert_shader_stage_info.pSpecializationInfo = p_state.specialization.get_info(specialization_entries, specialization_info);
+    frag_shader_stage_info.pSpecializationInfo = vert_shader_stage_info.pSpecializationInfo;
 
     VkPipelineShaderStageCreateInfo shader_stages[] = {vert_shader_stage_info, frag_shader_stage_info};
 
+    VkVertexInputBindingDescription binding_description = {};
+    binding_description.binding = 0;
+    binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    VkVertexInputAttributeDescription attribute_descriptions[3] = {};
+    uint32_t attribute_count {2};
+    attribute_descriptions[0].location = 0;
+    attribute_descriptions[0].binding = 0;
+    attribute_descriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+    attribute_descriptions[1].location = 1;
+    attribute_descriptions[1].binding = 0;
+    if (p_state.vertex_layout == VertexLayout::MESH_VERTEX) {
+        // Quantized by tools/meshconv; the vertex input unpacks them for free.
+        binding_description.stride = sizeof(MeshVertex);
+        attribute_descriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+        attribute_descriptions[0].offset = offsetof(MeshVertex, position);
+        attribute_descriptions[1].format = VK_FORMAT_R8G8B8A8_SNORM;
+        attribute_descriptions[1].offset = offsetof(MeshVertex, normal);
+        attribute_descriptions[2].location = 2;
+        attribute_descriptions[2].binding = 0;
+        attribute_descriptions[2].format = VK_FORMAT_R16G16_SFLOAT;
+        attribute_descriptions[2].offset = offsetof(MeshVertex, uv);
+        attribute_count = 3;
+    } else if (p_state.vertex_layout == VertexLayout::BATCH_VERTEX) {
+        binding_description.stride = sizeof(BatchVertex);
+        attribute_descriptions[0].offset = offsetof(BatchVertex, position);
+        attribute_descriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+        attribute_descriptions[1].offset = offsetof(BatchVertex, color);
+    } else {
+        binding_description.stride = sizeof(Vertex);
+        attribute_descriptions[0].offset = offsetof(Vertex, position);
+        attribute_descriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attribute_descriptions[1].offset = offsetof(Vertex, color);
+    }
+
+    // The buffers store quantized formats, so only check that every input the shader reads is fed.
+    for (uint32_t i = 0; i < p_reflection.vertex_input_count; i++) {
+        const ShaderVertexInput &input = p_reflection.vertex_inputs[i];
+        bool provided = false;
+        for (uint32_t j = 0; j < attribute_count && p_state.vertex_layout != VertexLayout::NONE; j++) {
+            provided = provided || attribute_descriptions[j].location == input.location;
+        }
+        if (!provided) {
+            print("'%s' reads vertex input '%s' at location %u, which its vertex layout does not provide!", p_reflection.name, input.name, input.location);
+            return false;
+        }
+    }
+
     VkPipelineVertexInputStateCreateInfo vertex_input_info = {};
     vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertex_input_info.vertexBindingDescriptionCount = 0;
-    vertex_input_info.pVertexBindingDescriptions = nullptr;
-    vertex_input_info.pVertexBindingDescriptions = 0;
-    vertex_input_info.pVertexAttributeDescriptions = nullptr;
+    if (p_state.vertex_layout != VertexLayout::NONE) {
+        vertex_input_info.vertexBindingDescriptionCount = 1;
+        vertex_input_info.pVertexBindingDescriptions = &binding_description;
+        vertex_input_info.vertexAttributeDescriptionCount = attribute_count;
+        vertex_input_info.pVertexAttributeDescriptions = attribute_descriptions;
+    }
 
     VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
     input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    input_assembly.topology = p_state.topology;
     input_assembly.primitiveRestartEnable = VK_FALSE;
 
     VkViewport viewport = {};
@@ -246,8 +799,8 @@ bool Renderer::create_pipeline() {
     rasterizer.depthClampEnable = VK_FALSE;
     rasterizer.rasterizerDiscardEnable = VK_FALSE;
     rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    rasterizer.cullMode = p_state.cull_mode;
+    rasterizer.frontFace = p_state.front_face;
     rasterizer.depthBiasEnable = VK_FALSE;
     rasterizer.depthBiasConstantFactor = 0.0f;
     rasterizer.depthBiasClamp = 0.0f;
@@ -263,10 +816,25 @@ bool Renderer::create_pipeline() {
     multisampling.alphaToCoverageEnable = VK_FALSE;
     multisampling.alphaToOneEnable;
 
+    VkPipelineDepthStencilStateCreateInfo depth_stencil = {};
+    depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil.depthTestEnable = VK_TRUE;
+    depth_stencil.depthWriteEnable = VK_TRUE;
+    depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
     VkPipelineColorBlendAttachmentState color_blend_attachment = {};
     color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
     color_blend_attachment.blendEnable = VK_FALSE;
     color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    if (p_state.alpha_blend) {
+        color_blend_attachment.blendEnable = VK_TRUE;
+        color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+        color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    }
 
     VkPipelineColorBlendStateCreateInfo color_blending = {};
     color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
@@ -274,17 +842,17 @@ bool Renderer::create_pipeline() {
     color_blending.attachmentCount = 1;
     color_blending.pAttachments = &color_blend_attachment;
 
-    VkPipelineLayoutCreateInfo pipeline_layout_info = {};
-    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipeline_layout_info.setLayoutCount = 0;
-
-    if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &pipeline_layout) != VK_SUCCESS) {
-        print("Could not create pipeline layout!");
-        return false;
-    }
+    // Dynamic rendering: the pipeline only needs the attachment formats, not a render pass object.
+    VkFormat color_format = p_state.color_format;
+    VkPipelineRenderingCreateInfo rendering_info = {};
+    rendering_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    rendering_info.colorAttachmentCount = 1;
+    rendering_info.pColorAttachmentFormats = &color_format;
+    rendering_info.depthAttachmentFormat = p_state.depth_format;
 
     VkGraphicsPipelineCreateInfo pipeline_info = {};
     pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.pNext = &rendering_info;
     pipeline_info.stageCount = 2;
     pipeline_info.pStages = shader_stages;
     pipeline_info.pVertexInputState = &vertex_input_info;
@@ -292,115 +860,1273 @@ bool Renderer::create_pipeline() {
     pipeline_info.pViewportState = &viewport_state;
     pipeline_info.pRasterizationState = &rasterizer;
     pipeline_info.pMultisampleState = &multisampling;
-    pipeline_info.pDepthStencilState = nullptr;
+    pipeline_info.pDepthStencilState = p_state.depth_format != VK_FORMAT_UNDEFINED ? &depth_stencil : nullptr;
     pipeline_info.pColorBlendState = &color_blending;
     pipeline_info.pDynamicState = &dynamic_state;
-    pipeline_info.layout = pipeline_layout;
-    pipeline_info.renderPass = render_pass;
-    pipeline_info.subpass = 0;
+    pipeline_info.layout = p_layout;
+    pipeline_info.renderPass = VK_NULL_HANDLE;
     pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
     pipeline_info.basePipelineIndex = -1;
 
-    if (!vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline) == VK_SUCCESS) {
+    if (vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipeline_info, nullptr, r_pipeline.put(device)) != VK_SUCCESS) {
         print("Could not create graphics pipeline!");
         return false;
     }
 
-    vkDestroyShaderModule(device, shader_module, nullptr);
+    return true;
+}
+
+
+bool Renderer::create_compute_pipeline(const uint32_t p_code[], const size_t p_code_size, const ShaderReflection &p_reflection, VkPipelineLayout p_layout,
+    const SpecializationValues &p_specialization, UniquePipeline &r_pipeline) {
+    const ShaderEntryPoint* entry_point = p_reflection.find_entry_point(VK_SHADER_STAGE_COMPUTE_BIT);
+    if (entry_point == nullptr) {
+        print("'%s' has no compute entry point!", p_reflection.name);
+        return false;
+    }
+    UniqueShaderModule shader_module;
+
+    if (!create_shader_module(p_code, p_code_size, shader_module)) {
+        print("Could not create shader modules!");
+        return false;
+    }
+
+    VkComputePipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader_module;
+    pipeline_info.stage.pName = entry_point->name;
+    VkSpecializationMapEntry specialization_entries[MAX_SPECIALIZATION_CONSTANTS];
+    VkSpecializationInfo specialization_info = {};
+    pipeline_info.stage.pSpecializationInfo = p_specialization.get_info(specialization_entries, specialization_info);
+    pipeline_info.layout = p_layout;
+    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_info.basePipelineIndex = -1;
+
+    if (vkCreateComputePipelines(device, pipeline_cache, 1, &pipeline_info, nullptr, r_pipeline.put(device)) != VK_SUCCESS) {
+        print("Could not create compute pipeline!");
+        return false;
+    }
 
     return true;
 }
 
 
-bool Renderer::create_framebuffers() {
-    framebuffers.resize(swapchain_image_views.size());
+bool Renderer::create_descriptors() {
+    // Every window records the draw list, each draw with its own block.
+    VkDeviceSize uniform_capacity = UNIFORM_RING_SIZE + draw_list.size() * windows.size() * MAX_UNIFORM_BLOCK_SIZE;
+    if (!uniform_ring.initialize(physical_device, device, allocator, uniform_capacity, settings.frames_in_flight)) {
+        print("Could not create uniform ring!");
+        return false;
+    }
+    if (!bindless_set.initialize(device, BINDLESS_TEXTURE_COUNT, BINDLESS_SAMPLER_COUNT, BINDLESS_STORAGE_BUFFER_COUNT)) {
+        print("Could not create bindless descriptor set!");
+        return false;
+    }
+    if (settings.texture_paths.empty()) {
+        return true;
+    }
+    if (!texture_streamer.initialize(physical_device, device, allocator, bindless_set, TEXTURE_STAGING_SIZE, settings.texture_budget)) {
+        print("Could not create texture streamer!");
+        return false;
+    }
+    for (const std::string &path : settings.texture_paths) {
+        textures.push_back(texture_streamer.load(path));
+    }
+    texture_indices.assign(textures.size(), BINDLESS_INVALID_INDEX);
+    return true;
+}
 
-    for (size_t i = 0; i < swapchain_image_views.size(); i++) {
-        VkImageView attachments[] = {
-            swapchain_image_views[i]
-        };
 
-        VkFramebufferCreateInfo framebuffer_info = {};
-        framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebuffer_info.renderPass = render_pass;
-        framebuffer_info.attachmentCount = 1;
-        framebuffer_info.pAttachments = attachments;
-        framebuffer_info.width = VIEWPORT_WIDTH;
-        framebuffer_info.height = VIEWPORT_HEIGHT;
-        framebuffer_info.layers = 1;
+bool Renderer::create_pipeline() {
+    // Set 0 is the bindless set, set 1 the uniform ring; see shaders/src/triangle.slang.
+    if (!pipeline_layout.create(device, triangle_reflection, 0, {bindless_set.get_set_layout(), uniform_ring.get_set_layout()})) {
+        print("Could not create pipeline layout!");
+        return false;
+    }
+
+    pipeline_key.shader = pipeline_library.add_shader(triangle_spv, triangle_spv_sizeInBytes, triangle_reflection);
+    pipeline_key.layout = pipeline_library.add_layout(pipeline_layout);
+    pipeline_key.state.vertex_layout = VertexLayout::VERTEX;
+    // Without textures the fragment shader compiles without the sampling branch.
+    pipeline_key.state.specialization.set(triangle_reflection, "TEXTURED", textures.empty() ? 0 : 1);
+    return true;
+}
+
+
+std::vector<PipelineKey> Renderer::get_known_pipelines() const {
+    std::vector<PipelineKey> keys = {batch_pipeline_key, batch_line_pipeline_key};
+    if (!draw_list.empty()) {
+        keys.push_back(pipeline_key);
+    }
+    if (settings.instance_count > 0) {
+        keys.push_back(instance_pipeline_key);
+    }
+    if (settings.particle_count > 0) {
+        keys.push_back(particle_pipeline_key);
+    }
+    if (mesh_header != nullptr) {
+        keys.push_back(mesh_pipeline_key);
+    }
+    return keys;
+}
+
+
+bool Renderer::start_pipeline_library() {
+    uint32_t thread_count = settings.pipeline_threads > 0 ? settings.pipeline_threads : std::max(1u, std::thread::hardware_concurrency() / 2);
+    // Compiles run on the library's threads; the pipeline cache synchronizes itself.
+    pipeline_library.start(thread_count, [this](const GraphicsPipelineState &p_state, const ShaderReflection &p_reflection, const uint32_t* p_code,
+        size_t p_code_size, VkPipelineLayout p_layout, UniquePipeline &r_pipeline) {
+        return create_graphics_pipeline(p_code, p_code_size, p_reflection, p_layout, p_state, r_pipeline);
+    });
+    if (!settings.prewarm_pipelines) {
+        return true;
+    }
 
-        if (vkCreateFramebuffer(device, &framebuffer_info, nullptr, &framebuffers[i]) != VK_SUCCESS) {
+    std::vector<PipelineKey> keys = get_known_pipelines();
+    pipeline_library.prewarm(keys);
+    pipeline_library.wait_idle();
+    for (const PipelineKey &key : keys) {
+        if (pipeline_library.get(key) == VK_NULL_HANDLE) {
             return false;
         }
     }
-
     return true;
 }
 
 
+void Renderer::resolve_pipelines() {
+    pipeline = draw_list.empty() ? VK_NULL_HANDLE : pipeline_library.get(pipeline_key);
+    instance_pipeline = settings.instance_count > 0 ? pipeline_library.get(instance_pipeline_key) : VK_NULL_HANDLE;
+    particle_pipeline = settings.particle_count > 0 ? pipeline_library.get(particle_pipeline_key) : VK_NULL_HANDLE;
+    mesh_pipeline = mesh_header != nullptr ? pipeline_library.get(mesh_pipeline_key) : VK_NULL_HANDLE;
+    batch_pipeline = pipeline_library.get(batch_pipeline_key);
+    batch_line_pipeline = pipeline_library.get(batch_line_pipeline_key);
+}
+
+
 bool Renderer::create_command_pool() {
     VkCommandPoolCreateInfo pool_info = {};
     pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    pool_info.queueFamilyIndex = 0;
+    pool_info.queueFamilyIndex = queue_family_index;
+
+    if (vkCreateCommandPool(device, &pool_info, nullptr, command_pool.put(device)) != VK_SUCCESS) {
+        return false;
+    }
 
-    return vkCreateCommandPool(device, &pool_info, nullptr, &command_pool) == VK_SUCCESS;
+    if (has_transfer_queue()) {
+        pool_info.queueFamilyIndex = transfer_queue_family_index;
+        if (vkCreateCommandPool(device, &pool_info, nullptr, transfer_command_pool.put(device)) != VK_SUCCESS) {
+            return false;
+        }
+    }
+    if (has_compute_queue()) {
+        pool_info.queueFamilyIndex = compute_queue_family_index;
+        if (vkCreateCommandPool(device, &pool_info, nullptr, compute_command_pool.put(device)) != VK_SUCCESS) {
+            return false;
+        }
+    }
+
+    return true;
 }
 
 
-bool Renderer::create_command_buffer() {
+bool Renderer::create_command_buffers() {
+    std::vector<VkCommandBuffer> command_buffers(frames.size());
+
     VkCommandBufferAllocateInfo alloc_info = {};
     alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     alloc_info.commandPool = command_pool;
     alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = static_cast<uint32_t>(command_buffers.size());
+
+    if (vkAllocateCommandBuffers(device, &alloc_info, command_buffers.data()) != VK_SUCCESS) {
+        return false;
+    }
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        frames[i].command_buffer = command_buffers[i];
+        DEBUG_NAME(device, VK_OBJECT_TYPE_COMMAND_BUFFER, command_buffers[i], "frame");
+    }
+
     alloc_info.commandBufferCount = 1;
+    for (FrameData &frame : frames) {
+        if (transfer_command_pool != VK_NULL_HANDLE) {
+            alloc_info.commandPool = transfer_command_pool;
+            if (vkAllocateCommandBuffers(device, &alloc_info, &frame.transfer_command_buffer) != VK_SUCCESS) {
+                return false;
+            }
+            DEBUG_NAME(device, VK_OBJECT_TYPE_COMMAND_BUFFER, frame.transfer_command_buffer, "transfer");
+        }
+        if (compute_command_pool != VK_NULL_HANDLE) {
+            alloc_info.commandPool = compute_command_pool;
+            if (vkAllocateCommandBuffers(device, &alloc_info, &frame.compute_command_buffer) != VK_SUCCESS) {
+                return false;
+            }
+            DEBUG_NAME(device, VK_OBJECT_TYPE_COMMAND_BUFFER, frame.compute_command_buffer, "async compute");
+        }
+    }
 
-    return vkAllocateCommandBuffers(device, &alloc_info, &command_buffer) == VK_SUCCESS;
+    return true;
 }
 
 
-void Renderer::record_command_buffer(VkCommandBuffer p_command_buffer, uint32_t p_image_index) {
+bool Renderer::submit_uploads(FrameData &p_frame) {
+    if (!has_transfer_queue() || !staging_ring.has_pending_copies()) {
+        return false;
+    }
+
     VkCommandBufferBeginInfo begin_info = {};
     begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    begin_info.flags = 0;
-    begin_info.pInheritanceInfo = nullptr;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-    if (vkBeginCommandBuffer(p_command_buffer, &begin_info) != VK_SUCCESS) {
-        print("Could not begin command buffer!");
-    }
+    vkResetCommandBuffer(p_frame.transfer_command_buffer, 0);
+    vkBeginCommandBuffer(p_frame.transfer_command_buffer, &begin_info);
+    staging_ring.flush_release(p_frame.transfer_command_buffer, current_frame, transfer_queue_family_index, queue_family_index);
+    vkEndCommandBuffer(p_frame.transfer_command_buffer);
 
-    VkRenderPassBeginInfo render_pass_info = {};
-    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    render_pass_info.renderPass = render_pass;
-    render_pass_info.framebuffer = framebuffers[p_image_index];
-    render_pass_info.renderArea.offset = {0, 0};
-    render_pass_info.renderArea.extent.width = VIEWPORT_WIDTH;
-    render_pass_info.renderArea.extent.height = VIEWPORT_HEIGHT;
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &p_frame.transfer_command_buffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = p_frame.transfer_finished_semaphore.address();
 
-    VkClearValue clear_color = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-    render_pass_info.clearValueCount = 1;
-    render_pass_info.pClearValues = &clear_color;
+    // No fence: the graphics submit of this frame waits for it, directly or through the compute queue.
+    return vkQueueSubmit(transfer_queue, 1, &submit_info, VK_NULL_HANDLE) == VK_SUCCESS;
+}
 
-    vkCmdBeginRenderPass(p_command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(p_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
-    VkViewport viewport = {};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = static_cast<float>(VIEWPORT_WIDTH);
-    viewport.height = static_cast<float>(VIEWPORT_HEIGHT);
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
+bool Renderer::submit_culling(FrameData &p_frame, bool p_wait_for_uploads) {
+    if (!has_compute_queue() || settings.instance_count == 0 || !settings.gpu_culling) {
+        return false;
+    }
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkResetCommandBuffer(p_frame.compute_command_buffer, 0);
+    vkBeginCommandBuffer(p_frame.compute_command_buffer, &begin_info);
+    record_instance_culling(p_frame.compute_command_buffer);
+    vkEndCommandBuffer(p_frame.compute_command_buffer);
+
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.waitSemaphoreCount = p_wait_for_uploads ? 1 : 0;
+    submit_info.pWaitSemaphores = p_frame.transfer_finished_semaphore.address();
+    submit_info.pWaitDstStageMask = &wait_stage;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &p_frame.compute_command_buffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = p_frame.compute_finished_semaphore.address();
+
+    return vkQueueSubmit(compute_queue, 1, &submit_info, VK_NULL_HANDLE) == VK_SUCCESS;
+}
+
+
+bool Renderer::upload_buffer(VkBuffer p_buffer, const void* p_data, VkDeviceSize p_size, bool p_concurrent) {
+    // Usually the copy is batched with the other uploads at the start of the next frame.
+    if (staging_ring.upload(p_buffer, 0, p_data, p_size, p_concurrent)) {
+        return true;
+    }
+
+    // Too large for the ring: use a one-off staging buffer and wait for the copy. This stays on
+    // the graphics queue, so exclusive buffers are owned by the family that will use them.
+    VkBuffer staging_buffer;
+    Allocation staging_allocation;
+    VkMemoryPropertyFlags host_memory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if (!allocator.create_buffer(p_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, host_memory, AllocationStrategy::POOL, staging_buffer, staging_allocation)) {
+        return false;
+    }
+    memcpy(staging_allocation.mapped, p_data, p_size);
+
+    VkCommandBufferAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = command_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+
+    VkCommandBuffer command_buffer;
+    bool success = vkAllocateCommandBuffers(device, &alloc_info, &command_buffer) == VK_SUCCESS;
+    if (success) {
+        VkCommandBufferBeginInfo begin_info = {};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(command_buffer, &begin_info);
+
+        VkBufferCopy region = {};
+        region.size = p_size;
+        vkCmdCopyBuffer(command_buffer, staging_buffer, p_buffer, 1, &region);
+        vkEndCommandBuffer(command_buffer);
+
+        VkSubmitInfo submit_info = {};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &command_buffer;
+
+        success = vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE) == VK_SUCCESS
+            && vkQueueWaitIdle(queue) == VK_SUCCESS;
+        vkFreeCommandBuffers(device, command_pool, 1, &command_buffer);
+    }
+
+    allocator.destroy_buffer(staging_buffer, staging_allocation);
+    return success;
+}
+
+
+bool Renderer::create_geometry_buffers() {
+    static const Vertex triangle_vertices[3] = {
+        {{0.0f, -0.5f}, {1.0f, 0.0f, 0.0f}},
+        {{0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}},
+        {{-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}}
+    };
+    static const uint16_t triangle_indices[3] = {0, 1, 2};
+
+    // Static geometry is never freed on its own, so it can be bump-allocated.
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    if (!allocator.create_buffer(sizeof(triangle_vertices), usage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationStrategy::LINEAR, vertex_buffer, vertex_allocation)
+        || !allocator.create_buffer(sizeof(triangle_indices), usage | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationStrategy::LINEAR, index_buffer, index_allocation)) {
+        return false;
+    }
+    DEBUG_NAME(device, VK_OBJECT_TYPE_BUFFER, vertex_buffer, "triangle vertices");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_BUFFER, index_buffer, "triangle indices");
+
+    return upload_buffer(vertex_buffer, triangle_vertices, sizeof(triangle_vertices))
+        && upload_buffer(index_buffer, triangle_indices, sizeof(triangle_indices));
+}
+
+
+bool Renderer::create_instance_buffers() {
+    uint32_t count = settings.instance_count;
+
+    // Fixed seed, so every run renders the same scene and images can be compared.
+    std::vector<InstanceData> instances(count);
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-1.2f, 1.2f);
+    std::uniform_real_distribution<float> scale(0.01f, 0.04f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (InstanceData &instance : instances) {
+        instance.offset[0] = position(random);
+        instance.offset[1] = position(random);
+        instance.scale = scale(random);
+        instance.rotation = unit(random) * 6.2831853f;
+        instance.color[0] = unit(random);
+        instance.color[1] = unit(random);
+        instance.color[2] = unit(random);
+        instance.color[3] = 1.0f;
+    }
+
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    VkMemoryPropertyFlags device_memory = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    // The instances are read by culling and drawing, which may run on different queue families.
+    std::vector<uint32_t> queue_families = get_queue_families();
+    if (!allocator.create_buffer(count * sizeof(InstanceData), usage, device_memory, AllocationStrategy::POOL, queue_families, instance_buffer, instance_allocation)
+        || !upload_buffer(instance_buffer, instances.data(), count * sizeof(InstanceData), queue_families.size() > 1)) {
+        return false;
+    }
+    DEBUG_NAME(device, VK_OBJECT_TYPE_BUFFER, instance_buffer, "instances");
+
+    // Without the compute pass every instance is drawn, in order.
+    std::vector<uint32_t> visible_instances;
+    VkDrawIndirectCommand draw_command = {3, count, 0, 0};
+    if (!settings.gpu_culling) {
+        visible_instances.resize(count);
+        std::iota(visible_instances.begin(), visible_instances.end(), 0u);
+    }
+
+    for (FrameData &frame : frames) {
+        if (!allocator.create_buffer(count * sizeof(uint32_t), usage, device_memory, AllocationStrategy::POOL, frame.visible_instance_buffer, frame.visible_instance_allocation)
+            || !allocator.create_buffer(sizeof(VkDrawIndirectCommand), usage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, device_memory, AllocationStrategy::POOL, frame.indirect_buffer, frame.indirect_allocation)) {
+            return false;
+        }
+        DEBUG_NAME(device, VK_OBJECT_TYPE_BUFFER, frame.visible_instance_buffer, "visible instances");
+        DEBUG_NAME(device, VK_OBJECT_TYPE_BUFFER, frame.indirect_buffer, "indirect");
+        if (!settings.gpu_culling) {
+            if (!upload_buffer(frame.visible_instance_buffer, visible_instances.data(), count * sizeof(uint32_t))
+                || !upload_buffer(frame.indirect_buffer, &draw_command, sizeof(draw_command))) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+bool Renderer::create_instance_descriptors() {
+    // Set 0 holds the instances, the visible instances and the indirect command, as declared by the shader.
+    if (!instance_pipeline_layout.create(device, instanced_reflection, sizeof(InstancePushConstants))) {
+        print("Could not create pipeline layout!");
+        return false;
+    }
+    VkDescriptorSetLayout instance_set_layout = instance_pipeline_layout.get_set_layout(0);
+
+    VkDescriptorPoolSize pool_size = {};
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_size.descriptorCount = 3 * static_cast<uint32_t>(frames.size());
+
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = static_cast<uint32_t>(frames.size());
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+
+    if (vkCreateDescriptorPool(device, &pool_info, nullptr, instance_descriptor_pool.put(device)) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = instance_descriptor_pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &instance_set_layout;
+
+    for (FrameData &frame : frames) {
+        if (vkAllocateDescriptorSets(device, &alloc_info, &frame.instance_descriptor_set) != VK_SUCCESS) {
+            return false;
+        }
+
+        VkDescriptorBufferInfo buffer_infos[3] = {
+            {instance_buffer, 0, VK_WHOLE_SIZE},
+            {frame.visible_instance_buffer, 0, VK_WHOLE_SIZE},
+            {frame.indirect_buffer, 0, VK_WHOLE_SIZE}
+        };
+        VkWriteDescriptorSet writes[3] = {};
+        for (uint32_t i = 0; i < 3; i++) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = frame.instance_descriptor_set;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &buffer_infos[i];
+        }
+        vkUpdateDescriptorSets(device, 3, writes, 0, nullptr);
+    }
+
+    return true;
+}
+
+
+bool Renderer::create_instance_pipelines() {
+    instance_pipeline_key.shader = pipeline_library.add_shader(instanced_spv, instanced_spv_sizeInBytes, instanced_reflection);
+    instance_pipeline_key.layout = pipeline_library.add_layout(instance_pipeline_layout);
+
+    return !settings.gpu_culling || create_compute_pipeline(instanced_spv, instanced_spv_sizeInBytes, instanced_reflection, instance_pipeline_layout, {}, cull_pipeline);
+}
+
+
+void Renderer::record_instance_culling(VkCommandBuffer p_command_buffer) {
+    // Every slot culls into its own buffers, and the fence of this slot has signalled, so nothing
+    // reads them anymore. Their old contents are discarded, which also makes an ownership
+    // transfer back to the compute family unnecessary.
+    const FrameData &frame = frames[current_frame];
+    VkDrawIndirectCommand reset_command = {3, 0, 0, 0};
+    vkCmdUpdateBuffer(p_command_buffer, frame.indirect_buffer, 0, sizeof(reset_command), &reset_command);
+
+    VkMemoryBarrier2 barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+    VkDependencyInfo dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.memoryBarrierCount = 1;
+    dependency_info.pMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(p_command_buffer, &dependency_info);
+
+    vkCmdBindPipeline(p_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline);
+    vkCmdBindDescriptorSets(p_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, instance_pipeline_layout, 0, 1, &frame.instance_descriptor_set, 0, nullptr);
+    vkCmdPushConstants(p_command_buffer, instance_pipeline_layout, instance_pipeline_layout.get_push_constant_stages(), 0, sizeof(instance_push_constants), &instance_push_constants);
+    uint32_t group_size = instanced_reflection.find_entry_point(VK_SHADER_STAGE_COMPUTE_BIT)->local_size[0];
+    vkCmdDispatch(p_command_buffer, (settings.instance_count + group_size - 1) / group_size, 1, 1);
+
+    // On the graphics queue the render graph places the barrier towards the indirect draw.
+    if (has_compute_queue()) {
+        record_culling_ownership(p_command_buffer, true);
+    }
+}
+
+
+void Renderer::record_culling_ownership(VkCommandBuffer p_command_buffer, bool p_release) {
+    // The culling output is exclusive to one family at a time. The async compute queue releases
+    // it after the dispatch, and the graphics queue acquires it before the indirect draw.
+    const FrameData &frame = frames[current_frame];
+    VkBuffer buffers[2] = {frame.visible_instance_buffer, frame.indirect_buffer};
+    VkBufferMemoryBarrier2 barriers[2] = {};
+    for (uint32_t i = 0; i < 2; i++) {
+        // Each half of the transfer ignores the other queue's scope.
+        barriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        barriers[i].srcStageMask = p_release ? VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_2_NONE;
+        barriers[i].srcAccessMask = p_release ? VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT : VK_ACCESS_2_NONE;
+        barriers[i].dstStageMask = p_release ? VK_PIPELINE_STAGE_2_NONE : VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT;
+        barriers[i].dstAccessMask = p_release ? VK_ACCESS_2_NONE : VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+        barriers[i].srcQueueFamilyIndex = compute_queue_family_index;
+        barriers[i].dstQueueFamilyIndex = queue_family_index;
+        barriers[i].buffer = buffers[i];
+        barriers[i].offset = 0;
+        barriers[i].size = VK_WHOLE_SIZE;
+    }
+
+    VkDependencyInfo dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.bufferMemoryBarrierCount = 2;
+    dependency_info.pBufferMemoryBarriers = barriers;
+    vkCmdPipelineBarrier2(p_command_buffer, &dependency_info);
+}
+
+
+void Renderer::record_instanced_draw(VkCommandBuffer p_command_buffer) {
+    if (instance_pipeline == VK_NULL_HANDLE) {
+        return;
+    }
+    // One indirect draw for the whole scene; the instance count comes from the culling pass.
+    vkCmdBindPipeline(p_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, instance_pipeline);
+    const FrameData &frame = frames[current_frame];
+    vkCmdBindDescriptorSets(p_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, instance_pipeline_layout, 0, 1, &frame.instance_descriptor_set, 0, nullptr);
+    vkCmdPushConstants(p_command_buffer, instance_pipeline_layout, instance_pipeline_layout.get_push_constant_stages(), 0, sizeof(instance_push_constants), &instance_push_constants);
+    vkCmdDrawIndirect(p_command_buffer, frame.indirect_buffer, 0, 1, sizeof(VkDrawIndirectCommand));
+}
+
+
+bool Renderer::create_particles() {
+    // Never uploaded: the first dispatch seeds the particles on the GPU.
+    VkDeviceSize size = VkDeviceSize(settings.particle_count) * 16;
+    if (!allocator.create_buffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationStrategy::POOL, particle_buffer, particle_allocation)) {
+        return false;
+    }
+    DEBUG_NAME(device, VK_OBJECT_TYPE_BUFFER, particle_buffer, "particles");
+    particle_push_constants.buffer_index = bindless_set.add_storage_buffer(particle_buffer, 0, size);
+    particle_push_constants.count = settings.particle_count;
+    if (particle_push_constants.buffer_index == BINDLESS_INVALID_INDEX) {
+        return false;
+    }
+
+    if (!particle_pipeline_layout.create(device, particles_reflection, sizeof(ParticlePushConstants), {bindless_set.get_set_layout()})) {
+        print("Could not create pipeline layout!");
+        return false;
+    }
+
+    // Small translucent quads, so overlapping particles add up.
+    particle_pipeline_key.shader = pipeline_library.add_shader(particles_spv, particles_spv_sizeInBytes, particles_reflection);
+    particle_pipeline_key.layout = pipeline_library.add_layout(particle_pipeline_layout);
+    particle_pipeline_key.state.cull_mode = VK_CULL_MODE_NONE;
+    particle_pipeline_key.state.alpha_blend = true;
+
+    // The substep loop is unrolled by the driver instead of reading its count every iteration.
+    if (!simulate_specialization.set(particles_reflection, "SUBSTEPS", std::max(settings.particle_substeps, 1u))) {
+        print("'%s' has no SUBSTEPS specialization constant!", particles_reflection.name);
+        return false;
+    }
+    return create_compute_pipeline(particles_spv, particles_spv_sizeInBytes, particles_reflection, particle_pipeline_layout, simulate_specialization, simulate_pipeline);
+}
+
+
+void Renderer::record_particle_simulation(VkCommandBuffer p_command_buffer) {
+    // The render graph orders the dispatch after last frame's draw and before this frame's.
+    VkDescriptorSet bindless_descriptor_set = bindless_set.get_set();
+    vkCmdBindPipeline(p_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, simulate_pipeline);
+    vkCmdBindDescriptorSets(p_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particle_pipeline_layout, 0, 1, &bindless_descriptor_set, 0, nullptr);
+    vkCmdPushConstants(p_command_buffer, particle_pipeline_layout, particle_pipeline_layout.get_push_constant_stages(), 0, sizeof(particle_push_constants), &particle_push_constants);
+    uint32_t group_size = particles_reflection.find_entry_point(VK_SHADER_STAGE_COMPUTE_BIT)->local_size[0];
+    vkCmdDispatch(p_command_buffer, (settings.particle_count + group_size - 1) / group_size, 1, 1);
+}
+
+
+void Renderer::record_particle_draw(VkCommandBuffer p_command_buffer) {
+    if (particle_pipeline == VK_NULL_HANDLE) {
+        return;
+    }
+    // No vertex buffer: the vertex shader reads the simulation output by SV_VertexID.
+    VkDescriptorSet bindless_descriptor_set = bindless_set.get_set();
+    vkCmdBindPipeline(p_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, particle_pipeline);
+    vkCmdBindDescriptorSets(p_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, particle_pipeline_layout, 0, 1, &bindless_descriptor_set, 0, nullptr);
+    vkCmdPushConstants(p_command_buffer, particle_pipeline_layout, particle_pipeline_layout.get_push_constant_stages(), 0, sizeof(particle_push_constants), &particle_push_constants);
+    vkCmdDraw(p_command_buffer, settings.particle_count * 6, 1, 0, 0);
+}
+
+
+bool Renderer::create_mesh() {
+    uint64_t start = SDL_GetTicksNS();
+    if (!mesh_file.open(settings.mesh_path)) {
+        print("Could not open file '%s'!", settings.mesh_path.c_str());
+        return false;
+    }
+
+    // The sections are uploaded as they are, after checking that the draws stay inside them.
+    if (mesh_file.get_size() < sizeof(MeshFileHeader)) {
+        print("'%s' is not a mesh written by meshconv!", settings.mesh_path.c_str());
+        return false;
+    }
+    const uint8_t* data = mesh_file.get_data();
+    const MeshFileHeader* header = reinterpret_cast<const MeshFileHeader*>(data);
+    uint64_t vertex_size = uint64_t(header->vertex_count) * sizeof(MeshVertex);
+    uint64_t index_size = uint64_t(header->index_count) * header->index_size;
+    if (header->magic != MESH_FILE_MAGIC || header->version != MESH_FILE_VERSION
+        || header->file_size != mesh_file.get_size() || (header->index_size != 2 && header->index_size != 4)
+        || header->vertex_count == 0 || header->index_count == 0 || header->index_count % 3 != 0
+        || header->vertex_offset % MESH_SECTION_ALIGNMENT != 0 || header->vertex_offset + vertex_size > header->file_size
+        || header->index_offset % MESH_SECTION_ALIGNMENT != 0 || header->index_offset + index_size > header->file_size
+        || header->meshlet_offset % MESH_SECTION_ALIGNMENT != 0 || header->meshlet_offset + uint64_t(header->meshlet_count) * sizeof(Meshlet) > header->file_size) {
+        print("'%s' is not a mesh written by this version of meshconv!", settings.mesh_path.c_str());
+        return false;
+    }
+    const Meshlet* meshlets = reinterpret_cast<const Meshlet*>(data + header->meshlet_offset);
+    for (uint32_t i = 0; i < header->meshlet_count; i++) {
+        if (uint64_t(meshlets[i].first_index) + meshlets[i].index_count > header->index_count) {
+            print("Meshlet %u of '%s' reads past the index section!", i, settings.mesh_path.c_str());
+            return false;
+        }
+    }
+    const uint8_t* indices = data + header->index_offset;
+    for (uint32_t i = 0; i < header->index_count; i++) {
+        uint32_t index = header->index_size == 2 ? reinterpret_cast<const uint16_t*>(indices)[i] : reinterpret_cast<const uint32_t*>(indices)[i];
+        if (index >= header->vertex_count) {
+            print("Index %u of '%s' points past the %u vertices!", i, settings.mesh_path.c_str(), header->vertex_count);
+            return false;
+        }
+    }
+    mesh_header = header;
+    mesh_meshlets = meshlets;
+
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    if (!allocator.create_buffer(vertex_size, usage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationStrategy::LINEAR, mesh_vertex_buffer, mesh_vertex_allocation)
+        || !allocator.create_buffer(index_size, usage | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationStrategy::LINEAR, mesh_index_buffer, mesh_index_allocation)) {
+        return false;
+    }
+    DEBUG_NAME(device, VK_OBJECT_TYPE_BUFFER, mesh_vertex_buffer, "mesh vertices");
+    DEBUG_NAME(device, VK_OBJECT_TYPE_BUFFER, mesh_index_buffer, "mesh indices");
+    if (!upload_buffer(mesh_vertex_buffer, data + header->vertex_offset, vertex_size)
+        || !upload_buffer(mesh_index_buffer, data + header->index_offset, index_size)) {
+        return false;
+    }
+    print("Mesh '%s': %u vertices, %u triangles, %u meshlets, mapped and staged in %.3f ms", settings.mesh_path.c_str(),
+        header->vertex_count, header->index_count / 3, header->meshlet_count, double(SDL_GetTicksNS() - start) * 0.000001);
+
+    if (pipeline_statistics) {
+        VkQueryPoolCreateInfo query_pool_info = {};
+        query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        query_pool_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        query_pool_info.queryCount = 1;
+        query_pool_info.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT;
+        for (FrameData &frame : frames) {
+            if (vkCreateQueryPool(device, &query_pool_info, nullptr, frame.statistics_query_pool.put(device)) != VK_SUCCESS) {
+                return false;
+            }
+        }
+    } else {
+        print("No pipeline statistics queries, vertex shader invocations are not measured");
+    }
+
+    // D32 is the common depth format, D16 the one every device supports.
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, VK_FORMAT_D32_SFLOAT, &format_properties);
+    depth_format = (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) ? VK_FORMAT_D32_SFLOAT : VK_FORMAT_D16_UNORM;
+
+    if (!mesh_pipeline_layout.create(device, mesh_reflection, sizeof(MeshPushConstants))) {
+        print("Could not create pipeline layout!");
+        return false;
+    }
+
+    mesh_pipeline_key.shader = pipeline_library.add_shader(mesh_spv, mesh_spv_sizeInBytes, mesh_reflection);
+    mesh_pipeline_key.layout = pipeline_library.add_layout(mesh_pipeline_layout);
+    mesh_pipeline_key.state.vertex_layout = VertexLayout::MESH_VERTEX;
+    // OBJ triangles are counter-clockwise, which the projection's y flip keeps on screen.
+    mesh_pipeline_key.state.front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    mesh_pipeline_key.state.depth_format = depth_format;
+    return true;
+}
+
+
+// Row-major 4x4 matrices.
+static void multiply_matrices(const float p_a[4][4], const float p_b[4][4], float r_result[4][4]) {
+    for (int row = 0; row < 4; row++) {
+        for (int column = 0; column < 4; column++) {
+            r_result[row][column] = p_a[row][0] * p_b[0][column] + p_a[row][1] * p_b[1][column] + p_a[row][2] * p_b[2][column] + p_a[row][3] * p_b[3][column];
+        }
+    }
+}
+
+
+static void normalize_vector(float r_vector[3]) {
+    float length = std::sqrt(r_vector[0] * r_vector[0] + r_vector[1] * r_vector[1] + r_vector[2] * r_vector[2]);
+    if (length > 0.0f) {
+        r_vector[0] /= length;
+        r_vector[1] /= length;
+        r_vector[2] /= length;
+    }
+}
+
+
+void Renderer::update_mesh_camera(VkExtent2D p_extent) {
+    // Orbit the bounds of the mesh, far enough away to keep all of it in view.
+    const float field_of_view = 0.8f;
+    const float elevation = 0.35f;
+    float center[3];
+    float radius {0.0f};
+    for (int axis = 0; axis < 3; axis++) {
+        center[axis] = mesh_header->bounds_min[axis] + mesh_header->bounds_extent[axis] * 0.5f;
+        radius += mesh_header->bounds_extent[axis] * mesh_header->bounds_extent[axis] * 0.25f;
+    }
+    radius = std::max(std::sqrt(radius), 0.0001f);
+    float distance = radius / std::sin(field_of_view * 0.5f) * 1.1f;
+    float angle = float(double(mesh_camera_ns - start_time_ns) * 0.0000000005);
+
+    float* eye = mesh_camera_position;
+    eye[0] = center[0] + distance * std::sin(angle) * std::cos(elevation);
+    eye[1] = center[1] + distance * std::sin(elevation);
+    eye[2] = center[2] + distance * std::cos(angle) * std::cos(elevation);
+
+    // Right-handed look-at, then a projection with Vulkan's downward y and 0..1 depth.
+    float forward[3] = {center[0] - eye[0], center[1] - eye[1], center[2] - eye[2]};
+    normalize_vector(forward);
+    float side[3] = {-forward[2], 0.0f, forward[0]};
+    normalize_vector(side);
+    float up[3] = {side[1] * forward[2] - side[2] * forward[1], side[2] * forward[0] - side[0] * forward[2], side[0] * forward[1] - side[1] * forward[0]};
+    float view[4][4] = {
+        {side[0], side[1], side[2], -(side[0] * eye[0] + side[1] * eye[1] + side[2] * eye[2])},
+        {up[0], up[1], up[2], -(up[0] * eye[0] + up[1] * eye[1] + up[2] * eye[2])},
+        {-forward[0], -forward[1], -forward[2], forward[0] * eye[0] + forward[1] * eye[1] + forward[2] * eye[2]},
+        {0.0f, 0.0f, 0.0f, 1.0f},
+    };
+    float near_plane = std::max(distance - radius * 1.5f, radius * 0.01f);
+    float far_plane = distance + radius * 1.5f;
+    float focal_length = 1.0f / std::tan(field_of_view * 0.5f);
+    float aspect = float(p_extent.width) / float(std::max(p_extent.height, 1u));
+    float projection[4][4] = {
+        {focal_length / aspect, 0.0f, 0.0f, 0.0f},
+        {0.0f, -focal_length, 0.0f, 0.0f},
+        {0.0f, 0.0f, far_plane / (near_plane - far_plane), near_plane * far_plane / (near_plane - far_plane)},
+        {0.0f, 0.0f, -1.0f, 0.0f},
+    };
+    // Positions arrive as 0..1 within the bounds.
+    const float* min = mesh_header->bounds_min;
+    const float* extent = mesh_header->bounds_extent;
+    float dequantize[4][4] = {
+        {extent[0], 0.0f, 0.0f, min[0]},
+        {0.0f, extent[1], 0.0f, min[1]},
+        {0.0f, 0.0f, extent[2], min[2]},
+        {0.0f, 0.0f, 0.0f, 1.0f},
+    };
+    float view_projection[4][4];
+    multiply_matrices(projection, view, view_projection);
+    multiply_matrices(view_projection, dequantize, mesh_push_constants.transform);
+
+    // Light from above the camera.
+    float light[3] = {-forward[0] + up[0], -forward[1] + up[1], -forward[2] + up[2]};
+    normalize_vector(light);
+    mesh_push_constants.light_direction[0] = light[0];
+    mesh_push_constants.light_direction[1] = light[1];
+    mesh_push_constants.light_direction[2] = light[2];
+}
+
+
+void Renderer::record_mesh(VkCommandBuffer p_command_buffer, uint32_t p_window) {
+    const WindowSurface &window = windows[p_window];
+    VkExtent2D extent = window.get_render_extent();
+    update_mesh_camera(extent);
+
+    // Statistics and meshlet counts are of the first window, so they do not depend on the window count.
+    FrameData &frame = frames[current_frame];
+    bool main_view = p_window == 0;
+    if (main_view) {
+        frame.statistics_pending = false;
+        frame.mesh_triangle_count = 0;
+    }
+    bool measure = main_view && pipeline_statistics && mesh_pipeline != VK_NULL_HANDLE;
+    if (measure) {
+        vkCmdResetQueryPool(p_command_buffer, frame.statistics_query_pool, 0, 1);
+    }
+
+    VkRenderingAttachmentInfo color_attachment = {};
+    color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    color_attachment.imageView = render_graph.get_image_view(window.graph_color);
+    color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    color_attachment.clearValue = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+
+    VkRenderingAttachmentInfo depth_attachment = {};
+    depth_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    depth_attachment.imageView = render_graph.get_image_view(window.graph_depth);
+    depth_attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+    depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depth_attachment.clearValue.depthStencil = {1.0f, 0};
+
+    VkRenderingInfo rendering_info = {};
+    rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    rendering_info.renderArea.offset = {0, 0};
+    rendering_info.renderArea.extent = extent;
+    rendering_info.layerCount = 1;
+    rendering_info.colorAttachmentCount = 1;
+    rendering_info.pColorAttachments = &color_attachment;
+    rendering_info.pDepthAttachment = &depth_attachment;
+
+    vkCmdBeginRendering(p_command_buffer, &rendering_info);
+    if (mesh_pipeline != VK_NULL_HANDLE) {
+        VkViewport viewport = {0.0f, 0.0f, float(extent.width), float(extent.height), 0.0f, 1.0f};
+        VkRect2D scissor = {{0, 0}, extent};
+        vkCmdSetViewport(p_command_buffer, 0, 1, &viewport);
+        vkCmdSetScissor(p_command_buffer, 0, 1, &scissor);
+        vkCmdBindPipeline(p_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline);
+        vkCmdPushConstants(p_command_buffer, mesh_pipeline_layout, mesh_pipeline_layout.get_push_constant_stages(), 0, sizeof(mesh_push_constants), &mesh_push_constants);
+        VkDeviceSize offset {0};
+        vkCmdBindVertexBuffers(p_command_buffer, 0, 1, &mesh_vertex_buffer, &offset);
+        vkCmdBindIndexBuffer(p_command_buffer, mesh_index_buffer, 0, mesh_header->index_size == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+        if (measure) {
+            vkCmdBeginQuery(p_command_buffer, frame.statistics_query_pool, 0, 0);
+        }
+
+        // Meshlets are consecutive ranges of the index buffer, so neighbouring visible ones merge into one draw.
+        uint32_t first_index {0};
+        uint32_t index_count {0};
+        for (uint32_t i = 0; i < mesh_header->meshlet_count; i++) {
+            const Meshlet &meshlet = mesh_meshlets[i];
+            bool visible = true;
+            if (settings.cluster_culling && meshlet.cone_cutoff < 1.0f) {
+                float direction[3] = {meshlet.cone_apex[0] - mesh_camera_position[0], meshlet.cone_apex[1] - mesh_camera_position[1],
+                    meshlet.cone_apex[2] - mesh_camera_position[2]};
+                normalize_vector(direction);
+                visible = direction[0] * meshlet.cone_axis[0] + direction[1] * meshlet.cone_axis[1] + direction[2] * meshlet.cone_axis[2] < meshlet.cone_cutoff;
+            }
+            if (!visible) {
+                continue;
+            }
+            frame_stats.mesh_meshlets_drawn += main_view ? 1 : 0;
+            if (index_count > 0 && first_index + index_count != meshlet.first_index) {
+                vkCmdDrawIndexed(p_command_buffer, index_count, 1, first_index, 0, 0);
+                frame.mesh_triangle_count += main_view ? index_count / 3 : 0;
+                index_count = 0;
+            }
+            if (index_count == 0) {
+                first_index = meshlet.first_index;
+            }
+            index_count += meshlet.index_count;
+        }
+        // Files without meshlets are drawn whole.
+        if (mesh_header->meshlet_count == 0) {
+            first_index = 0;
+            index_count = mesh_header->index_count;
+        }
+        if (index_count > 0) {
+            vkCmdDrawIndexed(p_command_buffer, index_count, 1, first_index, 0, 0);
+            frame.mesh_triangle_count += main_view ? index_count / 3 : 0;
+        }
+
+        if (measure) {
+            vkCmdEndQuery(p_command_buffer, frame.statistics_query_pool, 0);
+            frame.statistics_pending = true;
+        }
+    }
+    vkCmdEndRendering(p_command_buffer);
+}
+
+
+bool Renderer::create_primitive_batch() {
+    if (!primitive_batch.initialize(allocator, static_cast<uint32_t>(frames.size()), settings.batch_arena_size)) {
+        return false;
+    }
+    std::vector<uint32_t> quad_indices = primitive_batch.build_quad_indices();
+    if (!upload_buffer(primitive_batch.get_quad_index_buffer(), quad_indices.data(), quad_indices.size() * sizeof(uint32_t))) {
+        return false;
+    }
+
+    // PrimitiveBatch::record pushes its pixel to clip scale.
+    if (!batch_pipeline_layout.create(device, primitives_reflection, 2 * sizeof(float))) {
+        print("Could not create pipeline layout!");
+        return false;
+    }
+
+    // 2D primitives come in either winding and may be translucent.
+    batch_pipeline_key.shader = pipeline_library.add_shader(primitives_spv, primitives_spv_sizeInBytes, primitives_reflection);
+    batch_pipeline_key.layout = pipeline_library.add_layout(batch_pipeline_layout);
+    batch_pipeline_key.state.vertex_layout = VertexLayout::BATCH_VERTEX;
+    batch_pipeline_key.state.cull_mode = VK_CULL_MODE_NONE;
+    batch_pipeline_key.state.alpha_blend = true;
+    batch_line_pipeline_key = batch_pipeline_key;
+    batch_line_pipeline_key.state.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+    return true;
+}
+
+
+PrimitiveBatch& Renderer::get_primitive_batch() {
+    if (!primitive_batch.is_open()) {
+        // The arena of the next frame was last read by the frame this slot submitted before.
+        vkWaitForFences(device, 1, frames[current_frame].in_flight_fence.address(), VK_TRUE, UINT64_MAX);
+        primitive_batch.begin(current_frame);
+    }
+    return primitive_batch;
+}
+
+
+bool Renderer::create_worker_command_pools() {
+    uint32_t worker_count = job_system.get_worker_count();
+
+    for (FrameData &frame : frames) {
+        frame.worker_command_pools.clear();
+        frame.worker_command_pools.resize(worker_count);
+        frame.secondary_command_buffers.assign(windows.size() * worker_count, VK_NULL_HANDLE);
+
+        for (uint32_t i = 0; i < worker_count; i++) {
+            VkCommandPoolCreateInfo pool_info = {};
+            pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            pool_info.queueFamilyIndex = queue_family_index;
+
+            if (vkCreateCommandPool(device, &pool_info, nullptr, frame.worker_command_pools[i].put(device)) != VK_SUCCESS) {
+                return false;
+            }
+
+            VkCommandBufferAllocateInfo alloc_info = {};
+            alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            alloc_info.commandPool = frame.worker_command_pools[i];
+            alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            alloc_info.commandBufferCount = 1;
+
+            // One per window, so every window's scene pass executes its own.
+            for (size_t window = 0; window < windows.size(); window++) {
+                if (vkAllocateCommandBuffers(device, &alloc_info, &frame.secondary_command_buffers[window * worker_count + i]) != VK_SUCCESS) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+
+void Renderer::destroy_worker_command_pools() {
+    // Pending frames may still execute the secondary command buffers of these pools.
+    for (FrameData &frame : frames) {
+        for (UniqueCommandPool &pool : frame.worker_command_pools) {
+            deletion_queue.push(submit_count, std::move(pool));
+        }
+        frame.worker_command_pools.clear();
+        frame.secondary_command_buffers.clear();
+    }
+}
+
+
+void Renderer::record_draws(VkCommandBuffer p_command_buffer, VkExtent2D p_extent, size_t p_first, size_t p_count) {
+    VkViewport viewport = {};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(p_extent.width);
+    viewport.height = static_cast<float>(p_extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
     vkCmdSetViewport(p_command_buffer, 0, 1, &viewport);
 
     VkRect2D scissor = {};
     scissor.offset = {0, 0};
-    scissor.extent = {VIEWPORT_WIDTH, VIEWPORT_HEIGHT};
+    scissor.extent = p_extent;
     vkCmdSetScissor(p_command_buffer, 0, 1, &scissor);
 
-    vkCmdDraw(p_command_buffer, 3, 1, 0, 0);
-    vkCmdEndRenderPass(p_command_buffer);
-    
+    // Still compiling; the viewport and scissor above are needed by the other draws anyway.
+    if (pipeline == VK_NULL_HANDLE) {
+        return;
+    }
+    vkCmdBindPipeline(p_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+    VkDeviceSize vertex_offset {0};
+    vkCmdBindVertexBuffers(p_command_buffer, 0, 1, &vertex_buffer, &vertex_offset);
+    vkCmdBindIndexBuffer(p_command_buffer, index_buffer, 0, VK_INDEX_TYPE_UINT16);
+    VkDescriptorSet bindless = bindless_set.get_set();
+    vkCmdBindDescriptorSets(p_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &bindless, 0, nullptr);
+
+    // Lay the draws out on a grid so that each one gets its own constants.
+    uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(double(draw_list.size()))));
+    float cell = 2.0f / float(columns);
+    VkDescriptorSet uniforms = uniform_ring.get_set();
+    for (size_t i = p_first; i < p_first + p_count; i++) {
+        DrawUniforms draw_uniforms = {};
+        draw_uniforms.transform[0] = -1.0f + cell * (float(i % columns) + 0.5f);
+        draw_uniforms.transform[1] = -1.0f + cell * (float(i / columns) + 0.5f);
+        draw_uniforms.transform[2] = 1.0f / float(columns);
+        for (float &channel : draw_uniforms.tint) {
+            channel = 1.0f;
+        }
+        draw_uniforms.texture[0] = texture_indices.empty() ? BINDLESS_INVALID_INDEX : texture_indices[i % texture_indices.size()];
+        draw_uniforms.texture[1] = texture_streamer.get_sampler_index();
+        uint32_t uniform_offset;
+        if (!uniform_ring.push(&draw_uniforms, sizeof(draw_uniforms), uniform_offset)) {
+            break;
+        }
+        vkCmdBindDescriptorSets(p_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 1, 1, &uniforms, 1, &uniform_offset);
+
+        const DrawCommand &draw = draw_list[i];
+        vkCmdDrawIndexed(p_command_buffer, draw.index_count, draw.instance_count, draw.first_index, draw.vertex_offset, draw.first_instance);
+    }
+}
+
+
+void Renderer::record_secondary_command_buffers(uint32_t p_window) {
+    FrameData &frame = frames[current_frame];
+    size_t worker_count = job_system.get_worker_count();
+    size_t draws_per_worker = (draw_list.size() + worker_count - 1) / worker_count;
+    VkExtent2D extent = windows[p_window].get_render_extent();
+
+    job_system.run([&](uint32_t p_worker) {
+        // Resetting the whole pool is cheaper than resetting its command buffers one by one. The first
+        // window records first, later windows must not reset what it recorded.
+        if (p_window == 0) {
+            vkResetCommandPool(device, frame.worker_command_pools[p_worker], 0);
+        }
+
+        VkFormat color_format = COLOR_FORMAT;
+        VkCommandBufferInheritanceRenderingInfo rendering_info = {};
+        rendering_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+        rendering_info.colorAttachmentCount = 1;
+        rendering_info.pColorAttachmentFormats = &color_format;
+        rendering_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkCommandBufferInheritanceInfo inheritance_info = {};
+        inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritance_info.pNext = &rendering_info;
+
+        VkCommandBufferBeginInfo begin_info = {};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        begin_info.pInheritanceInfo = &inheritance_info;
+
+        VkCommandBuffer command_buffer = frame.secondary_command_buffers[p_window * worker_count + p_worker];
+        if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+            print("Could not begin secondary command buffer!");
+            return;
+        }
+
+        size_t first = std::min(draw_list.size(), p_worker * draws_per_worker);
+        size_t count = std::min(draw_list.size() - first, draws_per_worker);
+        record_draws(command_buffer, extent, first, count);
+        if (p_worker == 0 && settings.instance_count > 0) {
+            record_instanced_draw(command_buffer);
+        }
+        if (p_worker == 0 && settings.particle_count > 0) {
+            record_particle_draw(command_buffer);
+        }
+        if (p_worker == 0 && batch_pipeline != VK_NULL_HANDLE && batch_line_pipeline != VK_NULL_HANDLE) {
+            primitive_batch.record(command_buffer, batch_pipeline_layout, batch_pipeline, batch_line_pipeline, extent);
+        }
+
+        if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+            print("Could not end secondary command buffer!");
+        }
+    });
+}
+
+
+bool Renderer::build_render_graph() {
+    // The swapchain image is acquired with a semaphore wait at the color attachment output stage.
+    for (size_t i = 0; i < windows.size(); i++) {
+        std::string name = windows.size() > 1 ? "color " + std::to_string(i) : "color";
+        windows[i].graph_color = render_graph.import_image(name, VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            settings.headless ? ResourceUsage::NONE : ResourceUsage::PRESENT);
+    }
+
+    if (settings.instance_count > 0) {
+        graph_indirect = render_graph.import_buffer("indirect");
+        graph_visible_instances = render_graph.import_buffer("visible instances");
+        // With async compute, culling runs on its own queue and the ownership transfer orders it.
+        if (settings.gpu_culling && !has_compute_queue()) {
+            uint32_t culling = render_graph.add_pass("culling", [this](VkCommandBuffer p_command_buffer) {
+                profiler.begin_gpu_scope(p_command_buffer, "culling");
+                record_instance_culling(p_command_buffer);
+                profiler.end_gpu_scope(p_command_buffer);
+            });
+            render_graph.write(culling, graph_indirect, ResourceUsage::STORAGE_WRITE);
+            render_graph.write(culling, graph_visible_instances, ResourceUsage::STORAGE_WRITE);
+        }
+    }
+
+    if (settings.particle_count > 0) {
+        // Persistent: this frame's simulation has to wait until the previous frame has drawn the particles.
+        graph_particles = render_graph.import_buffer("particles", ResourceUsage::NONE, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT);
+        uint32_t particles = render_graph.add_pass("particles", [this](VkCommandBuffer p_command_buffer) {
+            profiler.begin_gpu_scope(p_command_buffer, "particles");
+            record_particle_simulation(p_command_buffer);
+            profiler.end_gpu_scope(p_command_buffer);
+        });
+        render_graph.write(particles, graph_particles, ResourceUsage::STORAGE_WRITE, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+    }
+
+    // Culling and the simulation above run once, every window draws their results.
+    for (uint32_t i = 0; i < windows.size(); i++) {
+        WindowSurface &window = windows[i];
+        std::string suffix = windows.size() > 1 ? " " + std::to_string(i) : "";
+
+        if (mesh_header != nullptr) {
+            // Transient: cleared every frame and never read afterwards, so the depth buffers of all windows
+            // share memory, or live in tile memory where the device has lazily allocated memory.
+            TransientImageInfo depth_info = {};
+            depth_info.format = depth_format;
+            depth_info.extent = window.swapchain_extent;
+            window.graph_depth = render_graph.create_image("depth" + suffix, depth_info, VK_IMAGE_ASPECT_DEPTH_BIT);
+            uint32_t mesh = render_graph.add_pass("mesh" + suffix, [this, i](VkCommandBuffer p_command_buffer) {
+                profiler.begin_gpu_scope(p_command_buffer, "mesh");
+                record_mesh(p_command_buffer, i);
+                profiler.end_gpu_scope(p_command_buffer);
+            });
+            render_graph.write(mesh, window.graph_color, ResourceUsage::COLOR_ATTACHMENT);
+            render_graph.write(mesh, window.graph_depth, ResourceUsage::DEPTH_ATTACHMENT);
+        }
+
+        uint32_t scene = render_graph.add_pass("scene" + suffix, [this, i](VkCommandBuffer p_command_buffer) { record_scene(p_command_buffer, i); });
+        render_graph.write(scene, window.graph_color, ResourceUsage::COLOR_ATTACHMENT);
+        if (settings.instance_count > 0) {
+            render_graph.read(scene, graph_indirect, ResourceUsage::INDIRECT_READ);
+            render_graph.read(scene, graph_visible_instances, ResourceUsage::STORAGE_READ, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT);
+        }
+        if (settings.particle_count > 0) {
+            render_graph.read(scene, graph_particles, ResourceUsage::STORAGE_READ, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT);
+        }
+    }
+
+    if (settings.headless) {
+        // Copying back here lets the host read frame N while the GPU already renders frame N+1.
+        graph_readback = render_graph.import_buffer("readback", ResourceUsage::HOST_READ);
+        uint32_t readback = render_graph.add_pass("readback", [this](VkCommandBuffer p_command_buffer) {
+            profiler.begin_gpu_scope(p_command_buffer, "readback");
+            VkBufferImageCopy region = {};
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent = {VIEWPORT_WIDTH, VIEWPORT_HEIGHT, 1};
+            vkCmdCopyImageToBuffer(p_command_buffer, render_graph.get_image(windows[0].graph_color), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                render_graph.get_buffer(graph_readback), 1, &region);
+            profiler.end_gpu_scope(p_command_buffer);
+        });
+        render_graph.read(readback, windows[0].graph_color, ResourceUsage::TRANSFER_SRC);
+        render_graph.write(readback, graph_readback, ResourceUsage::TRANSFER_DST);
+    }
+
+    if (!render_graph.compile() || !render_graph.allocate(device, allocator)) {
+        return false;
+    }
+    if (settings.dump_render_graph) {
+        for (const std::string &line : render_graph.describe()) {
+            print("%s", line.c_str());
+        }
+    }
+    return true;
+}
+
+
+void Renderer::record_scene(VkCommandBuffer p_command_buffer, uint32_t p_window) {
+    VkExtent2D extent = windows[p_window].get_render_extent();
+
+    VkRenderingAttachmentInfo color_attachment = {};
+    color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    color_attachment.imageView = render_graph.get_image_view(windows[p_window].graph_color);
+    color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    // The mesh pass already cleared and drew.
+    color_attachment.loadOp = mesh_header != nullptr ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    color_attachment.clearValue = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+
+    VkRenderingInfo rendering_info = {};
+    rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    rendering_info.renderArea.offset = {0, 0};
+    rendering_info.renderArea.extent = extent;
+    rendering_info.layerCount = 1;
+    rendering_info.colorAttachmentCount = 1;
+    rendering_info.pColorAttachments = &color_attachment;
+
+    profiler.begin_gpu_scope(p_command_buffer, "render pass");
+    if (job_system.get_worker_count() > 0) {
+        rendering_info.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+        vkCmdBeginRendering(p_command_buffer, &rendering_info);
+        record_secondary_command_buffers(p_window);
+        const FrameData &frame = frames[current_frame];
+        uint32_t worker_count = job_system.get_worker_count();
+        vkCmdExecuteCommands(p_command_buffer, worker_count, &frame.secondary_command_buffers[p_window * worker_count]);
+    } else {
+        vkCmdBeginRendering(p_command_buffer, &rendering_info);
+        record_draws(p_command_buffer, extent, 0, draw_list.size());
+        if (settings.instance_count > 0) {
+            record_instanced_draw(p_command_buffer);
+        }
+        if (settings.particle_count > 0) {
+            record_particle_draw(p_command_buffer);
+        }
+        // On top of the scene.
+        if (batch_pipeline != VK_NULL_HANDLE && batch_line_pipeline != VK_NULL_HANDLE) {
+            primitive_batch.record(p_command_buffer, batch_pipeline_layout, batch_pipeline, batch_line_pipeline, extent);
+        }
+    }
+    vkCmdEndRendering(p_command_buffer);
+    profiler.end_gpu_scope(p_command_buffer);
+}
+
+
+void Renderer::record_command_buffer(VkCommandBuffer p_command_buffer, bool p_submitted) {
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = 0;
+    begin_info.pInheritanceInfo = nullptr;
+
+    if (vkBeginCommandBuffer(p_command_buffer, &begin_info) != VK_SUCCESS) {
+        print("Could not begin command buffer!");
+    }
+
+    profiler.reset_queries(p_command_buffer);
+    // The first scope is the whole frame, which is what the frame stats report as GPU time.
+    profiler.begin_gpu_scope(p_command_buffer, "frame");
+
+    // With a dedicated transfer queue the copies were submitted there, only the ownership is taken over here.
+    profiler.begin_gpu_scope(p_command_buffer, "uploads");
+    DEBUG_LABEL_BEGIN(p_command_buffer, "uploads");
+    if (has_transfer_queue()) {
+        staging_ring.acquire(p_command_buffer, transfer_queue_family_index, queue_family_index);
+    } else {
+        staging_ring.flush(p_command_buffer, current_frame);
+    }
+    // Streamed mip levels are copied on the graphics queue, right before the draws that sample them.
+    if (!textures.empty() && p_submitted) {
+        texture_streamer.update(p_command_buffer, submit_count + 1, deletion_queue);
+        for (size_t i = 0; i < textures.size(); i++) {
+            texture_indices[i] = texture_streamer.get_bindless_index(textures[i]);
+        }
+        // Draw i samples texture i % textures.size(), so only the first draw_list.size() textures are on screen.
+        for (size_t i = 0; i < std::min(draw_list.size(), textures.size()); i++) {
+            texture_streamer.mark_used(textures[i]);
+        }
+    }
+    DEBUG_LABEL_END(p_command_buffer);
+    profiler.end_gpu_scope(p_command_buffer);
+
+    if (settings.instance_count > 0 && settings.gpu_culling && has_compute_queue()) {
+        record_culling_ownership(p_command_buffer, false);
+    }
+
+    // Everything else is ordered by the render graph, which swaps in this frame's images and buffers.
+    const FrameData &frame = frames[current_frame];
+    for (const WindowSurface &window : windows) {
+        // Windows that could not acquire an image, e.g. minimized ones, still run their passes, into the parked image.
+        if (window.presenting) {
+            render_graph.set_image(window.graph_color, window.swapchain_images[window.image_index], window.swapchain_image_views[window.image_index]);
+        } else {
+            render_graph.set_image(window.graph_color, window.parked_image, window.parked_image_view);
+        }
+    }
+    if (settings.instance_count > 0) {
+        render_graph.set_buffer(graph_indirect, frame.indirect_buffer);
+        render_graph.set_buffer(graph_visible_instances, frame.visible_instance_buffer);
+    }
+    if (settings.particle_count > 0) {
+        render_graph.set_buffer(graph_particles, particle_buffer);
+    }
+    if (settings.headless) {
+        render_graph.set_buffer(graph_readback, frame.readback_buffer);
+    }
+    render_graph.execute(p_command_buffer);
+
+    profiler.end_gpu_scope(p_command_buffer);
     if (vkEndCommandBuffer(p_command_buffer) != VK_SUCCESS) {
         print("Could not end command buffer!");
     }
@@ -415,10 +2141,24 @@ bool Renderer::create_sync_objects() {
     fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    int result;
-    result  = (int)vkCreateSemaphore(device, &semaphore_info, nullptr, &image_available_semaphore);
-    result += (int)vkCreateSemaphore(device, &semaphore_info, nullptr, &render_finished_semaphore);
-    result += (int)vkCreateFence(device, &fence_info, nullptr, &gImageAvailableFence);
+    int result {0};
+    if (!settings.headless) {
+        for (WindowSurface &window : windows) {
+            window.image_available_semaphores.resize(frames.size());
+            for (size_t i = 0; i < frames.size(); i++) {
+                result += (int)vkCreateSemaphore(device, &semaphore_info, nullptr, window.image_available_semaphores[i].put(device));
+            }
+        }
+    }
+    for (FrameData &frame : frames) {
+        result += (int)vkCreateFence(device, &fence_info, nullptr, frame.in_flight_fence.put(device));
+        if (has_transfer_queue()) {
+            result += (int)vkCreateSemaphore(device, &semaphore_info, nullptr, frame.transfer_finished_semaphore.put(device));
+        }
+        if (has_compute_queue()) {
+            result += (int)vkCreateSemaphore(device, &semaphore_info, nullptr, frame.compute_finished_semaphore.put(device));
+        }
+    }
 
     return result == 0;
 }
@@ -426,36 +2166,188 @@ bool Renderer::create_sync_objects() {
 
 void Renderer::cleanup_swapchain() {
     vkDeviceWaitIdle(device);
-    for (VkFramebuffer framebuffer : framebuffers) {
-        vkDestroyFramebuffer(device, framebuffer, nullptr);
-    }
-    for (VkImageView image_view : swapchain_image_views) {
-        vkDestroyImageView(device, image_view, nullptr);
+    deletion_queue.flush();
+    for (WindowSurface &window : windows) {
+        window.swapchain_image_views.clear();
+        if (settings.headless) {
+            for (size_t i = 0; i < window.swapchain_images.size(); i++) {
+                allocator.destroy_image(window.swapchain_images[i], window.offscreen_image_allocations[i]);
+            }
+            window.offscreen_image_allocations.clear();
+        }
+        window.swapchain.reset();
+        window.swapchain_images.clear();
+        window.image_available_semaphores.clear();
+        window.render_finished_semaphores.clear();
+        window.parked_image_view.reset();
+        allocator.destroy_image(window.parked_image, window.parked_allocation);
     }
-    vkDestroySwapchainKHR(device, swapchain, nullptr);
 }
 
 
-void Renderer::recreate_swapchain() {
-    vkDeviceWaitIdle(device);
+bool Renderer::recreate_swapchain(WindowSurface &p_window) {
+    uint64_t start = SDL_GetTicksNS();
+    VkExtent2D extent = choose_swapchain_extent(p_window);
+    if (extent.width == 0 || extent.height == 0) {
+        // Minimized: keep the old swapchain until the window has a size again.
+        return false;
+    }
 
-    cleanup_swapchain();
+    // No device idle: frames in flight keep rendering to and presenting the old images,
+    // which are destroyed once the last frame submitted before this point has finished.
+    for (UniqueImageView &image_view : p_window.swapchain_image_views) {
+        deletion_queue.push(submit_count, std::move(image_view));
+    }
+    for (UniqueSemaphore &semaphore : p_window.render_finished_semaphores) {
+        deletion_queue.push(submit_count, std::move(semaphore));
+    }
+    p_window.swapchain_image_views.clear();
+    p_window.render_finished_semaphores.clear();
+    p_window.swapchain_images.clear();
+
+    if (!create_swapchain(p_window) || !create_image_views(p_window)) {
+        print("Could not recreate swapchain!");
+        return false;
+    }
+    // The depth buffer follows the swapchain. Transients share one block, so all of them are replaced.
+    if (p_window.graph_depth != INVALID_RENDER_RESOURCE) {
+        render_graph.retire(deletion_queue, submit_count, allocator);
+        render_graph.set_extent(p_window.graph_depth, p_window.swapchain_extent);
+        if (!render_graph.allocate(device, allocator)) {
+            print("Could not recreate depth buffer!");
+            return false;
+        }
+    }
+    p_window.swapchain_dirty = false;
 
-    create_swapchain();
-    create_image_views();
-    create_framebuffers();
+    print("Swapchain recreated at %ux%u in %.3f ms, %zu object(s) pending deletion", p_window.swapchain_extent.width, p_window.swapchain_extent.height,
+        double(SDL_GetTicksNS() - start) * 0.000001, deletion_queue.size());
+    return true;
+}
+
+
+void Renderer::update_frame_stats(uint64_t p_frame_start) {
+    uint64_t now = SDL_GetTicksNS();
+    if (frame_stats.previous_frame_ns != 0) {
+        frame_stats.frame_time_ns += now - frame_stats.previous_frame_ns;
+        frame_stats.cpu_time_ns += now - p_frame_start;
+        frame_stats.frame_count++;
+    } else {
+        frame_stats.last_report_ns = now;
+    }
+    frame_stats.previous_frame_ns = now;
+
+    // Report once per second so the numbers are readable even at high frame rates.
+    if (now - frame_stats.last_report_ns >= 1000000000ull && frame_stats.frame_count > 0) {
+        double frame_ms = double(frame_stats.frame_time_ns) / double(frame_stats.frame_count) * 0.000001;
+        double cpu_ms = double(frame_stats.cpu_time_ns) / double(frame_stats.frame_count) * 0.000001;
+        double record_ms = double(frame_stats.record_time_ns) / double(frame_stats.frame_count) * 0.000001;
+        print("Frame time: %.3f ms (%.1f fps), CPU draw: %.3f ms, recording: %.3f ms, %u frames in flight",
+            frame_ms, 1000.0 / frame_ms, cpu_ms, record_ms, (uint32_t)frames.size());
+        if (frame_stats.gpu_frame_count > 0) {
+            print("GPU: %.3f ms average", double(frame_stats.gpu_time_ns) / double(frame_stats.gpu_frame_count) * 0.000001);
+        }
+        if (!settings.headless) {
+            print("Acquire-to-present: %.3f ms average", double(frame_stats.latency_ns) / double(frame_stats.frame_count) * 0.000001);
+        }
+        if (frame_stats.input_frame_count > 0) {
+            print("Input-to-submit: %.3f ms average over %llu frames with input", double(frame_stats.input_latency_ns) / double(frame_stats.input_frame_count) * 0.000001,
+                (unsigned long long)frame_stats.input_frame_count);
+        }
+        if (settings.instance_count > 0) {
+            print("Instances: %u per frame, %.2f M instances/s", settings.instance_count, double(settings.instance_count) / frame_ms * 0.001);
+        }
+        if (settings.particle_count > 0) {
+            // Without timestamps the whole frame time is the upper bound of the simulation time.
+            bool timed = frame_stats.particle_frame_count > 0;
+            double simulate_ms = timed ? double(frame_stats.particle_time_ns) / double(frame_stats.particle_frame_count) * 0.000001 : frame_ms;
+            print("Particles: %u, %.0f particles/ms simulated (%s %.3f ms)", settings.particle_count, double(settings.particle_count) / simulate_ms,
+                timed ? "GPU" : "frame", simulate_ms);
+        }
+        if (mesh_header != nullptr) {
+            double meshlets = double(mesh_header->meshlet_count) * double(frame_stats.frame_count);
+            if (frame_stats.mesh_frame_count > 0) {
+                print("Mesh: %.0f vertex shader invocations per frame, %.3f per triangle, %.1f%% of meshlets drawn",
+                    double(frame_stats.mesh_vertex_invocations) / double(frame_stats.mesh_frame_count),
+                    double(frame_stats.mesh_vertex_invocations) / double(std::max(frame_stats.mesh_triangles, uint64_t(1))),
+                    meshlets > 0.0 ? double(frame_stats.mesh_meshlets_drawn) / meshlets * 100.0 : 100.0);
+            } else {
+                print("Mesh: %.1f%% of meshlets drawn", meshlets > 0.0 ? double(frame_stats.mesh_meshlets_drawn) / meshlets * 100.0 : 100.0);
+            }
+        }
+        if (!textures.empty()) {
+            TextureStreamingStats stats = texture_streamer.get_stats();
+            double seconds = double(now - frame_stats.last_report_ns) * 0.000000001;
+            print("Textures: %u, %.1f of %.1f MiB resident, %u of %u mip levels, %.1f MB/s uploaded, %llu levels evicted", stats.texture_count,
+                double(stats.resident_bytes) / (1024.0 * 1024.0), double(stats.budget_bytes) / (1024.0 * 1024.0), stats.resident_levels, stats.total_levels,
+                double(stats.uploaded_bytes - frame_stats.texture_uploaded_bytes) / seconds * 0.000001, (unsigned long long)stats.evicted_levels);
+            frame_stats.texture_uploaded_bytes = stats.uploaded_bytes;
+        }
+        if (frame_stats.dropped_primitives > 0) {
+            print("%llu 2D primitives did not fit into the batch arena", (unsigned long long)frame_stats.dropped_primitives);
+        }
+        frame_stats.frame_count = 0;
+        frame_stats.frame_time_ns = 0;
+        frame_stats.cpu_time_ns = 0;
+        frame_stats.record_time_ns = 0;
+        frame_stats.latency_ns = 0;
+        frame_stats.input_latency_ns = 0;
+        frame_stats.input_frame_count = 0;
+        frame_stats.gpu_time_ns = 0;
+        frame_stats.gpu_frame_count = 0;
+        frame_stats.particle_time_ns = 0;
+        frame_stats.particle_frame_count = 0;
+        frame_stats.mesh_vertex_invocations = 0;
+        frame_stats.mesh_triangles = 0;
+        frame_stats.mesh_frame_count = 0;
+        frame_stats.mesh_meshlets_drawn = 0;
+        frame_stats.dropped_primitives = 0;
+        frame_stats.last_report_ns = now;
+    }
 }
 
-bool Renderer::initialize(uint32_t p_extension_count, const char* const* p_extensions, SDL_Window* p_window) {
-    window = p_window;
+bool Renderer::initialize(uint32_t p_extension_count, const char* const* p_extensions, const std::vector<SDL_Window*> &p_windows, const RendererSettings &p_settings) {
+    settings = p_settings;
+    if (!settings.headless && (p_windows.empty() || p_windows.size() > MAX_WINDOWS)) {
+        print("Can render to 1 to %u windows, not %zu!", MAX_WINDOWS, p_windows.size());
+        return false;
+    }
+    // Headless renders one offscreen view.
+    windows.resize(settings.headless ? 1 : p_windows.size());
+    for (size_t i = 0; i < windows.size() && i < p_windows.size(); i++) {
+        windows[i].window = p_windows[i];
+        int width {0};
+        int height {0};
+        SDL_GetWindowSizeInPixels(windows[i].window, &width, &height);
+        windows[i].window_extent = {uint32_t(std::max(width, 0)), uint32_t(std::max(height, 0))};
+    }
+    if (settings.frames_in_flight == 0 || settings.low_latency) {
+        settings.frames_in_flight = 1;
+    }
+    frames.resize(settings.frames_in_flight);
+    // The stress scene replaces the single triangle.
+    draw_list.assign(settings.instance_count > 0 ? 0 : std::max(1u, settings.draw_count), DrawCommand{3, 1, 0, 0, 0});
+    if (settings.particle_count > MAX_PARTICLE_COUNT) {
+        print("Limiting particles to %u", MAX_PARTICLE_COUNT);
+        settings.particle_count = MAX_PARTICLE_COUNT;
+    }
+    start_time_ns = SDL_GetTicksNS();
     
     if (!create_vulkan_instance(p_extension_count, p_extensions)) {
         print("Could not create Vulkan instance!");
         return false;
     }
-    if (!SDL_Vulkan_CreateSurface(window, instance, nullptr, &surface)) {
-        print("Could not create Vulkan surface! SDL error: %s", SDL_GetError());
-        return false;
+    for (WindowSurface &window : windows) {
+        if (!settings.headless && !SDL_Vulkan_CreateSurface(window.window, instance, nullptr, &window.surface)) {
+            print("Could not create Vulkan surface! SDL error: %s", SDL_GetError());
+            return false;
+        }
+    }
+    if (!settings.headless) {
+        // Frames are paced to the display of the first window.
+        const SDL_DisplayMode* display_mode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(windows[0].window));
+        float refresh_rate = display_mode != nullptr && display_mode->refresh_rate > 0.0f ? display_mode->refresh_rate : 60.0f;
+        frame_pacing.refresh_interval_ns = uint64_t(1000000000.0 / refresh_rate);
     }
     if (!create_physical_device()) {
         print("Could not create physical device!");
@@ -465,102 +2357,612 @@ bool Renderer::initialize(uint32_t p_extension_count, const char* const* p_exten
         print("Could not create logical device!");
         return false;
     }
-    if(!create_swapchain()) {
-        print("Could not create swapchain!");
+    if (!profiler.initialize(physical_device, device, queue_family_index, settings.frames_in_flight)) {
+        print("Could not create timestamp query pools!");
+        return false;
+    }
+    profiler.set_capture(!settings.profile_output_path.empty());
+    if (!allocator.initialize(physical_device, device) || !staging_ring.initialize(allocator, STAGING_RING_SIZE, settings.frames_in_flight)) {
+        print("Could not create device memory allocator!");
         return false;
     }
-    if (!create_image_views()) {
-        print("Could not create image views!");
+    for (WindowSurface &window : windows) {
+        if (settings.headless) {
+            if (!create_offscreen_images(window)) {
+                print("Could not create offscreen images!");
+                return false;
+            }
+        } else if (!create_swapchain(window)) {
+            print("Could not create swapchain!");
+            return false;
+        }
+        if (!create_image_views(window)) {
+            print("Could not create image views!");
+            return false;
+        }
+        // A single window skips the frame when it cannot present, several keep rendering the others.
+        if (windows.size() > 1 && !create_parked_image(window)) {
+            print("Could not create parked image!");
+            return false;
+        }
+    }
+    if (!create_descriptors()) {
         return false;
     }
-    if (!create_render_pass()) {
-        print("Could not create render pass!");
+    bool warm_cache;
+    if (!create_pipeline_cache(warm_cache)) {
+        print("Could not create pipeline cache!");
         return false;
     }
     if (!create_pipeline()) {
         print("Could not create pipeline!");
         return false;
     }
-    if (!create_framebuffers()) {
-        print("Could not create framebuffers!");
-        return false;
-    }
     if (!create_command_pool()) {
         print("Could not create command pool!");
         return false;
     }
-    if (!create_command_buffer()) {
-        print("Could not create command buffer!");
+    if (!create_command_buffers()) {
+        print("Could not create command buffers!");
+        return false;
+    }
+    if (!create_geometry_buffers()) {
+        print("Could not create vertex and index buffers!");
+        return false;
+    }
+    if (settings.instance_count > 0) {
+        if (!create_instance_buffers() || !create_instance_descriptors() || !create_instance_pipelines()) {
+            print("Could not create instanced scene!");
+            return false;
+        }
+    }
+    if (settings.particle_count > 0 && !create_particles()) {
+        print("Could not create particles!");
+        return false;
+    }
+    if (!settings.mesh_path.empty() && !create_mesh()) {
+        print("Could not load mesh!");
+        return false;
+    }
+    if (!create_primitive_batch()) {
+        print("Could not create primitive batch!");
+        return false;
+    }
+    uint64_t pipeline_start = SDL_GetTicksNS();
+    if (!start_pipeline_library()) {
+        print("Could not create pipelines!");
+        return false;
+    }
+    if (settings.prewarm_pipelines) {
+        print("Pipeline creation took %.3f ms (%s start, %zu pipelines)", double(SDL_GetTicksNS() - pipeline_start) * 0.000001,
+            warm_cache ? "warm" : "cold", pipeline_library.get_pipeline_count());
+    }
+    job_system.start(settings.recording_threads);
+    if (!create_worker_command_pools()) {
+        print("Could not create worker command pools!");
         return false;
     }
     if (!create_sync_objects()) {
         print("Could not create fence and semaphores!");
         return false;
     }
+    if (settings.headless && !create_readback_buffers()) {
+        print("Could not create readback buffers!");
+        return false;
+    }
+    if (!build_render_graph()) {
+        print("Could not build render graph!");
+        return false;
+    }
+#ifdef SHADER_HOT_RELOAD
+    if (!shader_reloader.start(SHADER_SOURCE_DIR, SLANGC_EXECUTABLE,
+        [this](const std::string &p_name, const std::vector<uint32_t> &p_spirv) { reload_shader(p_name, p_spirv); })) {
+        print("Shader hot-reload is disabled");
+    }
+#endif
 
     return true;
 }
 
-void Renderer::cleanup() {
+void Renderer::cleanup_device() {
+#ifdef SHADER_HOT_RELOAD
+    shader_reloader.stop();
+    reloaded_pipelines.clear();
+#endif
     cleanup_swapchain();
 
-    vkDestroySemaphore(device, image_available_semaphore, nullptr);
-    vkDestroySemaphore(device, render_finished_semaphore, nullptr);
-    vkDestroyFence(device, gImageAvailableFence, nullptr);
-    vkDestroyCommandPool(device, command_pool, nullptr);
-    vkDestroyPipeline(device, pipeline, nullptr);
-    vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
-    vkDestroyRenderPass(device, render_pass, nullptr);
-    
-    SDL_Vulkan_DestroySurface(instance, surface, nullptr);
-    SDL_DestroyWindow(window);
-    window = nullptr;
+    const std::string &profile_path = settings.profile_output_path;
+    if (!profile_path.empty()) {
+        bool json = profile_path.size() >= 5 && profile_path.compare(profile_path.size() - 5, 5, ".json") == 0;
+        if (json ? profiler.write_chrome_trace(profile_path) : profiler.write_csv(profile_path)) {
+            print("Wrote profile to '%s'", profile_path.c_str());
+        }
+    }
+    profiler.cleanup();
+
+    job_system.stop();
+    pipeline_library.stop();
+    destroy_worker_command_pools();
+    pipeline_library.collect_retired(deletion_queue, submit_count);
+    deletion_queue.flush();
+    // After the flush, which still releases streamed images and staging space.
+    if (!textures.empty()) {
+        texture_streamer.cleanup();
+        textures.clear();
+    }
 
+    for (FrameData &frame : frames) {
+        if (frame.readback_buffer != VK_NULL_HANDLE) {
+            allocator.destroy_buffer(frame.readback_buffer, frame.readback_allocation);
+        }
+        allocator.destroy_buffer(frame.visible_instance_buffer, frame.visible_instance_allocation);
+        allocator.destroy_buffer(frame.indirect_buffer, frame.indirect_allocation);
+    }
+    // Everything below owns its handles; only the order relative to the device matters.
+    frames.clear();
+    command_pool.reset();
+    transfer_command_pool.reset();
+    compute_command_pool.reset();
+    pipeline_library.clear();
+    cull_pipeline.reset();
+    instance_pipeline_layout.reset();
+    instance_descriptor_pool.reset();
+    allocator.destroy_buffer(instance_buffer, instance_allocation);
+    simulate_pipeline.reset();
+    particle_pipeline_layout.reset();
+    allocator.destroy_buffer(particle_buffer, particle_allocation);
+    mesh_pipeline_layout.reset();
+    allocator.destroy_buffer(mesh_vertex_buffer, mesh_vertex_allocation);
+    allocator.destroy_buffer(mesh_index_buffer, mesh_index_allocation);
+    mesh_header = nullptr;
+    mesh_meshlets = nullptr;
+    mesh_file.close();
+    allocator.destroy_buffer(vertex_buffer, vertex_allocation);
+    allocator.destroy_buffer(index_buffer, index_allocation);
+    render_graph.cleanup(allocator);
+    render_graph.clear();
+    uniform_ring.cleanup(allocator);
+    bindless_set.cleanup();
+    primitive_batch.cleanup(allocator);
+    batch_pipeline_layout.reset();
+    staging_ring.cleanup(allocator);
+    save_pipeline_cache();
+    pipeline_cache.reset();
+    pipeline_layout.reset();
+
+    allocator.cleanup();
     vkDestroyDevice(device, nullptr);
-    vkDestroyInstance(instance, nullptr);
-    SDL_Vulkan_UnloadLibrary();
+    device = VK_NULL_HANDLE;
 }
 
-void Renderer::draw() {
-    vkWaitForFences(device, 1, &gImageAvailableFence, VK_TRUE, UINT64_MAX);
-    vkResetFences(device, 1, &gImageAvailableFence);
 
-    uint32_t image_index;
-    VkResult acquisition_result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, image_available_semaphore, VK_NULL_HANDLE, &image_index);
-    if (acquisition_result == VK_ERROR_OUT_OF_DATE_KHR) {
-        recreate_swapchain();
+void Renderer::cleanup() {
+    // initialize() may have failed at any point, before the device or even the instance existed.
+    if (device != VK_NULL_HANDLE) {
+        cleanup_device();
+    }
+
+    if (!settings.headless) {
+        for (WindowSurface &window : windows) {
+            if (window.surface != VK_NULL_HANDLE) {
+                SDL_Vulkan_DestroySurface(instance, window.surface, nullptr);
+            }
+            SDL_DestroyWindow(window.window);
+        }
+    }
+    windows.clear();
+
+    if (instance != VK_NULL_HANDLE) {
+#ifdef VULKAN_DEBUG
+        destroy_debug_messenger(instance, debug_messenger);
+#endif
+        vkDestroyInstance(instance, nullptr);
+        instance = VK_NULL_HANDLE;
+    }
+    if (!settings.headless) {
+        SDL_Vulkan_UnloadLibrary();
+    }
+}
+
+void Renderer::draw(uint64_t p_input_ns) {
+    uint64_t frame_start = SDL_GetTicksNS();
+    FrameData &frame = frames[current_frame];
+
+    profiler.begin_cpu_scope("wait");
+    vkWaitForFences(device, 1, frame.in_flight_fence.address(), VK_TRUE, UINT64_MAX);
+    profiler.end_cpu_scope();
+    staging_ring.release(current_frame);
+    uniform_ring.begin(current_frame);
+    // Frames are submitted in order to one graphics queue, so this slot's fence covers every earlier
+    // submission too. Presents have no fence of their own without VK_EXT_swapchain_maintenance1,
+    // but they are queued behind the rendering they wait for.
+    completed_submit = std::max(completed_submit, frame.submit_index);
+    deletion_queue.collect(completed_submit);
+    if (frame.statistics_pending) {
+        uint64_t vertex_invocations {0};
+        if (vkGetQueryPoolResults(device, frame.statistics_query_pool, 0, 1, sizeof(vertex_invocations), &vertex_invocations,
+            sizeof(vertex_invocations), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+            frame_stats.mesh_vertex_invocations += vertex_invocations;
+            frame_stats.mesh_triangles += frame.mesh_triangle_count;
+            frame_stats.mesh_frame_count++;
+        }
+        frame.statistics_pending = false;
+    }
+#ifdef SHADER_HOT_RELOAD
+    apply_reloaded_pipelines();
+#endif
+    pipeline_library.collect_retired(deletion_queue, submit_count);
+    resolve_pipelines();
+
+    bool any_presenting {false};
+    for (WindowSurface &window : windows) {
+        window.presenting = settings.headless || ((!window.swapchain_dirty && window.swapchain != VK_NULL_HANDLE) || recreate_swapchain(window));
+        any_presenting = any_presenting || window.presenting;
+    }
+    if (!any_presenting) {
+        // Minimized, or the surface is not ready yet; try again next frame.
+        SDL_Delay(10);
         return;
     }
 
-    vkResetCommandBuffer(command_buffer, 0);
-    record_command_buffer(command_buffer, image_index);     
+    double gpu_ms = profiler.begin_frame(current_frame, frame_number++);
+    last_gpu_time_ms = gpu_ms;
+    if (gpu_ms >= 0.0) {
+        frame_stats.gpu_time_ns += uint64_t(gpu_ms * 1000000.0);
+        frame_stats.gpu_frame_count++;
+    }
+    double particle_ms = settings.particle_count > 0 ? profiler.get_scope_ms("particles") : -1.0;
+    if (particle_ms >= 0.0) {
+        frame_stats.particle_time_ns += uint64_t(particle_ms * 1000000.0);
+        frame_stats.particle_frame_count++;
+    }
+
+    // Headless slots own their target image, so there is nothing to acquire.
+    if (settings.headless) {
+        windows[0].image_index = current_frame;
+    } else {
+        profiler.begin_cpu_scope("acquire");
+        any_presenting = false;
+        for (WindowSurface &window : windows) {
+            if (!window.presenting) {
+                continue;
+            }
+            VkResult acquisition_result = vkAcquireNextImageKHR(device, window.swapchain, UINT64_MAX, window.image_available_semaphores[current_frame],
+                VK_NULL_HANDLE, &window.image_index);
+            // Out of date: this window sits the frame out and is recreated after the present.
+            // A suboptimal image can still be presented, so finish this frame and recreate afterwards.
+            if (acquisition_result != VK_SUCCESS && acquisition_result != VK_SUBOPTIMAL_KHR) {
+                window.presenting = false;
+            }
+            window.swapchain_dirty = window.swapchain_dirty || acquisition_result != VK_SUCCESS;
+            any_presenting = any_presenting || window.presenting;
+        }
+        profiler.end_cpu_scope();
+        if (!any_presenting) {
+            for (WindowSurface &window : windows) {
+                if (window.swapchain_dirty) {
+                    recreate_swapchain(window);
+                }
+            }
+            return;
+        }
+        frame_pacing.last_acquire_ns = SDL_GetTicksNS();
+
+        // The image can still be in use by an older slot if the swapchain hands images out of order.
+        for (WindowSurface &window : windows) {
+            if (!window.presenting) {
+                continue;
+            }
+            VkFence &image_fence = window.images_in_flight[window.image_index];
+            if (image_fence != VK_NULL_HANDLE) {
+                vkWaitForFences(device, 1, &image_fence, VK_TRUE, UINT64_MAX);
+            }
+            image_fence = frame.in_flight_fence;
+        }
+    }
+
+    // Only reset once we know work will be submitted, otherwise the next wait on this slot never returns.
+    vkResetFences(device, 1, frame.in_flight_fence.address());
 
-    VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    if (settings.instance_count > 0) {
+        instance_push_constants.instance_count = settings.instance_count;
+        instance_push_constants.time = float(double(SDL_GetTicksNS() - start_time_ns) * 0.000000001);
+    }
+    if (settings.particle_count > 0) {
+        // Seeded on the first step. Long stalls are clamped so particles do not jump across the screen.
+        uint64_t now = SDL_GetTicksNS();
+        particle_push_constants.reset = particle_step_ns == 0 ? 1 : 0;
+        particle_push_constants.delta_time = particle_step_ns == 0 ? 0.0f : float(std::min(double(now - particle_step_ns) * 0.000000001, 0.05));
+        particle_push_constants.time = float(double(now - start_time_ns) * 0.000000001);
+        // Quads of about two pixels in the first window; the simulation runs once for all of them.
+        particle_push_constants.particle_size[0] = 1.0f / float(windows[0].swapchain_extent.width);
+        particle_push_constants.particle_size[1] = 1.0f / float(windows[0].swapchain_extent.height);
+        particle_step_ns = now;
+    }
+    // Every window's mesh pass sees the camera at the same time.
+    mesh_camera_ns = SDL_GetTicksNS();
+
+    // Uploads and culling go to their own queues first, so they overlap with the previous frame's rendering.
+    bool uploads_submitted = submit_uploads(frame);
+    bool culling_submitted = submit_culling(frame, uploads_submitted);
+
+    uint64_t record_start = SDL_GetTicksNS();
+    profiler.begin_cpu_scope("record");
+    vkResetCommandBuffer(frame.command_buffer, 0);
+    record_command_buffer(frame.command_buffer);
+    profiler.end_cpu_scope();
+    frame_stats.record_time_ns += SDL_GetTicksNS() - record_start;
+
+    // One submission for all windows: it waits for every acquired image and signals one semaphore per present.
+    VkSemaphore wait_semaphores[MAX_WINDOWS + 1];
+    VkPipelineStageFlags wait_stages[MAX_WINDOWS + 1];
+    uint32_t wait_count {0};
+    VkSemaphore signal_semaphores[MAX_WINDOWS];
+    VkSwapchainKHR present_swapchains[MAX_WINDOWS];
+    uint32_t present_image_indices[MAX_WINDOWS];
+    uint32_t present_windows[MAX_WINDOWS];
+    uint32_t present_count {0};
+    for (uint32_t i = 0; i < windows.size() && !settings.headless; i++) {
+        WindowSurface &window = windows[i];
+        if (!window.presenting) {
+            continue;
+        }
+        wait_semaphores[wait_count] = window.image_available_semaphores[current_frame];
+        wait_stages[wait_count++] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        signal_semaphores[present_count] = window.render_finished_semaphores[window.image_index];
+        present_swapchains[present_count] = window.swapchain;
+        present_image_indices[present_count] = window.image_index;
+        present_windows[present_count++] = i;
+    }
+    // The compute queue already waited for the uploads, so waiting for it covers both.
+    if (culling_submitted) {
+        wait_semaphores[wait_count] = frame.compute_finished_semaphore;
+        wait_stages[wait_count++] = uploads_submitted ? VK_PIPELINE_STAGE_ALL_COMMANDS_BIT : VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+    } else if (uploads_submitted) {
+        wait_semaphores[wait_count] = frame.transfer_finished_semaphore;
+        wait_stages[wait_count++] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    }
 
     VkSubmitInfo submit_info = {};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = &image_available_semaphore;
+    submit_info.waitSemaphoreCount = wait_count;
+    submit_info.pWaitSemaphores = wait_semaphores;
     submit_info.pWaitDstStageMask = wait_stages;
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = &render_finished_semaphore;
+    submit_info.signalSemaphoreCount = present_count;
+    submit_info.pSignalSemaphores = signal_semaphores;
     submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffer;
+    submit_info.pCommandBuffers = &frame.command_buffer;
+
+    profiler.begin_cpu_scope("submit");
+    profiler.mark_submit();
+    vkQueueSubmit(queue, 1, &submit_info, frame.in_flight_fence);
+    frame.submit_index = ++submit_count;
+    if (p_input_ns != 0) {
+        uint64_t input_latency = SDL_GetTicksNS() - p_input_ns;
+        frame_stats.input_latency_ns += input_latency;
+        frame_stats.input_frame_count++;
+        if (settings.log_latency) {
+            print("Input-to-submit: %.3f ms", double(input_latency) * 0.000001);
+        }
+    }
+    primitive_batch.end();
+    frame_stats.dropped_primitives += primitive_batch.take_dropped_primitives();
+    profiler.end_cpu_scope();
 
-    vkQueueSubmit(queue, 1, &submit_info, gImageAvailableFence);
+    if (settings.headless) {
+        current_frame = (current_frame + 1) % frames.size();
+        update_frame_stats(frame_start);
+        return;
+    }
 
-    VkSwapchainKHR swap_chains[] = {swapchain};
+    VkResult presentation_results[MAX_WINDOWS];
     VkPresentInfoKHR present_info = {};
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    present_info.waitSemaphoreCount = 1;
-    present_info.pWaitSemaphores = &render_finished_semaphore;
-    present_info.swapchainCount = 1;
-    present_info.pSwapchains = swap_chains;
-    present_info.pImageIndices = &image_index;
-    present_info.pResults = nullptr;
-
-    VkResult presentation_result = vkQueuePresentKHR(queue, &present_info);
-    if (presentation_result == VK_ERROR_OUT_OF_DATE_KHR) {
-        recreate_swapchain();
-    }
-}
\ No newline at end of file
+    present_info.waitSemaphoreCount = present_count;
+    present_info.pWaitSemaphores = signal_semaphores;
+    present_info.swapchainCount = present_count;
+    present_info.pSwapchains = present_swapchains;
+    present_info.pImageIndices = present_image_indices;
+    present_info.pResults = presentation_results;
+
+    profiler.begin_cpu_scope("present");
+    vkQueuePresentKHR(queue, &present_info);
+    profiler.end_cpu_scope();
+    uint64_t present_time = SDL_GetTicksNS();
+    uint64_t latency = present_time - frame_pacing.last_acquire_ns;
+    frame_stats.latency_ns += latency;
+    if (settings.log_latency) {
+        print("Acquire-to-present: %.3f ms (%s)", double(latency) * 0.000001, present_mode_name(windows[0].present_mode));
+    }
+
+    // Each swapchain reports on its own, so one out of date window does not recreate the others.
+    for (uint32_t i = 0; i < present_count; i++) {
+        if (presentation_results[i] == VK_ERROR_OUT_OF_DATE_KHR || presentation_results[i] == VK_SUBOPTIMAL_KHR) {
+            windows[present_windows[i]].swapchain_dirty = true;
+        }
+    }
+    for (WindowSurface &window : windows) {
+        if (window.swapchain_dirty) {
+            recreate_swapchain(window);
+        }
+    }
+
+    current_frame = (current_frame + 1) % frames.size();
+    update_frame_stats(frame_start);
+    if (settings.low_latency) {
+        pace_frame(present_time - frame_pacing.last_acquire_ns);
+    }
+}
+
+
+#ifdef SHADER_HOT_RELOAD
+void Renderer::reload_shader(const std::string &p_name, const std::vector<uint32_t> &p_spirv) {
+    // Runs on the reloader thread. Graphics pipelines are rebuilt by the pipeline library, which
+    // swaps all pipelines of a shader at once. Compute pipelines are built here: creation only reads
+    // state that is fixed after initialize(), and the pipeline cache synchronizes itself.
+    const ShaderReflection* built_in = nullptr;
+    if (p_name == "triangle") {
+        built_in = &triangle_reflection;
+    } else if (p_name == "instanced") {
+        built_in = &instanced_reflection;
+    } else if (p_name == "primitives") {
+        built_in = &primitives_reflection;
+    } else if (p_name == "mesh") {
+        built_in = &mesh_reflection;
+    } else if (p_name == "particles") {
+        built_in = &particles_reflection;
+    } else {
+        return;
+    }
+    // Layouts, push constant stages and dispatch sizes were built from the compiled-in reflection.
+    ReflectedShader reflected;
+    std::string error;
+    if (!reflected.reflect(p_name, p_spirv.data(), p_spirv.size() * sizeof(uint32_t), error)) {
+        print("Could not reflect '%s': %s", p_name.c_str(), error.c_str());
+        return;
+    }
+    if (!same_interface(reflected.get(), *built_in)) {
+        print("The interface of '%s' changed, rebuild to pick it up", p_name.c_str());
+        return;
+    }
+
+    if (p_name == "triangle") {
+        pipeline_library.reload_shader(pipeline_key.shader, p_spirv);
+    } else if (p_name == "instanced" && settings.instance_count > 0) {
+        pipeline_library.reload_shader(instance_pipeline_key.shader, p_spirv);
+        if (settings.gpu_culling) {
+            PipelineSwap swap = {&cull_pipeline, UniquePipeline()};
+            if (!create_compute_pipeline(p_spirv.data(), p_spirv.size() * sizeof(uint32_t), instanced_reflection, instance_pipeline_layout, {}, swap.pipeline)) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(reload_mutex);
+            reloaded_pipelines.push_back(std::move(swap));
+        }
+    } else if (p_name == "primitives") {
+        pipeline_library.reload_shader(batch_pipeline_key.shader, p_spirv);
+    } else if (p_name == "mesh" && mesh_header != nullptr) {
+        pipeline_library.reload_shader(mesh_pipeline_key.shader, p_spirv);
+    } else if (p_name == "particles" && settings.particle_count > 0) {
+        pipeline_library.reload_shader(particle_pipeline_key.shader, p_spirv);
+        PipelineSwap swap = {&simulate_pipeline, UniquePipeline()};
+        if (!create_compute_pipeline(p_spirv.data(), p_spirv.size() * sizeof(uint32_t), particles_reflection, particle_pipeline_layout, simulate_specialization, swap.pipeline)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(reload_mutex);
+        reloaded_pipelines.push_back(std::move(swap));
+    } else {
+        return;
+    }
+    print("Reloading pipelines of '%s'", p_name.c_str());
+}
+
+
+void Renderer::apply_reloaded_pipelines() {
+    std::lock_guard<std::mutex> lock(reload_mutex);
+    for (PipelineSwap &swap : reloaded_pipelines) {
+        // Frames in flight may still be using the old pipeline.
+        deletion_queue.push(submit_count, std::move(*swap.target));
+        *swap.target = std::move(swap.pipeline);
+    }
+    reloaded_pipelines.clear();
+}
+#endif
+
+
+void Renderer::pace_frame(uint64_t p_work_time) {
+    FramePacing &pacing = frame_pacing;
+    pacing.work_estimate_ns = pacing.work_estimate_ns == 0 ? p_work_time : (pacing.work_estimate_ns * 7 + p_work_time) / 8;
+
+    uint64_t budget = pacing.work_estimate_ns + FRAME_PACING_MARGIN_NS;
+    if (pacing.refresh_interval_ns == 0 || budget >= pacing.refresh_interval_ns) {
+        return;
+    }
+
+    // Start the next frame just early enough to make the next vblank, so the events
+    // handled before it are as fresh as possible.
+    uint64_t target = pacing.last_acquire_ns + pacing.refresh_interval_ns - budget;
+    uint64_t now = SDL_GetTicksNS();
+    if (target > now) {
+        SDL_DelayPrecise(target - now);
+    }
+}
+
+bool Renderer::save_last_frame(const char* p_path) {
+    if (!settings.headless) {
+        print("Saving frames is only supported in headless mode!");
+        return false;
+    }
+
+    vkDeviceWaitIdle(device);
+    const FrameData &frame = frames[(current_frame + frames.size() - 1) % frames.size()];
+
+    std::ofstream file(p_path, std::ios::binary);
+    if (!file.is_open()) {
+        print("Could not open file '%s'!", p_path);
+        return false;
+    }
+
+    // Binary PPM: trivial to write and readable by every image tool we care about.
+    file << "P6\n" << VIEWPORT_WIDTH << " " << VIEWPORT_HEIGHT << "\n255\n";
+    const uint8_t* pixels = static_cast<const uint8_t*>(frame.readback_allocation.mapped);
+    std::vector<char> row(VIEWPORT_WIDTH * 3);
+    for (int y = 0; y < VIEWPORT_HEIGHT; y++) {
+        for (int x = 0; x < VIEWPORT_WIDTH; x++) {
+            const uint8_t* bgra = pixels + (size_t(y) * VIEWPORT_WIDTH + x) * 4;
+            row[x * 3 + 0] = char(bgra[2]);
+            row[x * 3 + 1] = char(bgra[1]);
+            row[x * 3 + 2] = char(bgra[0]);
+        }
+        file.write(row.data(), row.size());
+    }
+
+    return file.good();
+}
+
+
+bool Renderer::set_recording_threads(uint32_t p_thread_count) {
+    destroy_worker_command_pools();
+    settings.recording_threads = p_thread_count;
+    job_system.start(p_thread_count);
+
+    return create_worker_command_pools();
+}
+
+
+void Renderer::benchmark_recording(uint32_t p_iterations) {
+    uint32_t original_thread_count = settings.recording_threads;
+    uint32_t max_thread_count = std::max(1u, std::thread::hardware_concurrency());
+    // Submit one real frame first, so queued uploads are not swallowed by the benchmark recordings.
+    draw();
+    FrameData &frame = frames[current_frame];
+    // The benchmark re-records this slot's command buffer and uniforms without submitting them,
+    // not those of the frame draw() just submitted.
+    vkWaitForFences(device, 1, frame.in_flight_fence.address(), VK_TRUE, UINT64_MAX);
+
+    print("Recording benchmark: %u draws, %u iterations per thread count", (uint32_t)draw_list.size(), p_iterations);
+
+    // 0 is the inline path without secondary command buffers.
+    for (uint32_t thread_count = 0; thread_count <= max_thread_count; thread_count = thread_count == 0 ? 1 : thread_count * 2) {
+        if (!set_recording_threads(thread_count)) {
+            print("Could not create worker command pools!");
+            break;
+        }
+
+        uint64_t start = SDL_GetTicksNS();
+        for (uint32_t i = 0; i < p_iterations; i++) {
+            // Every recording pushes its draws' uniforms; without starting over the ring fills up and later ones record no draws.
+            uniform_ring.begin(current_frame);
+            vkResetCommandBuffer(frame.command_buffer, 0);
+            record_command_buffer(frame.command_buffer, false);
+        }
+        double ms = double(SDL_GetTicksNS() - start) / double(p_iterations) * 0.000001;
+
+        if (thread_count == 0) {
+            print("  inline:     %.3f ms per frame", ms);
+        } else {
+            print("  %2u threads: %.3f ms per frame", thread_count, ms);
+        }
+    }
+
+    set_recording_threads(original_thread_count);
+}
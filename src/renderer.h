@@ -3,53 +3,461 @@
 #include <vulkan/vulkan.hpp>
 #include <SDL3/SDL_vulkan.h>
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "job_system.h"
+#include "allocator.h"
+#include "staging_ring.h"
+#include "profiler.h"
+#include "vulkan_handle.h"
+#include "deletion_queue.h"
+#include "primitive_batch.h"
+#include "descriptors.h"
+#include "pipeline_library.h"
+#include "shader_layout.h"
+#include "render_graph.h"
+#include "texture_streamer.h"
+#include "mapped_file.h"
+#include "mesh_format.h"
+#include "debug_utils.h"
+#ifdef SHADER_HOT_RELOAD
+#include <mutex>
+#include "shader_reloader.h"
+#endif
+
 constexpr int VIEWPORT_WIDTH{ 800 };
 constexpr int VIEWPORT_HEIGHT{ 800 };
+constexpr uint32_t DEFAULT_FRAMES_IN_FLIGHT{ 2 };
+constexpr VkDeviceSize STAGING_RING_SIZE{ 16 * 1024 * 1024 };
+// Per frame slot, on top of one block per draw in the draw list.
+constexpr VkDeviceSize UNIFORM_RING_SIZE{ 1024 * 1024 };
+constexpr uint32_t BINDLESS_TEXTURE_COUNT{ 4096 };
+constexpr uint32_t BINDLESS_SAMPLER_COUNT{ 32 };
+constexpr uint32_t BINDLESS_STORAGE_BUFFER_COUNT{ 4096 };
+constexpr VkDeviceSize TEXTURE_STAGING_SIZE{ 32 * 1024 * 1024 };
+// One thread per particle in groups of 256, and a dispatch has at least 65535 groups.
+constexpr uint32_t MAX_PARTICLE_COUNT{ 65535 * 256 };
+// Slack on top of the measured CPU work when pacing frames, to absorb GPU time and jitter.
+constexpr uint64_t FRAME_PACING_MARGIN_NS{ 2000000 };
+constexpr uint32_t MAX_WINDOWS{ 8 };
+
+struct RendererSettings {
+    uint32_t frames_in_flight{ DEFAULT_FRAMES_IN_FLIGHT };
+    // Render into device-local images and read them back instead of presenting to a window.
+    bool headless{ false };
+    // Where the VkPipelineCache is loaded from and written back to. Empty disables the cache.
+    std::string pipeline_cache_path{ "pipeline_cache.bin" };
+    // Worker threads recording secondary command buffers. 0 records everything inline.
+    uint32_t recording_threads{ 0 };
+    // Number of draws in the per-frame draw list, to stress command recording.
+    uint32_t draw_count{ 1 };
+    // Instances in the GPU-driven stress scene. 0 draws the plain triangle instead.
+    uint32_t instance_count{ 0 };
+    // Cull and compact instances in a compute pre-pass before the indirect draw.
+    bool gpu_culling{ true };
+    // KTX2 textures streamed in mip by mip and mapped onto the triangles of the draw list.
+    std::vector<std::string> texture_paths;
+    // Device memory the streamed textures may use before the least recently used ones lose mip levels.
+    VkDeviceSize texture_budget{ 256 * 1024 * 1024 };
+    // Particles simulated by a compute shader and drawn straight from its buffer. 0 disables them.
+    uint32_t particle_count{ 0 };
+    // Simulation steps per frame, a specialization constant of the simulate shader.
+    uint32_t particle_substeps{ 1 };
+    // Binary mesh written by tools/meshconv, drawn with a depth buffer underneath the scene. Empty draws none.
+    std::string mesh_path;
+    // Skip the meshlets of the mesh whose normal cone faces away from the camera.
+    bool cluster_culling{ true };
+    // Preferred present mode. Falls back along MAILBOX -> IMMEDIATE -> FIFO when unsupported.
+    VkPresentModeKHR present_mode{ VK_PRESENT_MODE_FIFO_KHR };
+    // Use the smallest swapchain, one frame in flight, and start each frame as late as possible.
+    bool low_latency{ false };
+    // Log the acquire-to-present time of every frame.
+    bool log_latency{ false };
+    // Write every CPU and GPU scope here on exit: a Chrome trace for *.json, CSV otherwise.
+    std::string profile_output_path;
+    // GPU index or part of its name. Empty picks the device with the highest score.
+    std::string device;
+    // Run uploads and culling on dedicated transfer and compute queues when the device has them.
+    bool async_queues{ true };
+    // Vertex arena of the 2D primitive batch, per frame slot.
+    VkDeviceSize batch_arena_size{ 8 * 1024 * 1024 };
+    // Threads compiling graphics pipelines. 0 picks half of the hardware threads.
+    uint32_t pipeline_threads{ 0 };
+    // Compile the known pipelines before the first frame instead of on first use.
+    bool prewarm_pipelines{ true };
+    // Log the passes, barriers and transient memory layout of the render graph at startup.
+    bool dump_render_graph{ false };
+    // Only in builds with the VULKAN_DEBUG CMake option. Skipped with a message when not installed.
+    bool validation{ true };
+    // Object names and command buffer labels for captures, plus the messenger that logs validation messages.
+    bool debug_utils{ true };
+};
+
+// Matches Instance in shaders/src/instanced.slang.
+struct InstanceData {
+    float offset[2];
+    float scale;
+    float rotation;
+    float color[4];
+};
+
+struct InstancePushConstants {
+    uint32_t instance_count;
+    float time;
+};
+
+// Matches PushConstants in shaders/src/particles.slang.
+struct ParticlePushConstants {
+    float particle_size[2];
+    uint32_t buffer_index;
+    uint32_t count;
+    float delta_time;
+    float time;
+    uint32_t reset;
+};
+
+// Matches PushConstants in shaders/src/mesh.slang.
+struct MeshPushConstants {
+    // Row-major, from quantized positions to clip space.
+    float transform[4][4];
+    float light_direction[4];
+};
+
+// Matches VSInput in shaders/src/triangle.slang.
+struct Vertex {
+    float position[2];
+    float color[3];
+};
+
+// Matches DrawUniforms in shaders/src/triangle.slang.
+struct DrawUniforms {
+    // xy: offset in clip space, z: scale.
+    float transform[4];
+    float tint[4];
+    // x: bindless texture index or BINDLESS_INVALID_INDEX, y: sampler index.
+    uint32_t texture[4];
+};
+
+struct DrawCommand {
+    uint32_t index_count;
+    uint32_t instance_count;
+    uint32_t first_index;
+    int32_t vertex_offset;
+    uint32_t first_instance;
+};
+
+// Everything one frame in flight needs, so the CPU can record the next frame
+// while the GPU is still busy with the previous ones.
+struct FrameData {
+    VkCommandBuffer command_buffer;
+    UniqueFence in_flight_fence;
+    // Headless only: host-visible copy of the image this slot rendered last.
+    VkBuffer readback_buffer{ VK_NULL_HANDLE };
+    Allocation readback_allocation;
+    // One pool per recording thread, so workers never share a pool, with a secondary command
+    // buffer per window in each. Indexed by window, then by worker.
+    std::vector<UniqueCommandPool> worker_command_pools;
+    std::vector<VkCommandBuffer> secondary_command_buffers;
+    // Dedicated transfer and async-compute queues only.
+    VkCommandBuffer transfer_command_buffer{ VK_NULL_HANDLE };
+    UniqueSemaphore transfer_finished_semaphore;
+    VkCommandBuffer compute_command_buffer{ VK_NULL_HANDLE };
+    UniqueSemaphore compute_finished_semaphore;
+    // Value of Renderer::submit_count when this slot was last submitted.
+    uint64_t submit_index{ 0 };
+    // Culling output of this slot, so culling the next frame never waits for this one to be drawn.
+    VkBuffer visible_instance_buffer{ VK_NULL_HANDLE };
+    Allocation visible_instance_allocation;
+    VkBuffer indirect_buffer{ VK_NULL_HANDLE };
+    Allocation indirect_allocation;
+    VkDescriptorSet instance_descriptor_set{ VK_NULL_HANDLE };
+    // Vertex shader invocations of the mesh draws, when the device supports pipeline statistics.
+    UniqueQueryPool statistics_query_pool;
+    bool statistics_pending{ false };
+    uint32_t mesh_triangle_count{ 0 };
+};
+
+// Everything tied to one window. The device, pipelines and scene are shared, and each window gets
+// its own scene passes in the render graph. Headless rendering has a single one without a window,
+// whose images are offscreen images owned by the renderer.
+struct WindowSurface {
+    SDL_Window* window{ nullptr };
+    VkSurfaceKHR surface{ VK_NULL_HANDLE };
+    UniqueSwapchain swapchain;
+    VkPresentModeKHR present_mode{ VK_PRESENT_MODE_FIFO_KHR };
+    VkExtent2D swapchain_extent{ VIEWPORT_WIDTH, VIEWPORT_HEIGHT };
+    // Set by resize events and suboptimal results, handled at the start of the next frame.
+    bool swapchain_dirty{ false };
+    // Window size in pixels as of the last resize, so the render thread never asks SDL for it.
+    VkExtent2D window_extent{ VIEWPORT_WIDTH, VIEWPORT_HEIGHT };
+    uint32_t swapchain_image_count{ 0 };
+    std::vector<VkImage> swapchain_images;
+    std::vector<Allocation> offscreen_image_allocations;
+    std::vector<UniqueImageView> swapchain_image_views;
+    std::vector<VkFence> images_in_flight;
+    // One per frame slot.
+    std::vector<UniqueSemaphore> image_available_semaphores;
+    // One per swapchain image, recreated with the swapchain.
+    std::vector<UniqueSemaphore> render_finished_semaphores;
+    // The image acquired for the frame being recorded. With several windows, one that has none,
+    // e.g. while minimized, renders into its 1x1 parked image so the render graph stays the same.
+    uint32_t image_index{ 0 };
+    bool presenting{ false };
+    VkImage parked_image{ VK_NULL_HANDLE };
+    Allocation parked_allocation;
+    UniqueImageView parked_image_view;
+    RenderResource graph_color{ INVALID_RENDER_RESOURCE };
+    // Only with a mesh. A transient image of the render graph that follows the swapchain size.
+    RenderResource graph_depth{ INVALID_RENDER_RESOURCE };
+
+    VkExtent2D get_render_extent() const { return presenting ? swapchain_extent : VkExtent2D{ 1, 1 }; }
+};
+
+struct FrameStats {
+    uint64_t frame_count{ 0 };
+    uint64_t frame_time_ns{ 0 };
+    uint64_t cpu_time_ns{ 0 };
+    uint64_t record_time_ns{ 0 };
+    uint64_t latency_ns{ 0 };
+    // From the oldest input event a frame reflects to its vkQueueSubmit, for frames that had one.
+    uint64_t input_latency_ns{ 0 };
+    uint64_t input_frame_count{ 0 };
+    uint64_t gpu_time_ns{ 0 };
+    uint64_t gpu_frame_count{ 0 };
+    uint64_t particle_time_ns{ 0 };
+    uint64_t particle_frame_count{ 0 };
+    // Only frames whose pipeline statistics were read back.
+    uint64_t mesh_vertex_invocations{ 0 };
+    uint64_t mesh_triangles{ 0 };
+    uint64_t mesh_frame_count{ 0 };
+    uint64_t mesh_meshlets_drawn{ 0 };
+    // Streamed texture bytes at the last report.
+    uint64_t texture_uploaded_bytes{ 0 };
+    uint64_t dropped_primitives{ 0 };
+    uint64_t previous_frame_ns{ 0 };
+    uint64_t last_report_ns{ 0 };
+};
+
+struct FramePacing {
+    uint64_t refresh_interval_ns{ 0 };
+    // Acquire returns right after the display released an image, which approximates vblank.
+    uint64_t last_acquire_ns{ 0 };
+    uint64_t work_estimate_ns{ 0 };
+};
 
 class Renderer {
 
 private:
-    SDL_Window* window{ nullptr };
-    VkInstance instance;
+    RendererSettings settings;
+    VkInstance instance{ VK_NULL_HANDLE };
+#ifdef VULKAN_DEBUG
+    VkDebugUtilsMessengerEXT debug_messenger{ VK_NULL_HANDLE };
+#endif
     VkPhysicalDevice physical_device;
-    VkDevice device;
-    VkSurfaceKHR surface;
+    std::string device_name;
+    VkDevice device{ VK_NULL_HANDLE };
+    // Never resized after initialize(), so render graph passes can refer to windows by index.
+    std::vector<WindowSurface> windows;
     VkQueue queue;
-    VkSwapchainKHR swapchain;
-    uint32_t swapchain_image_count;
-    VkImage* swapchain_images;
-    uint32_t current_image_index;
-    std::vector<VkImageView> swapchain_image_views;
-    std::vector<VkFramebuffer> framebuffers;
-    VkPipeline pipeline;
-    VkRenderPass render_pass;
-    VkPipelineLayout pipeline_layout;
-    VkCommandPool command_pool;
-    VkCommandBuffer command_buffer;
-    VkSemaphore image_available_semaphore;
-    VkSemaphore render_finished_semaphore;
-    VkFence gImageAvailableFence;
+    uint32_t queue_family_index{ 0 };
+    // Equal to queue and queue_family_index when the device has no dedicated family.
+    VkQueue transfer_queue{ VK_NULL_HANDLE };
+    uint32_t transfer_queue_family_index{ 0 };
+    VkQueue compute_queue{ VK_NULL_HANDLE };
+    uint32_t compute_queue_family_index{ 0 };
+    // Number of frames submitted so far, and the highest one known to have finished on the GPU.
+    uint64_t submit_count{ 0 };
+    uint64_t completed_submit{ 0 };
+    DeletionQueue deletion_queue;
+    UniquePipelineCache pipeline_cache;
+    PipelineLibrary pipeline_library;
+    // Looked up in pipeline_library at the start of every frame. VK_NULL_HANDLE while compiling.
+    VkPipeline pipeline{ VK_NULL_HANDLE };
+    PipelineKey pipeline_key;
+    ShaderLayout pipeline_layout;
+    UniqueCommandPool command_pool;
+    UniqueCommandPool transfer_command_pool;
+    UniqueCommandPool compute_command_pool;
+    JobSystem job_system;
+    DeviceAllocator allocator;
+    StagingRing staging_ring;
+    VkBuffer vertex_buffer{ VK_NULL_HANDLE };
+    Allocation vertex_allocation;
+    VkBuffer index_buffer{ VK_NULL_HANDLE };
+    Allocation index_allocation;
+    std::vector<DrawCommand> draw_list;
+    UniformRing uniform_ring;
+    BindlessSet bindless_set;
+    TextureStreamer texture_streamer;
+    std::vector<TextureHandle> textures;
+    // Bindless indices of textures for this frame, resolved before recording so workers only read them.
+    std::vector<uint32_t> texture_indices;
+    uint64_t start_time_ns{ 0 };
+
+    // GPU-driven instancing, only created when settings.instance_count > 0.
+    VkBuffer instance_buffer{ VK_NULL_HANDLE };
+    Allocation instance_allocation;
+    UniqueDescriptorPool instance_descriptor_pool;
+    ShaderLayout instance_pipeline_layout;
+    VkPipeline instance_pipeline{ VK_NULL_HANDLE };
+    PipelineKey instance_pipeline_key;
+    UniquePipeline cull_pipeline;
+    InstancePushConstants instance_push_constants{};
+    // GPU particles, only created when settings.particle_count > 0. The buffer persists across
+    // frames, so every frame simulates on top of the previous one.
+    VkBuffer particle_buffer{ VK_NULL_HANDLE };
+    Allocation particle_allocation;
+    ShaderLayout particle_pipeline_layout;
+    UniquePipeline simulate_pipeline;
+    SpecializationValues simulate_specialization;
+    VkPipeline particle_pipeline{ VK_NULL_HANDLE };
+    PipelineKey particle_pipeline_key;
+    ParticlePushConstants particle_push_constants{};
+    uint64_t particle_step_ns{ 0 };
+    // Mesh from settings.mesh_path. The file stays mapped, so its meshlets are read in place.
+    MappedFile mesh_file;
+    const MeshFileHeader* mesh_header{ nullptr };
+    const Meshlet* mesh_meshlets{ nullptr };
+    VkBuffer mesh_vertex_buffer{ VK_NULL_HANDLE };
+    Allocation mesh_vertex_allocation;
+    VkBuffer mesh_index_buffer{ VK_NULL_HANDLE };
+    Allocation mesh_index_allocation;
+    ShaderLayout mesh_pipeline_layout;
+    VkPipeline mesh_pipeline{ VK_NULL_HANDLE };
+    PipelineKey mesh_pipeline_key;
+    MeshPushConstants mesh_push_constants{};
+    // Model space, for the normal cone test.
+    float mesh_camera_position[3]{};
+    // Every window sees the mesh at the same point of its orbit.
+    uint64_t mesh_camera_ns{ 0 };
+    // Of the depth buffers of all windows.
+    VkFormat depth_format{ VK_FORMAT_UNDEFINED };
+    bool pipeline_statistics{ false };
+    PrimitiveBatch primitive_batch;
+    ShaderLayout batch_pipeline_layout;
+    VkPipeline batch_pipeline{ VK_NULL_HANDLE };
+    VkPipeline batch_line_pipeline{ VK_NULL_HANDLE };
+    PipelineKey batch_pipeline_key;
+    PipelineKey batch_line_pipeline_key;
+    RenderGraph render_graph;
+    RenderResource graph_indirect{ INVALID_RENDER_RESOURCE };
+    RenderResource graph_visible_instances{ INVALID_RENDER_RESOURCE };
+    RenderResource graph_particles{ INVALID_RENDER_RESOURCE };
+    RenderResource graph_readback{ INVALID_RENDER_RESOURCE };
+    std::vector<FrameData> frames;
+    uint32_t current_frame{ 0 };
+    FrameStats frame_stats;
+    FramePacing frame_pacing;
+    Profiler profiler;
+    uint64_t frame_number{ 0 };
+    double last_gpu_time_ms{ -1.0 };
+#ifdef SHADER_HOT_RELOAD
+    struct PipelineSwap {
+        UniquePipeline* target;
+        UniquePipeline pipeline;
+    };
+    ShaderReloader shader_reloader;
+    std::mutex reload_mutex;
+    // Built on the reloader thread, swapped in at the start of the next frame.
+    std::vector<PipelineSwap> reloaded_pipelines;
+#endif
     
     bool create_vulkan_instance(uint32_t p_extension_count, const char* const* p_extensions);
+    int64_t score_physical_device(VkPhysicalDevice p_physical_device);
     bool create_physical_device();
     bool create_device();
-    bool create_swapchain();
-    bool create_image_views();
-    bool create_render_pass();
-    bool create_shader_module(const uint32_t bytes[], const size_t length, VkShaderModule &r_shader_module);
+    bool has_transfer_queue() const { return transfer_queue_family_index != queue_family_index; }
+    bool has_compute_queue() const { return compute_queue_family_index != queue_family_index; }
+    std::vector<uint32_t> get_queue_families() const;
+    // Whether p_queue_family can present to the surfaces of all windows.
+    bool can_present(VkPhysicalDevice p_physical_device, uint32_t p_queue_family) const;
+    VkPresentModeKHR choose_present_mode(const WindowSurface &p_window);
+    VkExtent2D choose_swapchain_extent(const WindowSurface &p_window);
+    bool create_swapchain(WindowSurface &p_window);
+    bool create_offscreen_images(WindowSurface &p_window);
+    bool create_readback_buffers();
+    bool create_image_views(WindowSurface &p_window);
+    bool create_parked_image(WindowSurface &p_window);
+    bool create_shader_module(const uint32_t bytes[], const size_t length, UniqueShaderModule &r_shader_module);
+    bool read_pipeline_cache_file(std::vector<char> &r_data);
+    bool create_pipeline_cache(bool &r_warm);
+    void save_pipeline_cache();
+    bool create_graphics_pipeline(const uint32_t p_code[], const size_t p_code_size, const ShaderReflection &p_reflection, VkPipelineLayout p_layout, const GraphicsPipelineState &p_state, UniquePipeline &r_pipeline);
+    bool create_compute_pipeline(const uint32_t p_code[], const size_t p_code_size, const ShaderReflection &p_reflection, VkPipelineLayout p_layout,
+        const SpecializationValues &p_specialization, UniquePipeline &r_pipeline);
+    bool create_descriptors();
     bool create_pipeline();
-    bool create_framebuffers();
+    std::vector<PipelineKey> get_known_pipelines() const;
+    bool start_pipeline_library();
+    void resolve_pipelines();
+    bool upload_buffer(VkBuffer p_buffer, const void* p_data, VkDeviceSize p_size, bool p_concurrent = false);
+    bool create_geometry_buffers();
+    bool create_instance_buffers();
+    bool create_instance_descriptors();
+    bool create_instance_pipelines();
+    void record_instance_culling(VkCommandBuffer p_command_buffer);
+    void record_culling_ownership(VkCommandBuffer p_command_buffer, bool p_release);
+    void record_instanced_draw(VkCommandBuffer p_command_buffer);
+    bool create_particles();
+    void record_particle_simulation(VkCommandBuffer p_command_buffer);
+    void record_particle_draw(VkCommandBuffer p_command_buffer);
+    bool create_mesh();
+    void update_mesh_camera(VkExtent2D p_extent);
+    void record_mesh(VkCommandBuffer p_command_buffer, uint32_t p_window);
+    bool create_primitive_batch();
     bool create_command_pool();
-    bool create_command_buffer();
-    void record_command_buffer(VkCommandBuffer p_command_buffer, uint32_t p_image_index);
+    bool create_command_buffers();
+    bool submit_uploads(FrameData &p_frame);
+    bool submit_culling(FrameData &p_frame, bool p_wait_for_uploads);
+    bool create_worker_command_pools();
+    void destroy_worker_command_pools();
+    void record_draws(VkCommandBuffer p_command_buffer, VkExtent2D p_extent, size_t p_first, size_t p_count);
+    void record_secondary_command_buffers(uint32_t p_window);
+    bool build_render_graph();
+    void record_scene(VkCommandBuffer p_command_buffer, uint32_t p_window);
+    // Renders into the images of all windows. p_submitted is false for recordings that are thrown
+    // away, which must not consume texture uploads.
+    void record_command_buffer(VkCommandBuffer p_command_buffer, bool p_submitted = true);
     bool create_sync_objects();
     void cleanup_swapchain();
-    void recreate_swapchain();
+    // Everything created from the device, and the device itself.
+    void cleanup_device();
+    bool recreate_swapchain(WindowSurface &p_window);
+    void update_frame_stats(uint64_t p_frame_start);
+    void pace_frame(uint64_t p_work_time);
+#ifdef SHADER_HOT_RELOAD
+    void reload_shader(const std::string &p_name, const std::vector<uint32_t> &p_spirv);
+    void apply_reloaded_pipelines();
+#endif
     
 public:
-    bool initialize(uint32_t p_extension_count, const char* const* p_extensions, SDL_Window* p_window);
+    // Renders to every window in p_windows, up to MAX_WINDOWS, with one submit and one present per
+    // frame. The renderer destroys them in cleanup(). Empty in headless mode.
+    bool initialize(uint32_t p_extension_count, const char* const* p_extensions, const std::vector<SDL_Window*> &p_windows,
+        const RendererSettings &p_settings = RendererSettings());
+    // Also after a failed initialize(), which leaves the renderer partly initialized.
     void cleanup();
-    void draw();
+    // p_input_ns is the SDL_GetTicksNS() time of the oldest input this frame is the first to see, 0 if none.
+    void draw(uint64_t p_input_ns = 0);
+    bool save_last_frame(const char* p_path);
+    bool set_recording_threads(uint32_t p_thread_count);
+    // The size of window p_window changed, so its swapchain is recreated before the next frame.
+    void notify_resized(uint32_t p_window, int p_width, int p_height) {
+        windows[p_window].window_extent = {uint32_t(std::max(p_width, 0)), uint32_t(std::max(p_height, 0))};
+        windows[p_window].swapchain_dirty = true;
+    }
+    // 2D primitives for the next draw(). Waits until the GPU is done with the arena of that frame.
+    PrimitiveBatch& get_primitive_batch();
+    void benchmark_recording(uint32_t p_iterations);
+
+    const RendererSettings& get_settings() const { return settings; }
+    const std::string& get_device_name() const { return device_name; }
+    // Of the first window.
+    const char* get_present_mode_name() const;
+    // GPU time of the most recent frame whose timestamps were read back, negative if unknown.
+    double get_last_gpu_time_ms() const { return last_gpu_time_ms; }
 
     Renderer() {};
     ~Renderer() {};
@@ -0,0 +1,80 @@
+#include "shader_layout.h"
+
+#include <algorithm>
+
+#include "util.h"
+
+
+bool ShaderLayout::create(VkDevice p_device, const ShaderReflection &p_reflection, uint32_t p_push_constant_size,
+    const std::vector<VkDescriptorSetLayout> &p_shared_set_layouts) {
+    uint32_t set_count = std::max(p_reflection.get_set_count(), static_cast<uint32_t>(p_shared_set_layouts.size()));
+    set_layouts.assign(set_count, VK_NULL_HANDLE);
+    for (uint32_t set = 0; set < set_count; set++) {
+        if (set < p_shared_set_layouts.size() && p_shared_set_layouts[set] != VK_NULL_HANDLE) {
+            set_layouts[set] = p_shared_set_layouts[set];
+            continue;
+        }
+
+        // Sets in between the used ones get an empty layout.
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        for (uint32_t i = 0; i < p_reflection.binding_count; i++) {
+            const ShaderBinding &binding = p_reflection.bindings[i];
+            if (binding.set != set) {
+                continue;
+            }
+            if (binding.count == 0) {
+                print("'%s' declares the unbounded array '%s' in set %u, which needs a shared set layout", p_reflection.name, binding.name, set);
+                return false;
+            }
+            VkDescriptorSetLayoutBinding layout_binding = {};
+            layout_binding.binding = binding.binding;
+            layout_binding.descriptorType = binding.type;
+            layout_binding.descriptorCount = binding.count;
+            layout_binding.stageFlags = binding.stages;
+            bindings.push_back(layout_binding);
+        }
+
+        VkDescriptorSetLayoutCreateInfo layout_info = {};
+        layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+        layout_info.pBindings = bindings.data();
+
+        owned_set_layouts.emplace_back();
+        if (vkCreateDescriptorSetLayout(p_device, &layout_info, nullptr, owned_set_layouts.back().put(p_device)) != VK_SUCCESS) {
+            return false;
+        }
+        set_layouts[set] = owned_set_layouts.back();
+    }
+
+    // Both sides have to agree: pushing to stages without push constants is as invalid as reading past what was pushed.
+    if (p_reflection.push_constant_size > p_push_constant_size || (p_reflection.push_constant_size == 0) != (p_push_constant_size == 0)) {
+        print("'%s' declares %u bytes of push constants, but %u are pushed", p_reflection.name, p_reflection.push_constant_size, p_push_constant_size);
+        return false;
+    }
+    push_constant_stages = p_reflection.push_constant_stages;
+
+    VkPushConstantRange push_constant_range = {};
+    push_constant_range.stageFlags = push_constant_stages;
+    push_constant_range.offset = 0;
+    push_constant_range.size = p_push_constant_size;
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = set_count;
+    pipeline_layout_info.pSetLayouts = set_layouts.data();
+    pipeline_layout_info.pushConstantRangeCount = p_push_constant_size > 0 ? 1 : 0;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+    if (vkCreatePipelineLayout(p_device, &pipeline_layout_info, nullptr, pipeline_layout.put(p_device)) != VK_SUCCESS) {
+        print("Could not create pipeline layout!");
+        return false;
+    }
+    return true;
+}
+
+
+void ShaderLayout::reset() {
+    pipeline_layout.reset();
+    set_layouts.clear();
+    owned_set_layouts.clear();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "shader_reflection.h"
+#include "vulkan_handle.h"
+
+// A pipeline layout built from the reflection of a shader. Set layouts shared with other shaders,
+// like the bindless set, are passed in and used as they are; the other sets are created from the
+// bindings the shader declares, visible to the stages that use them.
+class ShaderLayout {
+
+private:
+    std::vector<UniqueDescriptorSetLayout> owned_set_layouts;
+    std::vector<VkDescriptorSetLayout> set_layouts;
+    UniquePipelineLayout pipeline_layout;
+    VkShaderStageFlags push_constant_stages{ 0 };
+
+public:
+    // p_shared_set_layouts[i] is used for set i unless it is VK_NULL_HANDLE. p_push_constant_size is
+    // the size of what the renderer pushes, which the shader's push constants must fit in.
+    bool create(VkDevice p_device, const ShaderReflection &p_reflection, uint32_t p_push_constant_size,
+        const std::vector<VkDescriptorSetLayout> &p_shared_set_layouts = {});
+    void reset();
+
+    operator VkPipelineLayout() const { return pipeline_layout; }
+    VkDescriptorSetLayout get_set_layout(uint32_t p_set) const { return set_layouts[p_set]; }
+    // What vkCmdPushConstants has to be called with.
+    VkShaderStageFlags get_push_constant_stages() const { return push_constant_stages; }
+
+    ShaderLayout() {};
+    ~ShaderLayout() {};
+};
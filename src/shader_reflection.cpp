@@ -0,0 +1,628 @@
+#include "shader_reflection.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+// The part of the SPIR-V specification reflection needs.
+constexpr uint32_t SPIRV_MAGIC{ 0x07230203 };
+constexpr uint32_t SPIRV_HEADER_WORDS{ 5 };
+// From 1.4 on, entry points list every global they use, not just inputs and outputs.
+constexpr uint32_t SPIRV_VERSION_1_4{ 0x00010400 };
+
+enum SpirvOp : uint32_t {
+    SPIRV_OP_NAME = 5,
+    SPIRV_OP_ENTRY_POINT = 15,
+    SPIRV_OP_EXECUTION_MODE = 16,
+    SPIRV_OP_TYPE_BOOL = 20,
+    SPIRV_OP_TYPE_INT = 21,
+    SPIRV_OP_TYPE_FLOAT = 22,
+    SPIRV_OP_TYPE_VECTOR = 23,
+    SPIRV_OP_TYPE_MATRIX = 24,
+    SPIRV_OP_TYPE_IMAGE = 25,
+    SPIRV_OP_TYPE_SAMPLER = 26,
+    SPIRV_OP_TYPE_SAMPLED_IMAGE = 27,
+    SPIRV_OP_TYPE_ARRAY = 28,
+    SPIRV_OP_TYPE_RUNTIME_ARRAY = 29,
+    SPIRV_OP_TYPE_STRUCT = 30,
+    SPIRV_OP_TYPE_POINTER = 32,
+    SPIRV_OP_CONSTANT = 43,
+    SPIRV_OP_SPEC_CONSTANT_TRUE = 48,
+    SPIRV_OP_SPEC_CONSTANT_FALSE = 49,
+    SPIRV_OP_SPEC_CONSTANT = 50,
+    SPIRV_OP_FUNCTION = 54,
+    SPIRV_OP_VARIABLE = 59,
+    SPIRV_OP_DECORATE = 71,
+    SPIRV_OP_MEMBER_DECORATE = 72,
+    SPIRV_OP_TYPE_ACCELERATION_STRUCTURE = 5341,
+};
+
+enum SpirvDecoration : uint32_t {
+    SPIRV_DECORATION_SPEC_ID = 1,
+    SPIRV_DECORATION_BLOCK = 2,
+    SPIRV_DECORATION_BUFFER_BLOCK = 3,
+    SPIRV_DECORATION_ARRAY_STRIDE = 6,
+    SPIRV_DECORATION_MATRIX_STRIDE = 7,
+    SPIRV_DECORATION_BUILT_IN = 11,
+    SPIRV_DECORATION_LOCATION = 30,
+    SPIRV_DECORATION_BINDING = 33,
+    SPIRV_DECORATION_DESCRIPTOR_SET = 34,
+    SPIRV_DECORATION_OFFSET = 35,
+};
+
+enum SpirvStorageClass : uint32_t {
+    SPIRV_STORAGE_UNIFORM_CONSTANT = 0,
+    SPIRV_STORAGE_INPUT = 1,
+    SPIRV_STORAGE_UNIFORM = 2,
+    SPIRV_STORAGE_PUSH_CONSTANT = 9,
+    SPIRV_STORAGE_STORAGE_BUFFER = 12,
+};
+
+constexpr uint32_t SPIRV_EXECUTION_MODE_LOCAL_SIZE{ 17 };
+constexpr uint32_t SPIRV_DIM_BUFFER{ 5 };
+constexpr uint32_t SPIRV_DIM_SUBPASS_DATA{ 6 };
+
+// Everything known about one SPIR-V id.
+struct SpirvId {
+    // The instruction that defines it, for types, constants and variables.
+    const uint32_t* instruction{ nullptr };
+    std::string name;
+    uint32_t set{ UINT32_MAX };
+    uint32_t binding{ UINT32_MAX };
+    uint32_t location{ UINT32_MAX };
+    uint32_t spec_id{ UINT32_MAX };
+    uint32_t array_stride{ 0 };
+    bool built_in{ false };
+    bool block{ false };
+    bool buffer_block{ false };
+    std::vector<uint32_t> member_offsets;
+    std::vector<uint32_t> member_matrix_strides;
+};
+
+struct SpirvEntryPoint {
+    std::string name;
+    VkShaderStageFlagBits stage;
+    uint32_t id;
+    std::vector<uint32_t> interface;
+    uint32_t local_size[3]{};
+};
+
+struct SpirvModule {
+    uint32_t version{ 0 };
+    std::vector<SpirvId> ids;
+    std::vector<SpirvEntryPoint> entry_points;
+    std::vector<uint32_t> variables;
+};
+
+
+static uint32_t get_opcode(const uint32_t* p_instruction) {
+    return p_instruction[0] & 0xffff;
+}
+
+
+static uint32_t get_word_count(const uint32_t* p_instruction) {
+    return p_instruction[0] >> 16;
+}
+
+
+// Literal strings are nul-terminated and padded to whole words.
+static std::string read_string(const uint32_t* p_words, uint32_t p_word_count, uint32_t &r_words_read) {
+    const char* bytes = reinterpret_cast<const char*>(p_words);
+    size_t length = strnlen(bytes, size_t(p_word_count) * sizeof(uint32_t));
+    r_words_read = std::min(p_word_count, uint32_t(length / sizeof(uint32_t) + 1));
+    return std::string(bytes, length);
+}
+
+
+static bool get_stage(uint32_t p_execution_model, VkShaderStageFlagBits &r_stage) {
+    switch (p_execution_model) {
+        case 0: r_stage = VK_SHADER_STAGE_VERTEX_BIT; return true;
+        case 1: r_stage = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT; return true;
+        case 2: r_stage = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT; return true;
+        case 3: r_stage = VK_SHADER_STAGE_GEOMETRY_BIT; return true;
+        case 4: r_stage = VK_SHADER_STAGE_FRAGMENT_BIT; return true;
+        case 5: r_stage = VK_SHADER_STAGE_COMPUTE_BIT; return true;
+        default: return false;
+    }
+}
+
+
+static const uint32_t* get_definition(const SpirvModule &p_module, uint32_t p_id) {
+    return p_id < p_module.ids.size() ? p_module.ids[p_id].instruction : nullptr;
+}
+
+
+static bool get_constant(const SpirvModule &p_module, uint32_t p_id, uint32_t &r_value) {
+    const uint32_t* constant = get_definition(p_module, p_id);
+    if (constant == nullptr || get_opcode(constant) != SPIRV_OP_CONSTANT || get_word_count(constant) < 4) {
+        return false;
+    }
+    r_value = constant[3];
+    return true;
+}
+
+
+// Size in bytes as laid out in a push constant block, following the explicit offsets and strides.
+static bool get_type_size(const SpirvModule &p_module, uint32_t p_type, uint32_t p_matrix_stride, uint32_t &r_size) {
+    const uint32_t* type = get_definition(p_module, p_type);
+    if (type == nullptr) {
+        return false;
+    }
+    uint32_t word_count = get_word_count(type);
+    switch (get_opcode(type)) {
+        case SPIRV_OP_TYPE_BOOL:
+            r_size = 4;
+            return true;
+        case SPIRV_OP_TYPE_INT:
+        case SPIRV_OP_TYPE_FLOAT:
+            r_size = type[2] / 8;
+            return true;
+        case SPIRV_OP_TYPE_VECTOR: {
+            uint32_t component_size {0};
+            if (!get_type_size(p_module, type[2], 0, component_size)) {
+                return false;
+            }
+            r_size = component_size * type[3];
+            return true;
+        }
+        case SPIRV_OP_TYPE_MATRIX: {
+            uint32_t column_size {p_matrix_stride};
+            if (column_size == 0 && !get_type_size(p_module, type[2], 0, column_size)) {
+                return false;
+            }
+            r_size = column_size * type[3];
+            return true;
+        }
+        case SPIRV_OP_TYPE_ARRAY: {
+            uint32_t length {0};
+            uint32_t stride {p_module.ids[p_type].array_stride};
+            if (!get_constant(p_module, type[3], length) || (stride == 0 && !get_type_size(p_module, type[2], p_matrix_stride, stride))) {
+                return false;
+            }
+            r_size = stride * length;
+            return true;
+        }
+        case SPIRV_OP_TYPE_STRUCT: {
+            const SpirvId &id = p_module.ids[p_type];
+            r_size = 0;
+            for (uint32_t i = 0; i + 2 < word_count; i++) {
+                uint32_t member_size {0};
+                uint32_t matrix_stride = i < id.member_matrix_strides.size() ? id.member_matrix_strides[i] : 0;
+                if (i >= id.member_offsets.size() || !get_type_size(p_module, type[i + 2], matrix_stride, member_size)) {
+                    return false;
+                }
+                r_size = std::max(r_size, id.member_offsets[i] + member_size);
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+
+static bool get_descriptor_type(const SpirvModule &p_module, uint32_t p_type, uint32_t p_storage_class, VkDescriptorType &r_type, uint32_t &r_count) {
+    r_count = 1;
+    const uint32_t* type = get_definition(p_module, p_type);
+    while (type != nullptr && (get_opcode(type) == SPIRV_OP_TYPE_ARRAY || get_opcode(type) == SPIRV_OP_TYPE_RUNTIME_ARRAY)) {
+        uint32_t length {0};
+        if (get_opcode(type) == SPIRV_OP_TYPE_RUNTIME_ARRAY) {
+            r_count = 0;
+        } else if (get_constant(p_module, type[3], length)) {
+            r_count *= length;
+        } else {
+            return false;
+        }
+        p_type = type[2];
+        type = get_definition(p_module, p_type);
+    }
+    if (type == nullptr) {
+        return false;
+    }
+
+    switch (get_opcode(type)) {
+        case SPIRV_OP_TYPE_STRUCT:
+            if (p_storage_class == SPIRV_STORAGE_STORAGE_BUFFER || p_module.ids[p_type].buffer_block) {
+                r_type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                return true;
+            }
+            r_type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            return p_module.ids[p_type].block;
+        case SPIRV_OP_TYPE_IMAGE: {
+            // Sampled is 1 for images used with a sampler, 2 for storage images.
+            bool storage = type[7] == 2;
+            if (type[3] == SPIRV_DIM_BUFFER) {
+                r_type = storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+            } else if (type[3] == SPIRV_DIM_SUBPASS_DATA) {
+                r_type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            } else {
+                r_type = storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            }
+            return true;
+        }
+        case SPIRV_OP_TYPE_SAMPLER:
+            r_type = VK_DESCRIPTOR_TYPE_SAMPLER;
+            return true;
+        case SPIRV_OP_TYPE_SAMPLED_IMAGE:
+            r_type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            return true;
+        case SPIRV_OP_TYPE_ACCELERATION_STRUCTURE:
+            r_type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+// Vertex inputs are 32-bit scalars or vectors in the shader, whatever the buffer stores.
+static VkFormat get_vertex_format(const SpirvModule &p_module, uint32_t p_type) {
+    static const VkFormat FORMATS[3][4] = {
+        {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT},
+        {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT},
+        {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT},
+    };
+    const uint32_t* type = get_definition(p_module, p_type);
+    uint32_t component_count {1};
+    if (type != nullptr && get_opcode(type) == SPIRV_OP_TYPE_VECTOR) {
+        component_count = type[3];
+        type = get_definition(p_module, type[2]);
+    }
+    if (type == nullptr || component_count < 1 || component_count > 4 || type[2] != 32) {
+        return VK_FORMAT_UNDEFINED;
+    }
+    if (get_opcode(type) == SPIRV_OP_TYPE_FLOAT) {
+        return FORMATS[0][component_count - 1];
+    }
+    if (get_opcode(type) == SPIRV_OP_TYPE_INT) {
+        return FORMATS[type[3] != 0 ? 1 : 2][component_count - 1];
+    }
+    return VK_FORMAT_UNDEFINED;
+}
+
+
+static bool parse_module(const uint32_t* p_code, size_t p_word_count, SpirvModule &r_module, std::string &r_error) {
+    if (p_word_count < SPIRV_HEADER_WORDS || p_code[0] != SPIRV_MAGIC) {
+        r_error = "not a SPIR-V module";
+        return false;
+    }
+    r_module.version = p_code[1];
+    r_module.ids.resize(p_code[3]);
+
+    // Everything reflection needs is declared before the first function.
+    size_t offset = SPIRV_HEADER_WORDS;
+    while (offset < p_word_count) {
+        const uint32_t* instruction = p_code + offset;
+        uint32_t word_count = get_word_count(instruction);
+        uint32_t opcode = get_opcode(instruction);
+        if (word_count == 0 || offset + word_count > p_word_count) {
+            r_error = "truncated instruction";
+            return false;
+        }
+        if (opcode == SPIRV_OP_FUNCTION) {
+            break;
+        }
+        offset += word_count;
+
+        // Names, decorations and types have their id in word 1, constants and variables in word 2.
+        uint32_t target = word_count > 1 ? instruction[1] : 0;
+        uint32_t result = word_count > 2 ? instruction[2] : 0;
+        bool result_in_word_2 = opcode == SPIRV_OP_CONSTANT || opcode == SPIRV_OP_SPEC_CONSTANT_TRUE || opcode == SPIRV_OP_SPEC_CONSTANT_FALSE
+            || opcode == SPIRV_OP_SPEC_CONSTANT || opcode == SPIRV_OP_VARIABLE;
+        if ((result_in_word_2 ? result : opcode == SPIRV_OP_ENTRY_POINT ? 0 : target) >= r_module.ids.size()) {
+            r_error = "id out of bounds";
+            return false;
+        }
+        uint32_t read {0};
+        switch (opcode) {
+            case SPIRV_OP_NAME:
+                r_module.ids[target].name = read_string(instruction + 2, word_count - 2, read);
+                break;
+            case SPIRV_OP_ENTRY_POINT: {
+                SpirvEntryPoint entry_point;
+                if (word_count < 4 || !get_stage(instruction[1], entry_point.stage)) {
+                    r_error = "unsupported execution model";
+                    return false;
+                }
+                entry_point.id = instruction[2];
+                entry_point.name = read_string(instruction + 3, word_count - 3, read);
+                entry_point.interface.assign(instruction + 3 + read, instruction + word_count);
+                r_module.entry_points.push_back(std::move(entry_point));
+                break;
+            }
+            case SPIRV_OP_EXECUTION_MODE:
+                if (word_count >= 6 && instruction[2] == SPIRV_EXECUTION_MODE_LOCAL_SIZE) {
+                    for (SpirvEntryPoint &entry_point : r_module.entry_points) {
+                        if (entry_point.id == instruction[1]) {
+                            std::copy(instruction + 3, instruction + 6, entry_point.local_size);
+                        }
+                    }
+                }
+                break;
+            case SPIRV_OP_DECORATE: {
+                SpirvId &id = r_module.ids[target];
+                uint32_t value = word_count > 3 ? instruction[3] : 0;
+                switch (word_count > 2 ? instruction[2] : UINT32_MAX) {
+                    case SPIRV_DECORATION_SPEC_ID: id.spec_id = value; break;
+                    case SPIRV_DECORATION_BLOCK: id.block = true; break;
+                    case SPIRV_DECORATION_BUFFER_BLOCK: id.buffer_block = true; break;
+                    case SPIRV_DECORATION_ARRAY_STRIDE: id.array_stride = value; break;
+                    case SPIRV_DECORATION_BUILT_IN: id.built_in = true; break;
+                    case SPIRV_DECORATION_LOCATION: id.location = value; break;
+                    case SPIRV_DECORATION_BINDING: id.binding = value; break;
+                    case SPIRV_DECORATION_DESCRIPTOR_SET: id.set = value; break;
+                    default: break;
+                }
+                break;
+            }
+            case SPIRV_OP_MEMBER_DECORATE: {
+                if (word_count < 5) {
+                    break;
+                }
+                SpirvId &id = r_module.ids[target];
+                uint32_t member = instruction[2];
+                std::vector<uint32_t>* values = instruction[3] == SPIRV_DECORATION_OFFSET ? &id.member_offsets
+                    : instruction[3] == SPIRV_DECORATION_MATRIX_STRIDE ? &id.member_matrix_strides : nullptr;
+                if (values != nullptr && member < 0xffff) {
+                    values->resize(std::max<size_t>(values->size(), member + 1), 0);
+                    (*values)[member] = instruction[4];
+                }
+                break;
+            }
+            case SPIRV_OP_CONSTANT:
+            case SPIRV_OP_SPEC_CONSTANT_TRUE:
+            case SPIRV_OP_SPEC_CONSTANT_FALSE:
+            case SPIRV_OP_SPEC_CONSTANT:
+                r_module.ids[result].instruction = instruction;
+                break;
+            case SPIRV_OP_VARIABLE:
+                if (word_count < 4) {
+                    r_error = "truncated variable";
+                    return false;
+                }
+                r_module.ids[result].instruction = instruction;
+                r_module.variables.push_back(result);
+                break;
+            default:
+                // Types define their result in word 1.
+                if ((opcode >= SPIRV_OP_TYPE_BOOL && opcode <= SPIRV_OP_TYPE_POINTER) || opcode == SPIRV_OP_TYPE_ACCELERATION_STRUCTURE) {
+                    r_module.ids[target].instruction = instruction;
+                }
+                break;
+        }
+    }
+    if (r_module.entry_points.empty()) {
+        r_error = "no entry points";
+        return false;
+    }
+    return true;
+}
+
+
+const char* ReflectedShader::add_string(const std::string &p_string) {
+    strings.push_back(p_string);
+    return strings.back().c_str();
+}
+
+
+bool ReflectedShader::reflect(const std::string &p_name, const uint32_t* p_code, size_t p_code_size, std::string &r_error) {
+    SpirvModule module;
+    if (!parse_module(p_code, p_code_size / sizeof(uint32_t), module, r_error)) {
+        return false;
+    }
+    name = p_name;
+
+    for (const SpirvEntryPoint &entry_point : module.entry_points) {
+        entry_points.push_back({add_string(entry_point.name), entry_point.stage,
+            {entry_point.local_size[0], entry_point.local_size[1], entry_point.local_size[2]}});
+    }
+
+    for (uint32_t variable : module.variables) {
+        const SpirvId &id = module.ids[variable];
+        uint32_t storage_class = id.instruction[3];
+        const uint32_t* pointer = get_definition(module, id.instruction[1]);
+        if (pointer == nullptr || get_opcode(pointer) != SPIRV_OP_TYPE_POINTER) {
+            r_error = "variable '" + id.name + "' is not a pointer";
+            return false;
+        }
+        uint32_t type = pointer[3];
+
+        // Older modules only list inputs and outputs, so anything else may be used by any stage.
+        VkShaderStageFlags stages {0};
+        for (const SpirvEntryPoint &entry_point : module.entry_points) {
+            bool listed = std::find(entry_point.interface.begin(), entry_point.interface.end(), variable) != entry_point.interface.end();
+            if (listed || (module.version < SPIRV_VERSION_1_4 && storage_class != SPIRV_STORAGE_INPUT)) {
+                stages |= entry_point.stage;
+            }
+        }
+        if (stages == 0) {
+            continue;
+        }
+
+        if (storage_class == SPIRV_STORAGE_PUSH_CONSTANT) {
+            uint32_t size {0};
+            if (!get_type_size(module, type, 0, size)) {
+                r_error = "cannot size push constants '" + id.name + "'";
+                return false;
+            }
+            push_constant_size = std::max(push_constant_size, size);
+            push_constant_stages |= stages;
+        } else if (storage_class == SPIRV_STORAGE_INPUT) {
+            if (!(stages & VK_SHADER_STAGE_VERTEX_BIT) || id.built_in || id.location == UINT32_MAX) {
+                continue;
+            }
+            VkFormat format = get_vertex_format(module, type);
+            if (format == VK_FORMAT_UNDEFINED) {
+                r_error = "vertex input '" + id.name + "' is not a 32-bit scalar or vector";
+                return false;
+            }
+            vertex_inputs.push_back({id.location, format, add_string(id.name)});
+        } else if (id.set != UINT32_MAX && id.binding != UINT32_MAX) {
+            ShaderBinding binding = {id.set, id.binding, VK_DESCRIPTOR_TYPE_MAX_ENUM, 1, stages, nullptr};
+            if (!get_descriptor_type(module, type, storage_class, binding.type, binding.count)) {
+                r_error = "unsupported resource type of '" + id.name + "'";
+                return false;
+            }
+            // Aliases of one binding, e.g. read-only and read-write views of a storage buffer.
+            auto existing = std::find_if(bindings.begin(), bindings.end(), [&](const ShaderBinding &p_binding) {
+                return p_binding.set == binding.set && p_binding.binding == binding.binding;
+            });
+            if (existing == bindings.end()) {
+                binding.name = add_string(id.name);
+                bindings.push_back(binding);
+            } else if (existing->type == binding.type && existing->count == binding.count) {
+                existing->stages |= binding.stages;
+            } else {
+                r_error = "'" + id.name + "' and '" + existing->name + "' share a binding with different types";
+                return false;
+            }
+        }
+    }
+
+    for (const SpirvId &id : module.ids) {
+        if (id.spec_id == UINT32_MAX || id.instruction == nullptr) {
+            continue;
+        }
+        uint32_t opcode = get_opcode(id.instruction);
+        uint32_t value {opcode == SPIRV_OP_SPEC_CONSTANT_TRUE ? 1u : 0u};
+        if (opcode == SPIRV_OP_SPEC_CONSTANT) {
+            // One literal word means a 32-bit constant.
+            if (get_word_count(id.instruction) != 4) {
+                r_error = "specialization constant '" + id.name + "' is not 32 bits";
+                return false;
+            }
+            value = id.instruction[3];
+        } else if (opcode != SPIRV_OP_SPEC_CONSTANT_TRUE && opcode != SPIRV_OP_SPEC_CONSTANT_FALSE) {
+            continue;
+        }
+        if (id.spec_id >= MAX_SPECIALIZATION_CONSTANTS) {
+            r_error = "specialization constant '" + id.name + "' has an id above MAX_SPECIALIZATION_CONSTANTS";
+            return false;
+        }
+        specialization_constants.push_back({id.spec_id, value, add_string(id.name)});
+    }
+
+    std::sort(bindings.begin(), bindings.end(), [](const ShaderBinding &p_a, const ShaderBinding &p_b) {
+        return p_a.set != p_b.set ? p_a.set < p_b.set : p_a.binding < p_b.binding;
+    });
+    std::sort(vertex_inputs.begin(), vertex_inputs.end(), [](const ShaderVertexInput &p_a, const ShaderVertexInput &p_b) {
+        return p_a.location < p_b.location;
+    });
+    std::sort(specialization_constants.begin(), specialization_constants.end(), [](const ShaderSpecializationConstant &p_a, const ShaderSpecializationConstant &p_b) {
+        return p_a.id < p_b.id;
+    });
+    return true;
+}
+
+
+ShaderReflection ReflectedShader::get() const {
+    ShaderReflection reflection = {};
+    reflection.name = name.c_str();
+    reflection.entry_points = entry_points.empty() ? nullptr : entry_points.data();
+    reflection.entry_point_count = static_cast<uint32_t>(entry_points.size());
+    reflection.bindings = bindings.empty() ? nullptr : bindings.data();
+    reflection.binding_count = static_cast<uint32_t>(bindings.size());
+    reflection.vertex_inputs = vertex_inputs.empty() ? nullptr : vertex_inputs.data();
+    reflection.vertex_input_count = static_cast<uint32_t>(vertex_inputs.size());
+    reflection.specialization_constants = specialization_constants.empty() ? nullptr : specialization_constants.data();
+    reflection.specialization_constant_count = static_cast<uint32_t>(specialization_constants.size());
+    reflection.push_constant_size = push_constant_size;
+    reflection.push_constant_stages = push_constant_stages;
+    return reflection;
+}
+
+
+const ShaderEntryPoint* ShaderReflection::find_entry_point(VkShaderStageFlagBits p_stage) const {
+    for (uint32_t i = 0; i < entry_point_count; i++) {
+        if (entry_points[i].stage == p_stage) {
+            return &entry_points[i];
+        }
+    }
+    return nullptr;
+}
+
+
+const ShaderSpecializationConstant* ShaderReflection::find_specialization_constant(const char* p_name) const {
+    for (uint32_t i = 0; i < specialization_constant_count; i++) {
+        if (strcmp(specialization_constants[i].name, p_name) == 0) {
+            return &specialization_constants[i];
+        }
+    }
+    return nullptr;
+}
+
+
+uint32_t ShaderReflection::get_set_count() const {
+    return binding_count > 0 ? bindings[binding_count - 1].set + 1 : 0;
+}
+
+
+bool same_interface(const ShaderReflection &p_a, const ShaderReflection &p_b) {
+    if (p_a.entry_point_count != p_b.entry_point_count || p_a.binding_count != p_b.binding_count
+        || p_a.vertex_input_count != p_b.vertex_input_count || p_a.specialization_constant_count != p_b.specialization_constant_count
+        || p_a.push_constant_size != p_b.push_constant_size || p_a.push_constant_stages != p_b.push_constant_stages) {
+        return false;
+    }
+    for (uint32_t i = 0; i < p_a.entry_point_count; i++) {
+        const ShaderEntryPoint &a = p_a.entry_points[i];
+        const ShaderEntryPoint &b = p_b.entry_points[i];
+        if (a.stage != b.stage || strcmp(a.name, b.name) != 0 || !std::equal(a.local_size, a.local_size + 3, b.local_size)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < p_a.binding_count; i++) {
+        const ShaderBinding &a = p_a.bindings[i];
+        const ShaderBinding &b = p_b.bindings[i];
+        if (a.set != b.set || a.binding != b.binding || a.type != b.type || a.count != b.count || a.stages != b.stages) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < p_a.vertex_input_count; i++) {
+        if (p_a.vertex_inputs[i].location != p_b.vertex_inputs[i].location || p_a.vertex_inputs[i].format != p_b.vertex_inputs[i].format) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < p_a.specialization_constant_count; i++) {
+        if (p_a.specialization_constants[i].id != p_b.specialization_constants[i].id
+            || strcmp(p_a.specialization_constants[i].name, p_b.specialization_constants[i].name) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool SpecializationValues::set(const ShaderReflection &p_reflection, const char* p_name, uint32_t p_value) {
+    const ShaderSpecializationConstant* constant = p_reflection.find_specialization_constant(p_name);
+    if (constant == nullptr) {
+        return false;
+    }
+    mask |= 1u << constant->id;
+    values[constant->id] = p_value;
+    return true;
+}
+
+
+const VkSpecializationInfo* SpecializationValues::get_info(VkSpecializationMapEntry r_entries[MAX_SPECIALIZATION_CONSTANTS], VkSpecializationInfo &r_info) const {
+    uint32_t count {0};
+    for (uint32_t id = 0; id < MAX_SPECIALIZATION_CONSTANTS; id++) {
+        if (mask & (1u << id)) {
+            r_entries[count++] = {id, id * uint32_t(sizeof(uint32_t)), sizeof(uint32_t)};
+        }
+    }
+    if (count == 0) {
+        return nullptr;
+    }
+    r_info = {};
+    r_info.mapEntryCount = count;
+    r_info.pMapEntries = r_entries;
+    r_info.dataSize = sizeof(values);
+    r_info.pData = values;
+    return &r_info;
+}
+
+
+bool SpecializationValues::operator==(const SpecializationValues &p_other) const {
+    // Unset values are always 0, see set().
+    return mask == p_other.mask && std::equal(values, values + MAX_SPECIALIZATION_CONSTANTS, p_other.values);
+}
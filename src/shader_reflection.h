@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Specialization constant ids a pipeline can set, 0 to MAX_SPECIALIZATION_CONSTANTS - 1.
+constexpr uint32_t MAX_SPECIALIZATION_CONSTANTS{ 8 };
+
+struct ShaderEntryPoint {
+    const char* name;
+    VkShaderStageFlagBits stage;
+    // numthreads of compute entry points, 0 otherwise.
+    uint32_t local_size[3];
+};
+
+struct ShaderBinding {
+    uint32_t set;
+    uint32_t binding;
+    VkDescriptorType type;
+    // 0 for an unbounded array.
+    uint32_t count;
+    // The entry points that use it.
+    VkShaderStageFlags stages;
+    const char* name;
+};
+
+struct ShaderVertexInput {
+    uint32_t location;
+    // What the shader reads, e.g. R32G32_SFLOAT for a float2. The vertex buffer may store it in any
+    // format that converts to the same numeric type, e.g. R16G16_UNORM.
+    VkFormat format;
+    const char* name;
+};
+
+struct ShaderSpecializationConstant {
+    uint32_t id;
+    // The 32 bits of the default value; booleans are 0 or 1.
+    uint32_t default_value;
+    const char* name;
+};
+
+// The interface of a shader module, read from its SPIR-V. shaders/compile.sh writes one per shader
+// to shaders/bin/<name>_reflection.h with tools/shader_reflect, so pipeline layouts, entry point
+// names and specialization constant ids follow the shader source instead of being repeated here.
+struct ShaderReflection {
+    const char* name;
+    const ShaderEntryPoint* entry_points;
+    uint32_t entry_point_count;
+    // Sorted by set and binding.
+    const ShaderBinding* bindings;
+    uint32_t binding_count;
+    const ShaderVertexInput* vertex_inputs;
+    uint32_t vertex_input_count;
+    const ShaderSpecializationConstant* specialization_constants;
+    uint32_t specialization_constant_count;
+    uint32_t push_constant_size;
+    VkShaderStageFlags push_constant_stages;
+
+    // nullptr if the shader has no entry point for p_stage.
+    const ShaderEntryPoint* find_entry_point(VkShaderStageFlagBits p_stage) const;
+    const ShaderSpecializationConstant* find_specialization_constant(const char* p_name) const;
+    // One past the highest set the shader uses.
+    uint32_t get_set_count() const;
+};
+
+// Whether pipelines built for p_a also fit p_b: same entry points, bindings, push constants,
+// vertex inputs and specialization constants. Names of resources may differ.
+bool same_interface(const ShaderReflection &p_a, const ShaderReflection &p_b);
+
+// Values for the specialization constants of a pipeline, by id. Constants that are not set keep
+// the default the shader declares.
+struct SpecializationValues {
+    uint32_t mask{ 0 };
+    uint32_t values[MAX_SPECIALIZATION_CONSTANTS]{};
+
+    // By name, so ids are only written in the shader. False if p_reflection has no such constant.
+    bool set(const ShaderReflection &p_reflection, const char* p_name, uint32_t p_value);
+    // Fills r_entries and r_info from the set values. nullptr if none are set.
+    const VkSpecializationInfo* get_info(VkSpecializationMapEntry r_entries[MAX_SPECIALIZATION_CONSTANTS], VkSpecializationInfo &r_info) const;
+
+    bool operator==(const SpecializationValues &p_other) const;
+};
+
+// A ShaderReflection that owns its arrays, read from SPIR-V at runtime: by tools/shader_reflect,
+// and to check that a hot-reloaded shader kept the interface its pipelines were built for.
+class ReflectedShader {
+
+private:
+    std::string name;
+    std::vector<ShaderEntryPoint> entry_points;
+    std::vector<ShaderBinding> bindings;
+    std::vector<ShaderVertexInput> vertex_inputs;
+    std::vector<ShaderSpecializationConstant> specialization_constants;
+    uint32_t push_constant_size{ 0 };
+    VkShaderStageFlags push_constant_stages{ 0 };
+    // Backing storage of the names above; a deque never moves its elements.
+    std::deque<std::string> strings;
+
+    const char* add_string(const std::string &p_string);
+
+public:
+    // False with a reason in r_error if the module is not SPIR-V or declares something the
+    // renderer has no Vulkan equivalent for, e.g. 64-bit specialization constants.
+    bool reflect(const std::string &p_name, const uint32_t* p_code, size_t p_code_size, std::string &r_error);
+
+    ShaderReflection get() const;
+
+    ReflectedShader(const ReflectedShader&) = delete;
+    ReflectedShader& operator=(const ReflectedShader&) = delete;
+
+    ReflectedShader() {};
+    ~ReflectedShader() {};
+};
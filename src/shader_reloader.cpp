@@ -0,0 +1,144 @@
+#include "shader_reloader.h"
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <set>
+
+#include "util.h"
+
+constexpr int RELOAD_POLL_MS{ 100 };
+// Editors often save in several steps; changes within this window are compiled once.
+constexpr int RELOAD_DEBOUNCE_MS{ 50 };
+
+
+// Drains the queued events and collects the names of changed .slang files.
+static void read_events(int p_fd, std::set<std::string> &r_names) {
+    const std::string extension = ".slang";
+    alignas(inotify_event) char buffer[4096];
+    ssize_t length;
+
+    while ((length = read(p_fd, buffer, sizeof(buffer))) > 0) {
+        for (char* position = buffer; position < buffer + length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(position);
+            std::string file_name = event->len > 0 ? event->name : "";
+            if (file_name.size() > extension.size() && file_name.compare(file_name.size() - extension.size(), extension.size(), extension) == 0) {
+                r_names.insert(file_name.substr(0, file_name.size() - extension.size()));
+            }
+            position += sizeof(inotify_event) + event->len;
+        }
+    }
+}
+
+
+bool ShaderReloader::start(const std::string &p_source_directory, const std::string &p_compiler,
+    std::function<void(const std::string&, const std::vector<uint32_t>&)> p_on_compiled) {
+    stop();
+
+    source_directory = p_source_directory;
+    compiler = p_compiler;
+    on_compiled = std::move(p_on_compiled);
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        print("Could not initialize inotify!");
+        return false;
+    }
+    // Saving through a temporary file and renaming it over the source shows up as IN_MOVED_TO.
+    if (inotify_add_watch(inotify_fd, source_directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        print("Could not watch '%s'!", source_directory.c_str());
+        close(inotify_fd);
+        inotify_fd = -1;
+        return false;
+    }
+
+    running = true;
+    thread = std::thread(&ShaderReloader::watch_loop, this);
+    print("Watching '%s' for shader changes", source_directory.c_str());
+    return true;
+}
+
+
+void ShaderReloader::stop() {
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+}
+
+
+void ShaderReloader::watch_loop() {
+    pollfd poll_fd = {inotify_fd, POLLIN, 0};
+
+    while (running) {
+        if (poll(&poll_fd, 1, RELOAD_POLL_MS) <= 0) {
+            continue;
+        }
+
+        std::set<std::string> names;
+        read_events(inotify_fd, names);
+        while (running && poll(&poll_fd, 1, RELOAD_DEBOUNCE_MS) > 0) {
+            read_events(inotify_fd, names);
+        }
+
+        for (const std::string &name : names) {
+            std::vector<uint32_t> spirv;
+            if (running && compile(name, spirv)) {
+                on_compiled(name, spirv);
+            }
+        }
+    }
+}
+
+
+bool ShaderReloader::compile(const std::string &p_name, std::vector<uint32_t> &r_spirv) {
+    uint64_t start = SDL_GetTicksNS();
+    std::string source = source_directory + "/" + p_name + ".slang";
+    std::string output = (std::filesystem::temp_directory_path() / (p_name + "." + std::to_string(getpid()) + ".spv")).string();
+
+    // Same flags as shaders/compile.sh, so entry points keep the names the pipelines use.
+    std::string command = "\"" + compiler + "\" -target spirv -emit-spirv-directly -fvk-use-entrypoint-name -o \""
+        + output + "\" \"" + source + "\" 2>&1";
+    FILE* pipe = popen(command.c_str(), "r");
+    if (pipe == nullptr) {
+        print("Could not run '%s'!", compiler.c_str());
+        return false;
+    }
+    std::string diagnostics;
+    char line[512];
+    while (fgets(line, sizeof(line), pipe) != nullptr) {
+        diagnostics += line;
+    }
+    if (pclose(pipe) != 0) {
+        print("Could not compile '%s', keeping the previous version:\n%s", source.c_str(), diagnostics.c_str());
+        std::remove(output.c_str());
+        return false;
+    }
+
+    std::ifstream file(output, std::ios::ate | std::ios::binary);
+    size_t file_size = file.is_open() ? (size_t) file.tellg() : 0;
+    if (file_size == 0 || file_size % sizeof(uint32_t) != 0) {
+        print("Could not read SPIR-V of '%s'!", source.c_str());
+        return false;
+    }
+    r_spirv.resize(file_size / sizeof(uint32_t));
+    file.seekg(0);
+    bool success = bool(file.read(reinterpret_cast<char*>(r_spirv.data()), file_size));
+    file.close();
+    std::remove(output.c_str());
+    if (!success) {
+        print("Could not read SPIR-V of '%s'!", source.c_str());
+        return false;
+    }
+
+    print("Compiled '%s' in %.3f ms", source.c_str(), double(SDL_GetTicksNS() - start) * 0.000001);
+    return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Watches a directory of Slang sources with inotify and recompiles every saved file with
+// slangc on a background thread. SPIR-V that compiled is handed to the callback on that
+// thread; failures are only logged, so whatever was built last stays in use.
+class ShaderReloader {
+
+private:
+    std::string source_directory;
+    std::string compiler;
+    std::function<void(const std::string&, const std::vector<uint32_t>&)> on_compiled;
+    int inotify_fd{ -1 };
+    std::atomic<bool> running{ false };
+    std::thread thread;
+
+    void watch_loop();
+    bool compile(const std::string &p_name, std::vector<uint32_t> &r_spirv);
+
+public:
+    // p_on_compiled gets the file name without extension, e.g. "triangle" for triangle.slang.
+    bool start(const std::string &p_source_directory, const std::string &p_compiler,
+        std::function<void(const std::string&, const std::vector<uint32_t>&)> p_on_compiled);
+    void stop();
+
+    ShaderReloader() {};
+    ~ShaderReloader() { stop(); };
+};
@@ -0,0 +1,174 @@
+#include "staging_ring.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Generous enough for any texel block or vertex format we copy from.
+constexpr VkDeviceSize STAGING_ALIGNMENT{ 16 };
+
+// Everything an uploaded buffer may be consumed by.
+constexpr VkPipelineStageFlags2 UPLOAD_CONSUMER_STAGES{ VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT
+    | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT };
+constexpr VkAccessFlags2 UPLOAD_CONSUMER_ACCESS{ VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT | VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT
+    | VK_ACCESS_2_UNIFORM_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT };
+
+
+bool StagingRing::initialize(DeviceAllocator &p_allocator, VkDeviceSize p_capacity, uint32_t p_frame_count) {
+    capacity = p_capacity;
+    frame_heads.assign(p_frame_count, 0);
+
+    VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    return p_allocator.create_buffer(capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, properties, AllocationStrategy::POOL, buffer, allocation);
+}
+
+
+void StagingRing::cleanup(DeviceAllocator &p_allocator) {
+    if (buffer != VK_NULL_HANDLE) {
+        p_allocator.destroy_buffer(buffer, allocation);
+    }
+    pending_copies.clear();
+    released_buffers.clear();
+}
+
+
+bool StagingRing::upload(VkBuffer p_destination, VkDeviceSize p_destination_offset, const void* p_data, VkDeviceSize p_size, bool p_concurrent) {
+    uint64_t start = (head + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+    // Copies must be contiguous, so skip the rest of the buffer when the upload would wrap.
+    if (start % capacity + p_size > capacity) {
+        start += capacity - start % capacity;
+    }
+    if (p_size > capacity || start + p_size - tail > capacity) {
+        return false;
+    }
+
+    VkDeviceSize offset = start % capacity;
+    memcpy(static_cast<char*>(allocation.mapped) + offset, p_data, p_size);
+    head = start + p_size;
+    uploaded_bytes += p_size;
+
+    VkBufferCopy region = {};
+    region.srcOffset = offset;
+    region.dstOffset = p_destination_offset;
+    region.size = p_size;
+    pending_copies.push_back({p_destination, region, p_concurrent});
+
+    return true;
+}
+
+
+void StagingRing::record_copies(VkCommandBuffer p_command_buffer) {
+    // Group by destination so each buffer gets a single copy command with all its regions.
+    std::stable_sort(pending_copies.begin(), pending_copies.end(), [](const PendingCopy &a, const PendingCopy &b) {
+        return a.destination < b.destination;
+    });
+
+    std::vector<VkBufferCopy> regions;
+    for (size_t i = 0; i < pending_copies.size();) {
+        VkBuffer destination = pending_copies[i].destination;
+        regions.clear();
+        for (; i < pending_copies.size() && pending_copies[i].destination == destination; i++) {
+            regions.push_back(pending_copies[i].region);
+        }
+        vkCmdCopyBuffer(p_command_buffer, buffer, destination, static_cast<uint32_t>(regions.size()), regions.data());
+    }
+}
+
+
+void StagingRing::flush(VkCommandBuffer p_command_buffer, uint32_t p_frame) {
+    frame_heads[p_frame] = head;
+    if (pending_copies.empty()) {
+        return;
+    }
+
+    record_copies(p_command_buffer);
+    pending_copies.clear();
+
+    VkMemoryBarrier2 barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.dstStageMask = UPLOAD_CONSUMER_STAGES;
+    barrier.dstAccessMask = UPLOAD_CONSUMER_ACCESS;
+
+    VkDependencyInfo dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.memoryBarrierCount = 1;
+    dependency_info.pMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(p_command_buffer, &dependency_info);
+}
+
+
+void StagingRing::flush_release(VkCommandBuffer p_command_buffer, uint32_t p_frame, uint32_t p_src_queue_family, uint32_t p_dst_queue_family) {
+    frame_heads[p_frame] = head;
+    if (pending_copies.empty()) {
+        return;
+    }
+
+    record_copies(p_command_buffer);
+
+    // pending_copies is sorted by destination now, so duplicates are adjacent.
+    std::vector<VkBufferMemoryBarrier2> barriers;
+    for (const PendingCopy &copy : pending_copies) {
+        if (copy.concurrent || (!released_buffers.empty() && released_buffers.back() == copy.destination)) {
+            continue;
+        }
+        released_buffers.push_back(copy.destination);
+
+        VkBufferMemoryBarrier2 barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+        barrier.dstAccessMask = VK_ACCESS_2_NONE;
+        barrier.srcQueueFamilyIndex = p_src_queue_family;
+        barrier.dstQueueFamilyIndex = p_dst_queue_family;
+        barrier.buffer = copy.destination;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        barriers.push_back(barrier);
+    }
+    pending_copies.clear();
+
+    // Concurrent destinations are made visible by the semaphore alone.
+    if (!barriers.empty()) {
+        VkDependencyInfo dependency_info = {};
+        dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependency_info.bufferMemoryBarrierCount = static_cast<uint32_t>(barriers.size());
+        dependency_info.pBufferMemoryBarriers = barriers.data();
+        vkCmdPipelineBarrier2(p_command_buffer, &dependency_info);
+    }
+}
+
+
+void StagingRing::acquire(VkCommandBuffer p_command_buffer, uint32_t p_src_queue_family, uint32_t p_dst_queue_family) {
+    if (released_buffers.empty()) {
+        return;
+    }
+
+    std::vector<VkBufferMemoryBarrier2> barriers(released_buffers.size());
+    for (size_t i = 0; i < released_buffers.size(); i++) {
+        VkBufferMemoryBarrier2 &barrier = barriers[i];
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+        barrier.srcAccessMask = VK_ACCESS_2_NONE;
+        barrier.dstStageMask = UPLOAD_CONSUMER_STAGES;
+        barrier.dstAccessMask = UPLOAD_CONSUMER_ACCESS;
+        barrier.srcQueueFamilyIndex = p_src_queue_family;
+        barrier.dstQueueFamilyIndex = p_dst_queue_family;
+        barrier.buffer = released_buffers[i];
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+    }
+    released_buffers.clear();
+
+    VkDependencyInfo dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.bufferMemoryBarrierCount = static_cast<uint32_t>(barriers.size());
+    dependency_info.pBufferMemoryBarriers = barriers.data();
+    vkCmdPipelineBarrier2(p_command_buffer, &dependency_info);
+}
+
+
+void StagingRing::release(uint32_t p_frame) {
+    tail = std::max(tail, frame_heads[p_frame]);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "allocator.h"
+
+// A persistently mapped upload buffer used as a ring. Uploads are queued on the CPU and
+// recorded at the start of a frame as one vkCmdCopyBuffer per destination buffer; their
+// staging space is reused once the fence of that frame has signalled. The copies can run on
+// the graphics queue itself, or on a dedicated transfer queue that then releases exclusive
+// destinations to the graphics queue family.
+class StagingRing {
+
+private:
+    struct PendingCopy {
+        VkBuffer destination;
+        VkBufferCopy region;
+        // Shared by all queue families, so it needs no ownership transfer.
+        bool concurrent;
+    };
+
+    VkBuffer buffer{ VK_NULL_HANDLE };
+    Allocation allocation;
+    VkDeviceSize capacity{ 0 };
+    // Monotonic byte counters; the ring position is the counter modulo capacity.
+    uint64_t head{ 0 };
+    uint64_t tail{ 0 };
+    std::vector<PendingCopy> pending_copies;
+    // Head position at the time each frame slot flushed its copies.
+    std::vector<uint64_t> frame_heads;
+    uint64_t uploaded_bytes{ 0 };
+    // Exclusive destinations released by the transfer queue and not yet acquired.
+    std::vector<VkBuffer> released_buffers;
+
+    void record_copies(VkCommandBuffer p_command_buffer);
+
+public:
+    bool initialize(DeviceAllocator &p_allocator, VkDeviceSize p_capacity, uint32_t p_frame_count);
+    void cleanup(DeviceAllocator &p_allocator);
+
+    // Copies p_data into the ring and queues a copy to p_destination. Returns false if it does not fit.
+    bool upload(VkBuffer p_destination, VkDeviceSize p_destination_offset, const void* p_data, VkDeviceSize p_size, bool p_concurrent = false);
+    // Records all queued copies plus a barrier that makes them visible to vertex input and shaders.
+    void flush(VkCommandBuffer p_command_buffer, uint32_t p_frame);
+    // Records all queued copies on a transfer queue of p_src_queue_family and releases their
+    // destinations to p_dst_queue_family. The submit must signal a semaphore the consumer waits on.
+    void flush_release(VkCommandBuffer p_command_buffer, uint32_t p_frame, uint32_t p_src_queue_family, uint32_t p_dst_queue_family);
+    // The matching acquire half of flush_release(), recorded on the consuming queue.
+    void acquire(VkCommandBuffer p_command_buffer, uint32_t p_src_queue_family, uint32_t p_dst_queue_family);
+    // The fence of p_frame has signalled, so everything it copied from may be overwritten.
+    void release(uint32_t p_frame);
+
+    bool has_pending_copies() const { return !pending_copies.empty(); }
+    uint64_t get_uploaded_bytes() const { return uploaded_bytes; }
+
+    StagingRing() {};
+    ~StagingRing() {};
+};
@@ -0,0 +1,612 @@
+#include "texture_streamer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "util.h"
+#include "debug_utils.h"
+
+// Size of the staging buffer is a multiple of this. Offsets of copies from a buffer into an image must be
+// multiples of the texel block size and 4, which depends on the format, see get_format_block().
+constexpr VkDeviceSize TEXTURE_STAGING_ALIGNMENT{ 16 };
+// Everything that may sample a streamed texture through the bindless set.
+constexpr VkPipelineStageFlags2 TEXTURE_CONSUMER_STAGES{ VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT
+    | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT };
+
+// File identifier, then nine uint32 header fields, the index, and one entry per level.
+static const uint8_t KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+constexpr size_t KTX2_LEVEL_INDEX_OFFSET{ 80 };
+constexpr size_t KTX2_LEVEL_INDEX_ENTRY_SIZE{ 24 };
+
+
+static uint32_t read_u32(const uint8_t* p_data) {
+    uint32_t value;
+    memcpy(&value, p_data, sizeof(value));
+    return value;
+}
+
+
+static uint64_t read_u64(const uint8_t* p_data) {
+    uint64_t value;
+    memcpy(&value, p_data, sizeof(value));
+    return value;
+}
+
+
+static VkDeviceSize align_up(VkDeviceSize p_size, VkDeviceSize p_alignment) {
+    return (p_size + p_alignment - 1) / p_alignment * p_alignment;
+}
+
+
+struct FormatBlock {
+    uint32_t size;
+    uint32_t width;
+    uint32_t height;
+};
+
+
+// Texel block of the formats a KTX2 file can hold and the texture can be sampled in. False for depth,
+// stencil and multi-planar formats.
+static bool get_format_block(VkFormat p_format, FormatBlock &r_block) {
+    uint32_t format = static_cast<uint32_t>(p_format);
+    r_block = {0, 1, 1};
+    if (format == VK_FORMAT_R4G4_UNORM_PACK8) {
+        r_block.size = 1;
+    } else if (format <= VK_FORMAT_A1R5G5B5_UNORM_PACK16) {
+        r_block.size = 2;
+    } else if (format <= VK_FORMAT_R8_SRGB) {
+        r_block.size = 1;
+    } else if (format <= VK_FORMAT_R8G8_SRGB) {
+        r_block.size = 2;
+    } else if (format <= VK_FORMAT_B8G8R8_SRGB) {
+        r_block.size = 3;
+    } else if (format <= VK_FORMAT_A2B10G10R10_SINT_PACK32) {
+        r_block.size = 4;
+    } else if (format <= VK_FORMAT_R16_SFLOAT) {
+        r_block.size = 2;
+    } else if (format <= VK_FORMAT_R16G16_SFLOAT) {
+        r_block.size = 4;
+    } else if (format <= VK_FORMAT_R16G16B16_SFLOAT) {
+        r_block.size = 6;
+    } else if (format <= VK_FORMAT_R16G16B16A16_SFLOAT) {
+        r_block.size = 8;
+    } else if (format <= VK_FORMAT_R64G64B64A64_SFLOAT) {
+        // 32 and 64 bit channels, one to four of them, three formats each.
+        uint32_t channel_size = format <= VK_FORMAT_R32G32B32A32_SFLOAT ? 4 : 8;
+        uint32_t first = format <= VK_FORMAT_R32G32B32A32_SFLOAT ? VK_FORMAT_R32_UINT : VK_FORMAT_R64_UINT;
+        r_block.size = channel_size * ((format - first) / 3 + 1);
+    } else if (format <= VK_FORMAT_E5B9G9R9_UFLOAT_PACK32) {
+        r_block.size = 4;
+    } else if (format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_EAC_R11G11_SNORM_BLOCK) {
+        bool half = format <= VK_FORMAT_BC1_RGBA_SRGB_BLOCK || format == VK_FORMAT_BC4_UNORM_BLOCK || format == VK_FORMAT_BC4_SNORM_BLOCK
+            || (format >= VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK && format <= VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK)
+            || format == VK_FORMAT_EAC_R11_UNORM_BLOCK || format == VK_FORMAT_EAC_R11_SNORM_BLOCK;
+        r_block = {half ? 8u : 16u, 4, 4};
+    } else if ((format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK)
+        || (format >= VK_FORMAT_ASTC_4x4_SFLOAT_BLOCK && format <= VK_FORMAT_ASTC_12x12_SFLOAT_BLOCK)) {
+        // UNORM and SRGB come in pairs, SFLOAT on its own, in the same order of block sizes.
+        static const uint32_t ASTC_BLOCKS[14][2] = {{4, 4}, {5, 4}, {5, 5}, {6, 5}, {6, 6}, {8, 5}, {8, 6}, {8, 8},
+            {10, 5}, {10, 6}, {10, 8}, {10, 10}, {12, 10}, {12, 12}};
+        uint32_t index = format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK ? (format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2 : format - VK_FORMAT_ASTC_4x4_SFLOAT_BLOCK;
+        r_block = {16, ASTC_BLOCKS[index][0], ASTC_BLOCKS[index][1]};
+    } else if (format == VK_FORMAT_A4R4G4B4_UNORM_PACK16 || format == VK_FORMAT_A4B4G4R4_UNORM_PACK16) {
+        r_block.size = 2;
+    }
+    return r_block.size != 0;
+}
+
+
+bool TextureStreamer::initialize(VkPhysicalDevice p_physical_device, VkDevice p_device, DeviceAllocator &p_allocator, BindlessSet &p_bindless_set,
+    VkDeviceSize p_staging_size, VkDeviceSize p_budget) {
+    physical_device = p_physical_device;
+    device = p_device;
+    allocator = &p_allocator;
+    bindless_set = &p_bindless_set;
+    budget = p_budget;
+    staging_capacity = align_up(p_staging_size, TEXTURE_STAGING_ALIGNMENT);
+
+    VkMemoryPropertyFlags host_memory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if (!allocator->create_buffer(staging_capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, host_memory, AllocationStrategy::POOL, staging_buffer, staging_allocation)) {
+        return false;
+    }
+    DEBUG_NAME(device, VK_OBJECT_TYPE_BUFFER, staging_buffer, "texture staging");
+
+    VkSamplerCreateInfo sampler_info = {};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_LINEAR;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+    if (vkCreateSampler(device, &sampler_info, nullptr, sampler.put(device)) != VK_SUCCESS) {
+        return false;
+    }
+    sampler_index = bindless_set->add_sampler(sampler);
+    if (sampler_index == BINDLESS_INVALID_INDEX) {
+        return false;
+    }
+
+    stopping = false;
+    thread = std::thread(&TextureStreamer::thread_loop, this);
+    return true;
+}
+
+
+void TextureStreamer::cleanup() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    job_available.notify_all();
+    staging_released.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+
+    for (std::unique_ptr<Texture> &texture : textures) {
+        texture->image_view.reset();
+        if (texture->image != VK_NULL_HANDLE) {
+            allocator->destroy_image(texture->image, texture->allocation);
+        }
+    }
+    textures.clear();
+    staged_uploads.clear();
+    resident_bytes = 0;
+    sampler.reset();
+    if (staging_buffer != VK_NULL_HANDLE) {
+        allocator->destroy_buffer(staging_buffer, staging_allocation);
+    }
+}
+
+
+TextureHandle TextureStreamer::load(const std::string &p_path) {
+    std::unique_ptr<Texture> texture = std::make_unique<Texture>();
+    texture->path = p_path;
+    texture->loading = true;
+    textures.push_back(std::move(texture));
+
+    TextureHandle handle = static_cast<TextureHandle>(textures.size() - 1);
+    queue_job(handle, true, 0);
+    return handle;
+}
+
+
+void TextureStreamer::queue_job(TextureHandle p_texture, bool p_open, uint32_t p_first_level) {
+    jobs_in_flight++;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back({p_texture, textures[p_texture].get(), p_open, p_first_level});
+    }
+    job_available.notify_one();
+}
+
+
+void TextureStreamer::thread_loop() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_available.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (stopping) {
+                return;
+            }
+            job = jobs.front();
+            jobs.pop_front();
+        }
+
+        Texture &texture = *job.texture;
+        StagedUpload upload = {job.handle, false, job.first_level, 0, {}, 0};
+        if (!job.open) {
+            upload.success = stage_levels(texture, job.first_level, 1, upload);
+        } else if (open_texture(texture)) {
+            // The tail: every level up to TEXTURE_TAIL_SIZE, and at least the smallest one.
+            uint32_t first = static_cast<uint32_t>(texture.levels.size() - 1);
+            while (first > 0 && std::max(texture.levels[first - 1].extent.width, texture.levels[first - 1].extent.height) <= TEXTURE_TAIL_SIZE) {
+                first--;
+            }
+            upload.success = stage_levels(texture, first, static_cast<uint32_t>(texture.levels.size()) - first, upload);
+            if (!upload.success) {
+                print("The smallest levels of texture '%s' do not fit into the staging buffer!", texture.path.c_str());
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        staged_uploads.push_back(std::move(upload));
+    }
+}
+
+
+bool TextureStreamer::open_texture(Texture &p_texture) {
+    if (!p_texture.file.open(p_texture.path)) {
+        print("Could not open texture '%s'!", p_texture.path.c_str());
+        return false;
+    }
+
+    const uint8_t* data = p_texture.file.get_data();
+    size_t size = p_texture.file.get_size();
+    if (size < KTX2_LEVEL_INDEX_OFFSET || memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+        print("'%s' is not a KTX2 file!", p_texture.path.c_str());
+        return false;
+    }
+
+    VkFormat format = static_cast<VkFormat>(read_u32(data + 12));
+    uint32_t width = read_u32(data + 20);
+    uint32_t height = read_u32(data + 24);
+    uint32_t depth = read_u32(data + 28);
+    uint32_t layer_count = read_u32(data + 32);
+    uint32_t face_count = read_u32(data + 36);
+    uint32_t level_count = std::max(1u, read_u32(data + 40));
+    uint32_t supercompression = read_u32(data + 44);
+    // Basis Universal files have no VkFormat and would need transcoding first.
+    if (format == VK_FORMAT_UNDEFINED || supercompression != 0 || width == 0 || height == 0 || depth > 1 || layer_count > 1 || face_count != 1
+        || level_count > 32 || KTX2_LEVEL_INDEX_OFFSET + level_count * KTX2_LEVEL_INDEX_ENTRY_SIZE > size) {
+        print("Texture '%s' is not a plain 2D KTX2 texture!", p_texture.path.c_str());
+        return false;
+    }
+
+    FormatBlock block;
+    if (!get_format_block(format, block)) {
+        print("Texture '%s' has format %d, which cannot be streamed", p_texture.path.c_str(), int(format));
+        return false;
+    }
+
+    p_texture.format = format;
+    // The smallest multiple of both the block size and 4.
+    p_texture.staging_alignment = block.size % 4 == 0 ? block.size : block.size % 2 == 0 ? block.size * 2 : block.size * 4;
+    p_texture.levels.resize(level_count);
+    for (uint32_t i = 0; i < level_count; i++) {
+        const uint8_t* entry = data + KTX2_LEVEL_INDEX_OFFSET + i * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+        Level &level = p_texture.levels[i];
+        level.file_offset = read_u64(entry);
+        level.size = read_u64(entry + 8);
+        level.extent = {std::max(1u, width >> i), std::max(1u, height >> i), 1};
+        // The copy reads whole, tightly packed blocks, so a smaller level would read past its staged bytes.
+        uint64_t required_size = uint64_t((level.extent.width + block.width - 1) / block.width)
+            * ((level.extent.height + block.height - 1) / block.height) * block.size;
+        if (level.file_offset > size || level.size > size - level.file_offset || level.size < required_size) {
+            print("Texture '%s' is truncated!", p_texture.path.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool TextureStreamer::stage_levels(Texture &p_texture, uint32_t p_first, uint32_t p_count, StagedUpload &r_upload) {
+    VkDeviceSize total {0};
+    for (uint32_t i = p_first; i < p_first + p_count; i++) {
+        total += align_up(p_texture.levels[i].size, p_texture.staging_alignment);
+    }
+    if (total > staging_capacity) {
+        return false;
+    }
+
+    uint64_t start;
+    {
+        // Waits for frames to finish with older uploads; the render thread never waits for this one.
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            // Level copies must be contiguous, so skip the rest of the buffer when they would wrap.
+            // The start of the buffer is aligned for every format.
+            start = staging_head;
+            VkDeviceSize aligned_offset = align_up(start % staging_capacity, p_texture.staging_alignment);
+            if (aligned_offset + total > staging_capacity) {
+                start += staging_capacity - start % staging_capacity;
+            } else {
+                start += aligned_offset - start % staging_capacity;
+            }
+            if (start + total - staging_tail <= staging_capacity) {
+                break;
+            }
+            if (stopping) {
+                return false;
+            }
+            staging_released.wait(lock);
+        }
+        staging_head = start + total;
+    }
+
+    // The range is reserved, so the copy itself needs no lock. This is where the mapped pages are read.
+    VkDeviceSize offset = start % staging_capacity;
+    for (uint32_t i = p_first; i < p_first + p_count; i++) {
+        const Level &level = p_texture.levels[i];
+        memcpy(static_cast<char*>(staging_allocation.mapped) + offset, p_texture.file.get_data() + level.file_offset, level.size);
+        r_upload.offsets.push_back(offset);
+        offset += align_up(level.size, p_texture.staging_alignment);
+    }
+    r_upload.first_level = p_first;
+    r_upload.level_count = p_count;
+    r_upload.staging_end = start + total;
+    return true;
+}
+
+
+VkImageCreateInfo TextureStreamer::get_image_info(const Texture &p_texture, uint32_t p_first) const {
+    VkImageCreateInfo image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = p_texture.format;
+    image_info.extent = p_texture.levels[p_first].extent;
+    image_info.mipLevels = static_cast<uint32_t>(p_texture.levels.size()) - p_first;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    // Transfer source for the next rebuild, which keeps the levels both images share.
+    image_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    return image_info;
+}
+
+
+VkDeviceSize TextureStreamer::get_image_size(const Texture &p_texture, uint32_t p_first) const {
+    VkImageCreateInfo image_info = get_image_info(p_texture, p_first);
+    VkDeviceImageMemoryRequirements info = {};
+    info.sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS;
+    info.pCreateInfo = &image_info;
+    VkMemoryRequirements2 requirements = {};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    vkGetDeviceImageMemoryRequirements(device, &info, &requirements);
+    return requirements.memoryRequirements.size;
+}
+
+
+bool TextureStreamer::rebuild(VkCommandBuffer p_command_buffer, TextureHandle p_texture, uint32_t p_first, const StagedUpload* p_upload,
+    uint64_t p_submit_index, DeletionQueue &r_deletion_queue) {
+    Texture &texture = *textures[p_texture];
+    uint32_t level_count = static_cast<uint32_t>(texture.levels.size()) - p_first;
+    VkImageCreateInfo image_info = get_image_info(texture, p_first);
+
+    VkImage image;
+    Allocation allocation;
+    if (!allocator->create_image(image_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, allocation)) {
+        return false;
+    }
+    DEBUG_NAME(device, VK_OBJECT_TYPE_IMAGE, image, texture.path.c_str());
+
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = texture.format;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.levelCount = level_count;
+    view_info.subresourceRange.layerCount = 1;
+    UniqueImageView image_view;
+    uint32_t bindless_index = BINDLESS_INVALID_INDEX;
+    if (vkCreateImageView(device, &view_info, nullptr, image_view.put(device)) == VK_SUCCESS) {
+        bindless_index = bindless_set->add_texture(image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+    if (bindless_index == BINDLESS_INVALID_INDEX) {
+        image_view.reset();
+        allocator->destroy_image(image, allocation);
+        return false;
+    }
+
+    VkImageMemoryBarrier2 barriers[2] = {};
+    for (VkImageMemoryBarrier2 &barrier : barriers) {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        barrier.subresourceRange.layerCount = 1;
+    }
+    barriers[0].dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[0].image = image;
+    // Earlier frames may still sample the old image; the copy waits for them.
+    barriers[1].srcStageMask = TEXTURE_CONSUMER_STAGES;
+    barriers[1].dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[1].image = texture.image;
+
+    VkDependencyInfo dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.imageMemoryBarrierCount = texture.image != VK_NULL_HANDLE ? 2 : 1;
+    dependency_info.pImageMemoryBarriers = barriers;
+    vkCmdPipelineBarrier2(p_command_buffer, &dependency_info);
+
+    // Staged levels come from the buffer, every other level from the old image.
+    std::vector<VkImageCopy> image_copies;
+    std::vector<VkBufferImageCopy> buffer_copies;
+    for (uint32_t level = p_first; level < texture.levels.size(); level++) {
+        if (p_upload != nullptr && level >= p_upload->first_level && level < p_upload->first_level + p_upload->level_count) {
+            VkBufferImageCopy copy = {};
+            copy.bufferOffset = p_upload->offsets[level - p_upload->first_level];
+            copy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - p_first, 0, 1};
+            copy.imageExtent = texture.levels[level].extent;
+            buffer_copies.push_back(copy);
+        } else {
+            VkImageCopy copy = {};
+            copy.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - texture.resident_first, 0, 1};
+            copy.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - p_first, 0, 1};
+            copy.extent = texture.levels[level].extent;
+            image_copies.push_back(copy);
+        }
+    }
+    if (!image_copies.empty()) {
+        vkCmdCopyImage(p_command_buffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t>(image_copies.size()), image_copies.data());
+    }
+    if (!buffer_copies.empty()) {
+        vkCmdCopyBufferToImage(p_command_buffer, staging_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t>(buffer_copies.size()), buffer_copies.data());
+    }
+
+    barriers[0].srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    barriers[0].srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barriers[0].dstStageMask = TEXTURE_CONSUMER_STAGES;
+    barriers[0].dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    dependency_info.imageMemoryBarrierCount = 1;
+    vkCmdPipelineBarrier2(p_command_buffer, &dependency_info);
+
+    // The old image is read by this submission, and its index may be in use by earlier ones.
+    if (texture.image != VK_NULL_HANDLE) {
+        resident_bytes -= texture.allocation.size;
+        VkImage old_image = texture.image;
+        Allocation old_allocation = texture.allocation;
+        uint32_t old_index = texture.bindless_index;
+        r_deletion_queue.push(p_submit_index, std::move(texture.image_view));
+        r_deletion_queue.push(p_submit_index, [this, old_image, old_allocation, old_index]() mutable {
+            allocator->destroy_image(old_image, old_allocation);
+            bindless_set->release(BINDLESS_TEXTURES, old_index);
+        });
+    }
+    texture.image = image;
+    texture.allocation = allocation;
+    texture.image_view = std::move(image_view);
+    texture.bindless_index = bindless_index;
+    texture.resident_first = p_first;
+    resident_bytes += allocation.size;
+    return true;
+}
+
+
+bool TextureStreamer::evict_one(TextureHandle p_keep, VkCommandBuffer p_command_buffer, uint64_t p_submit_index, DeletionQueue &r_deletion_queue) {
+    // The least recently used texture with a level to spare. Textures drawn last frame are kept,
+    // otherwise two textures on screen would keep evicting each other.
+    TextureHandle victim = INVALID_TEXTURE;
+    for (TextureHandle i = 0; i < textures.size(); i++) {
+        const Texture &texture = *textures[i];
+        if (i == p_keep || !texture.ready || texture.loading || texture.resident_first + 1 >= texture.levels.size() || texture.last_used + 1 >= frame) {
+            continue;
+        }
+        if (victim == INVALID_TEXTURE || texture.last_used < textures[victim]->last_used) {
+            victim = i;
+        }
+    }
+    if (victim == INVALID_TEXTURE) {
+        return false;
+    }
+
+    Texture &texture = *textures[victim];
+    if (!rebuild(p_command_buffer, victim, texture.resident_first + 1, nullptr, p_submit_index, r_deletion_queue)) {
+        return false;
+    }
+    // Once evicted, a level is streamed in again when the texture is used.
+    evicted_levels++;
+    return true;
+}
+
+
+void TextureStreamer::update(VkCommandBuffer p_command_buffer, uint64_t p_submit_index, DeletionQueue &r_deletion_queue) {
+    frame++;
+
+    std::vector<StagedUpload> uploads;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        uploads.swap(staged_uploads);
+    }
+
+    for (const StagedUpload &upload : uploads) {
+        jobs_in_flight--;
+        Texture &texture = *textures[upload.texture];
+        texture.loading = false;
+        if (upload.success) {
+            // The staging space is reused once this submission is done copying from it.
+            uint64_t staging_end = upload.staging_end;
+            r_deletion_queue.push(p_submit_index, [this, staging_end]() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    staging_tail = std::max(staging_tail, staging_end);
+                }
+                staging_released.notify_one();
+            });
+        }
+
+        if (!texture.ready) {
+            if (!upload.success) {
+                texture.failed = true;
+                continue;
+            }
+            VkFormatProperties properties;
+            vkGetPhysicalDeviceFormatProperties(physical_device, texture.format, &properties);
+            VkFormatFeatureFlags features = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_SRC_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+            if ((properties.optimalTilingFeatures & features) != features) {
+                print("Texture '%s' has format %d, which the device cannot sample", texture.path.c_str(), int(texture.format));
+                texture.failed = true;
+                continue;
+            }
+            texture.ready = true;
+            texture.resident_first = static_cast<uint32_t>(texture.levels.size());
+        } else if (!upload.success) {
+            // Too large for the staging buffer; stay at the current level.
+            texture.first_allowed = upload.first_level + 1;
+            continue;
+        }
+
+        // The rebuilt image replaces the current one, both are counted by their allocation size.
+        // The tail is always uploaded, so every texture can be drawn. Larger levels only fit in the budget.
+        VkDeviceSize image_size = get_image_size(texture, upload.first_level);
+        bool tail = texture.resident_first == texture.levels.size();
+        while (resident_bytes - texture.allocation.size + image_size > budget && evict_one(upload.texture, p_command_buffer, p_submit_index, r_deletion_queue)) {}
+        if (!tail && resident_bytes - texture.allocation.size + image_size > budget) {
+            continue;
+        }
+        if (!rebuild(p_command_buffer, upload.texture, upload.first_level, &upload, p_submit_index, r_deletion_queue)) {
+            print("Could not create image for texture '%s'!", texture.path.c_str());
+            texture.failed = texture.bindless_index == BINDLESS_INVALID_INDEX;
+            continue;
+        }
+        for (uint32_t i = upload.first_level; i < upload.first_level + upload.level_count; i++) {
+            uploaded_bytes += texture.levels[i].size;
+        }
+    }
+
+    // Request one larger level for every texture drawn last frame, as long as the budget allows.
+    for (TextureHandle i = 0; i < textures.size() && jobs_in_flight < MAX_TEXTURE_JOBS; i++) {
+        Texture &texture = *textures[i];
+        if (!texture.ready || texture.failed || texture.loading || texture.resident_first <= texture.first_allowed || texture.last_used + 1 < frame) {
+            continue;
+        }
+        VkDeviceSize image_size = get_image_size(texture, texture.resident_first - 1);
+        while (resident_bytes - texture.allocation.size + image_size > budget && evict_one(i, p_command_buffer, p_submit_index, r_deletion_queue)) {}
+        if (resident_bytes - texture.allocation.size + image_size > budget) {
+            continue;
+        }
+        texture.loading = true;
+        queue_job(i, false, texture.resident_first - 1);
+    }
+}
+
+
+uint32_t TextureStreamer::get_bindless_index(TextureHandle p_texture) const {
+    if (p_texture >= textures.size()) {
+        return BINDLESS_INVALID_INDEX;
+    }
+    const Texture &texture = *textures[p_texture];
+    return texture.ready ? texture.bindless_index : BINDLESS_INVALID_INDEX;
+}
+
+
+void TextureStreamer::mark_used(TextureHandle p_texture) {
+    if (p_texture < textures.size()) {
+        textures[p_texture]->last_used = frame;
+    }
+}
+
+
+TextureStreamingStats TextureStreamer::get_stats() const {
+    TextureStreamingStats stats;
+    stats.texture_count = static_cast<uint32_t>(textures.size());
+    for (const std::unique_ptr<Texture> &texture : textures) {
+        if (texture->ready) {
+            stats.resident_levels += static_cast<uint32_t>(texture->levels.size()) - texture->resident_first;
+            stats.total_levels += static_cast<uint32_t>(texture->levels.size());
+        }
+    }
+    stats.resident_bytes = resident_bytes;
+    stats.budget_bytes = budget;
+    stats.uploaded_bytes = uploaded_bytes;
+    stats.evicted_levels = evicted_levels;
+    return stats;
+}
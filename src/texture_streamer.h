@@ -0,0 +1,158 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "allocator.h"
+#include "descriptors.h"
+#include "deletion_queue.h"
+#include "mapped_file.h"
+#include "vulkan_handle.h"
+
+using TextureHandle = uint32_t;
+constexpr TextureHandle INVALID_TEXTURE{ UINT32_MAX };
+// Mip levels up to this size are uploaded together when a texture is opened, so it can be drawn right away.
+constexpr uint32_t TEXTURE_TAIL_SIZE{ 64 };
+// Level uploads staged but not recorded yet, which bounds how much of the staging buffer one frame takes.
+constexpr uint32_t MAX_TEXTURE_JOBS{ 4 };
+
+struct TextureStreamingStats {
+    uint32_t texture_count{ 0 };
+    uint32_t resident_levels{ 0 };
+    uint32_t total_levels{ 0 };
+    uint64_t resident_bytes{ 0 };
+    uint64_t budget_bytes{ 0 };
+    // Totals since initialize().
+    uint64_t uploaded_bytes{ 0 };
+    uint64_t evicted_levels{ 0 };
+};
+
+// Streams mip levels of KTX2 textures into device-local images. Files are memory-mapped and
+// copied into a staging buffer on a loader thread; the copies into the images are recorded on
+// the render thread. A texture starts with its smallest levels and gains one larger level at a
+// time while it is in use and the VRAM budget allows, evicting the largest level of the least
+// recently used textures to make room. Images are never resized in place: every change builds
+// a new image, copies the levels it keeps on the GPU and retires the old one through the
+// deletion queue, together with its bindless index.
+class TextureStreamer {
+
+private:
+    struct Level {
+        uint64_t file_offset;
+        uint64_t size;
+        VkExtent3D extent;
+    };
+
+    struct Texture {
+        std::string path;
+        // Written by the loader thread before the first upload is handed over, read-only afterwards.
+        MappedFile file;
+        VkFormat format{ VK_FORMAT_UNDEFINED };
+        // Of the levels in the staging buffer, for vkCmdCopyBufferToImage.
+        VkDeviceSize staging_alignment{ 4 };
+        std::vector<Level> levels;
+        // Render thread only.
+        VkImage image{ VK_NULL_HANDLE };
+        Allocation allocation;
+        UniqueImageView image_view;
+        uint32_t bindless_index{ BINDLESS_INVALID_INDEX };
+        // First (largest) level in the image; levels.size() while nothing is resident.
+        uint32_t resident_first{ 0 };
+        // Levels below this are never requested, e.g. because they do not fit into the staging buffer.
+        uint32_t first_allowed{ 0 };
+        uint64_t last_used{ 0 };
+        // The file was parsed and its tail uploaded; the fields above are valid.
+        bool ready{ false };
+        bool loading{ false };
+        bool failed{ false };
+    };
+
+    struct Job {
+        TextureHandle handle;
+        Texture* texture;
+        // Open and parse the file first, then stage its tail.
+        bool open;
+        uint32_t first_level;
+    };
+
+    struct StagedUpload {
+        TextureHandle texture;
+        bool success;
+        uint32_t first_level;
+        uint32_t level_count;
+        // Staging offsets of the levels, in level order.
+        std::vector<VkDeviceSize> offsets;
+        uint64_t staging_end;
+    };
+
+    VkPhysicalDevice physical_device{ VK_NULL_HANDLE };
+    VkDevice device{ VK_NULL_HANDLE };
+    DeviceAllocator* allocator{ nullptr };
+    BindlessSet* bindless_set{ nullptr };
+    UniqueSampler sampler;
+    uint32_t sampler_index{ BINDLESS_INVALID_INDEX };
+    VkDeviceSize budget{ 0 };
+    std::vector<std::unique_ptr<Texture>> textures;
+    uint64_t frame{ 0 };
+    uint32_t jobs_in_flight{ 0 };
+    uint64_t resident_bytes{ 0 };
+    uint64_t uploaded_bytes{ 0 };
+    uint64_t evicted_levels{ 0 };
+
+    // Staging ring, written by the loader thread and released by the render thread.
+    VkBuffer staging_buffer{ VK_NULL_HANDLE };
+    Allocation staging_allocation;
+    VkDeviceSize staging_capacity{ 0 };
+    uint64_t staging_head{ 0 };
+    uint64_t staging_tail{ 0 };
+
+    std::deque<Job> jobs;
+    std::vector<StagedUpload> staged_uploads;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable job_available;
+    std::condition_variable staging_released;
+    bool stopping{ false };
+
+    void thread_loop();
+    bool open_texture(Texture &p_texture);
+    bool stage_levels(Texture &p_texture, uint32_t p_first, uint32_t p_count, StagedUpload &r_upload);
+    void queue_job(TextureHandle p_texture, bool p_open, uint32_t p_first_level);
+    VkImageCreateInfo get_image_info(const Texture &p_texture, uint32_t p_first) const;
+    // Size of the allocation that rebuild() makes for levels p_first.., to be compared with resident_bytes.
+    VkDeviceSize get_image_size(const Texture &p_texture, uint32_t p_first) const;
+    // Replaces the image of p_texture by one holding levels p_first.. and fills it from the old
+    // image and p_upload. Returns false if the new image could not be created.
+    bool rebuild(VkCommandBuffer p_command_buffer, TextureHandle p_texture, uint32_t p_first, const StagedUpload* p_upload,
+        uint64_t p_submit_index, DeletionQueue &r_deletion_queue);
+    bool evict_one(TextureHandle p_keep, VkCommandBuffer p_command_buffer, uint64_t p_submit_index, DeletionQueue &r_deletion_queue);
+
+public:
+    bool initialize(VkPhysicalDevice p_physical_device, VkDevice p_device, DeviceAllocator &p_allocator, BindlessSet &p_bindless_set,
+        VkDeviceSize p_staging_size, VkDeviceSize p_budget);
+    // Only valid once the device is idle.
+    void cleanup();
+
+    // Opens the file on the loader thread. The texture has no bindless index until its tail is uploaded.
+    TextureHandle load(const std::string &p_path);
+    // Call once per frame on the render thread, outside of rendering and before any draw that
+    // samples the textures. p_submit_index is the submission p_command_buffer belongs to.
+    void update(VkCommandBuffer p_command_buffer, uint64_t p_submit_index, DeletionQueue &r_deletion_queue);
+    // BINDLESS_INVALID_INDEX while nothing is resident.
+    uint32_t get_bindless_index(TextureHandle p_texture) const;
+    // Call for every texture that this frame's draws sample. Used textures get larger levels and are not evicted.
+    void mark_used(TextureHandle p_texture);
+    uint32_t get_sampler_index() const { return sampler_index; }
+    TextureStreamingStats get_stats() const;
+
+    TextureStreamer() {};
+    ~TextureStreamer() {};
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free hand-over of the latest value from one producer thread to one consumer thread.
+// The producer fills the back slot and swaps it with the middle one; the consumer swaps the
+// middle slot with its front one whenever a newer value was published. Neither side ever
+// waits, and a value the consumer did not get to in time is replaced by the next one.
+template <typename T>
+class TripleBuffer {
+
+private:
+    static constexpr uint32_t INDEX_MASK{ 3 };
+    // Set in middle while it holds a value the consumer has not taken yet.
+    static constexpr uint32_t UNREAD_BIT{ 4 };
+
+    T slots[3];
+    std::atomic<uint32_t> middle{ 1 };
+    // Producer only.
+    uint32_t back{ 0 };
+    // Consumer only.
+    uint32_t front{ 2 };
+
+public:
+    // Producer: the slot to fill before publish(). It holds an older value, not a default one.
+    T& get_back() { return slots[back]; }
+    // Producer: hands the back slot over. Returns false if it replaced a value that was never read.
+    bool publish() {
+        uint32_t previous = middle.exchange(back | UNREAD_BIT, std::memory_order_acq_rel);
+        back = previous & INDEX_MASK;
+        return (previous & UNREAD_BIT) == 0;
+    }
+    // Producer: the value published last has not been taken yet, so the next publish() may replace it.
+    bool has_unread() const { return (middle.load(std::memory_order_relaxed) & UNREAD_BIT) != 0; }
+
+    // Consumer: takes the newest published value, if there is one. Returns false if get_front() is unchanged.
+    bool update() {
+        if (!has_unread()) {
+            return false;
+        }
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+    // Consumer: default constructed until the first update() that returned true.
+    const T& get_front() const { return slots[front]; }
+
+    TripleBuffer() {};
+    ~TripleBuffer() {};
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+template <typename T>
+using DestroyFunction = void (VKAPI_PTR *)(VkDevice, T, const VkAllocationCallbacks*);
+
+// Move-only owner of an object created from a VkDevice. It converts to the raw handle, so
+// it can be passed to Vulkan calls as is.
+template <typename T, DestroyFunction<T> DESTROY>
+class UniqueHandle {
+
+private:
+    VkDevice device{ VK_NULL_HANDLE };
+    T handle{ VK_NULL_HANDLE };
+
+public:
+    // Destroys the current object and returns where to create the new one, e.g.
+    // vkCreateFence(device, &info, nullptr, fence.put(device)).
+    T* put(VkDevice p_device) {
+        reset();
+        device = p_device;
+        return &handle;
+    }
+
+    void reset() {
+        if (handle != VK_NULL_HANDLE) {
+            DESTROY(device, handle, nullptr);
+            handle = VK_NULL_HANDLE;
+        }
+    }
+
+    // Gives up ownership without destroying the object.
+    T release() {
+        T released = handle;
+        handle = VK_NULL_HANDLE;
+        return released;
+    }
+
+    VkDevice get_device() const { return device; }
+    // For calls that take an array of handles.
+    const T* address() const { return &handle; }
+    operator T() const { return handle; }
+
+    UniqueHandle& operator=(UniqueHandle &&p_other) noexcept {
+        if (this != &p_other) {
+            reset();
+            device = p_other.device;
+            handle = p_other.release();
+        }
+        return *this;
+    }
+
+    UniqueHandle(UniqueHandle &&p_other) noexcept : device(p_other.device), handle(p_other.release()) {}
+    UniqueHandle(const UniqueHandle&) = delete;
+    UniqueHandle& operator=(const UniqueHandle&) = delete;
+
+    UniqueHandle() {};
+    ~UniqueHandle() { reset(); };
+};
+
+using UniqueFence = UniqueHandle<VkFence, vkDestroyFence>;
+using UniqueSemaphore = UniqueHandle<VkSemaphore, vkDestroySemaphore>;
+using UniqueCommandPool = UniqueHandle<VkCommandPool, vkDestroyCommandPool>;
+using UniqueImage = UniqueHandle<VkImage, vkDestroyImage>;
+using UniqueImageView = UniqueHandle<VkImageView, vkDestroyImageView>;
+using UniqueSampler = UniqueHandle<VkSampler, vkDestroySampler>;
+using UniqueShaderModule = UniqueHandle<VkShaderModule, vkDestroyShaderModule>;
+using UniquePipelineCache = UniqueHandle<VkPipelineCache, vkDestroyPipelineCache>;
+using UniquePipelineLayout = UniqueHandle<VkPipelineLayout, vkDestroyPipelineLayout>;
+using UniquePipeline = UniqueHandle<VkPipeline, vkDestroyPipeline>;
+using UniqueDescriptorSetLayout = UniqueHandle<VkDescriptorSetLayout, vkDestroyDescriptorSetLayout>;
+using UniqueDescriptorPool = UniqueHandle<VkDescriptorPool, vkDestroyDescriptorPool>;
+using UniqueSwapchain = UniqueHandle<VkSwapchainKHR, vkDestroySwapchainKHR>;
+using UniqueQueryPool = UniqueHandle<VkQueryPool, vkDestroyQueryPool>;
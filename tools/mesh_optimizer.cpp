@@ -0,0 +1,300 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+// Scoring constants from Forsyth's article.
+constexpr float CACHE_DECAY_POWER{ 1.5f };
+constexpr float LAST_TRIANGLE_SCORE{ 0.75f };
+constexpr float VALENCE_BOOST_SCALE{ 2.0f };
+constexpr float VALENCE_BOOST_POWER{ 0.5f };
+// Valence scores are tabulated up to this many remaining triangles.
+constexpr uint32_t VALENCE_TABLE_SIZE{ 64 };
+// Cones wider than this never cull anything, so they are stored as never culled.
+constexpr float MIN_CONE_DOT{ 0.1f };
+
+
+struct ScoreTables {
+    float cache[VERTEX_CACHE_SIZE];
+    float valence[VALENCE_TABLE_SIZE];
+
+    ScoreTables() {
+        for (uint32_t i = 0; i < VERTEX_CACHE_SIZE; i++) {
+            // The vertices of the last triangle get a fixed score, so the next one does not simply reuse the same edge.
+            cache[i] = i < 3 ? LAST_TRIANGLE_SCORE : std::pow(1.0f - float(i - 3) / float(VERTEX_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+        }
+        valence[0] = 0.0f;
+        for (uint32_t i = 1; i < VALENCE_TABLE_SIZE; i++) {
+            valence[i] = VALENCE_BOOST_SCALE * std::pow(float(i), -VALENCE_BOOST_POWER);
+        }
+    }
+
+    float score(int32_t p_cache_position, uint32_t p_remaining) const {
+        if (p_remaining == 0) {
+            return -1.0f;
+        }
+        float result = p_cache_position >= 0 ? cache[p_cache_position] : 0.0f;
+        return result + (p_remaining < VALENCE_TABLE_SIZE ? valence[p_remaining] : VALENCE_BOOST_SCALE * std::pow(float(p_remaining), -VALENCE_BOOST_POWER));
+    }
+};
+
+
+std::vector<uint32_t> optimize_vertex_cache(const std::vector<uint32_t> &p_indices, uint32_t p_vertex_count) {
+    static const ScoreTables tables;
+    uint32_t triangle_count = uint32_t(p_indices.size() / 3);
+
+    // The triangles of every vertex that are not emitted yet, packed into one array.
+    std::vector<uint32_t> remaining(p_vertex_count, 0);
+    for (uint32_t index : p_indices) {
+        remaining[index]++;
+    }
+    std::vector<uint32_t> first_triangle(p_vertex_count, 0);
+    for (uint32_t i = 1; i < p_vertex_count; i++) {
+        first_triangle[i] = first_triangle[i - 1] + remaining[i - 1];
+    }
+    std::vector<uint32_t> adjacency(p_indices.size());
+    std::vector<uint32_t> fill = first_triangle;
+    for (uint32_t i = 0; i < triangle_count * 3; i++) {
+        adjacency[fill[p_indices[i]]++] = i / 3;
+    }
+
+    std::vector<int32_t> cache_position(p_vertex_count, -1);
+    std::vector<float> vertex_score(p_vertex_count);
+    for (uint32_t i = 0; i < p_vertex_count; i++) {
+        vertex_score[i] = tables.score(-1, remaining[i]);
+    }
+    std::vector<float> triangle_score(triangle_count);
+    std::vector<bool> emitted(triangle_count, false);
+    uint32_t best = UINT32_MAX;
+    float best_score = -1.0f;
+    for (uint32_t i = 0; i < triangle_count; i++) {
+        triangle_score[i] = vertex_score[p_indices[i * 3]] + vertex_score[p_indices[i * 3 + 1]] + vertex_score[p_indices[i * 3 + 2]];
+        if (triangle_score[i] > best_score) {
+            best = i;
+            best_score = triangle_score[i];
+        }
+    }
+
+    // Most recently used first. Holds up to three entries more than the cache while it is updated.
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> next_cache;
+    cache.reserve(VERTEX_CACHE_SIZE + 3);
+    next_cache.reserve(VERTEX_CACHE_SIZE + 3);
+    std::vector<uint32_t> result;
+    result.reserve(p_indices.size());
+    uint32_t scan = 0;
+
+    auto update_score = [&](uint32_t p_vertex, int32_t p_position) {
+        cache_position[p_vertex] = p_position;
+        float score = tables.score(p_position, remaining[p_vertex]);
+        float difference = score - vertex_score[p_vertex];
+        vertex_score[p_vertex] = score;
+        for (uint32_t i = 0; i < remaining[p_vertex]; i++) {
+            triangle_score[adjacency[first_triangle[p_vertex] + i]] += difference;
+        }
+    };
+
+    while (result.size() < p_indices.size()) {
+        if (best == UINT32_MAX) {
+            // Nothing in the cache has triangles left: continue with the next triangle in input order.
+            while (emitted[scan]) {
+                scan++;
+            }
+            best = scan;
+        }
+        emitted[best] = true;
+        const uint32_t* triangle = &p_indices[best * 3];
+        for (int i = 0; i < 3; i++) {
+            uint32_t vertex = triangle[i];
+            result.push_back(vertex);
+            uint32_t* begin = &adjacency[first_triangle[vertex]];
+            uint32_t* end = begin + remaining[vertex];
+            *std::find(begin, end, best) = end[-1];
+            remaining[vertex]--;
+        }
+
+        next_cache.assign(triangle, triangle + 3);
+        for (uint32_t vertex : cache) {
+            if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) {
+                next_cache.push_back(vertex);
+            }
+        }
+        for (size_t i = VERTEX_CACHE_SIZE; i < next_cache.size(); i++) {
+            update_score(next_cache[i], -1);
+        }
+        next_cache.resize(std::min<size_t>(next_cache.size(), VERTEX_CACHE_SIZE));
+        cache.swap(next_cache);
+        for (size_t i = 0; i < cache.size(); i++) {
+            update_score(cache[i], int32_t(i));
+        }
+
+        // Only triangles of cached vertices changed their score enough to matter.
+        best = UINT32_MAX;
+        best_score = -1.0f;
+        for (uint32_t vertex : cache) {
+            for (uint32_t i = 0; i < remaining[vertex]; i++) {
+                uint32_t candidate = adjacency[first_triangle[vertex] + i];
+                if (triangle_score[candidate] > best_score) {
+                    best = candidate;
+                    best_score = triangle_score[candidate];
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+
+std::vector<uint32_t> optimize_vertex_fetch(std::vector<uint32_t> &r_indices, uint32_t &r_vertex_count) {
+    std::vector<uint32_t> remap(r_vertex_count, UINT32_MAX);
+    uint32_t next {0};
+    for (uint32_t &index : r_indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+    r_vertex_count = next;
+    return remap;
+}
+
+
+uint64_t count_vertex_transforms(const std::vector<uint32_t> &p_indices, uint32_t p_vertex_count, uint32_t p_cache_size) {
+    // A vertex is still in the FIFO if fewer than p_cache_size vertices were inserted after it.
+    std::vector<uint64_t> inserted(p_vertex_count, 0);
+    uint64_t time = uint64_t(p_cache_size) + 1;
+    uint64_t transforms {0};
+    for (uint32_t index : p_indices) {
+        if (time - inserted[index] > p_cache_size) {
+            inserted[index] = time++;
+            transforms++;
+        }
+    }
+    return transforms;
+}
+
+
+static void compute_meshlet_bounds(const std::vector<uint32_t> &p_indices, const std::vector<float> &p_positions, Meshlet &r_meshlet) {
+    auto position = [&](uint32_t p_index, int p_axis) { return p_positions[size_t(p_indices[p_index]) * 3 + p_axis]; };
+
+    // Sphere around the center of the bounding box.
+    float min[3] = {INFINITY, INFINITY, INFINITY};
+    float max[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (uint32_t i = r_meshlet.first_index; i < r_meshlet.first_index + r_meshlet.index_count; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            min[axis] = std::min(min[axis], position(i, axis));
+            max[axis] = std::max(max[axis], position(i, axis));
+        }
+    }
+    float radius_squared {0.0f};
+    for (int axis = 0; axis < 3; axis++) {
+        r_meshlet.center[axis] = (min[axis] + max[axis]) * 0.5f;
+    }
+    for (uint32_t i = r_meshlet.first_index; i < r_meshlet.first_index + r_meshlet.index_count; i++) {
+        float d[3] = {position(i, 0) - r_meshlet.center[0], position(i, 1) - r_meshlet.center[1], position(i, 2) - r_meshlet.center[2]};
+        radius_squared = std::max(radius_squared, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    }
+    r_meshlet.radius = std::sqrt(radius_squared);
+
+    // Normal cone around the average of the unit face normals, as in meshoptimizer.
+    struct FaceNormal {
+        float normal[3];
+        uint32_t first_index;
+    };
+    std::vector<FaceNormal> normals;
+    normals.reserve(r_meshlet.index_count / 3);
+    float axis[3] = {0.0f, 0.0f, 0.0f};
+    for (uint32_t i = r_meshlet.first_index; i < r_meshlet.first_index + r_meshlet.index_count; i += 3) {
+        float e1[3];
+        float e2[3];
+        for (int a = 0; a < 3; a++) {
+            e1[a] = position(i + 1, a) - position(i, a);
+            e2[a] = position(i + 2, a) - position(i, a);
+        }
+        float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        // Zero area triangles are never visible, so they do not constrain the cone.
+        if (length == 0.0f) {
+            continue;
+        }
+        FaceNormal face = {{n[0] / length, n[1] / length, n[2] / length}, i};
+        for (int a = 0; a < 3; a++) {
+            axis[a] += face.normal[a];
+        }
+        normals.push_back(face);
+    }
+
+    r_meshlet.cone_cutoff = 1.0f;
+    for (int a = 0; a < 3; a++) {
+        r_meshlet.cone_apex[a] = r_meshlet.center[a];
+        r_meshlet.cone_axis[a] = 0.0f;
+    }
+    float axis_length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (axis_length == 0.0f) {
+        return;
+    }
+    for (int a = 0; a < 3; a++) {
+        axis[a] /= axis_length;
+    }
+    float min_dot {1.0f};
+    for (const FaceNormal &face : normals) {
+        min_dot = std::min(min_dot, face.normal[0] * axis[0] + face.normal[1] * axis[1] + face.normal[2] * axis[2]);
+    }
+    if (min_dot <= MIN_CONE_DOT) {
+        return;
+    }
+
+    // Move the apex back along the axis until it is behind the plane of every triangle.
+    float max_t {0.0f};
+    for (const FaceNormal &face : normals) {
+        float dc {0.0f};
+        float dn {0.0f};
+        for (int a = 0; a < 3; a++) {
+            dc += (r_meshlet.center[a] - position(face.first_index, a)) * face.normal[a];
+            dn += axis[a] * face.normal[a];
+        }
+        max_t = std::max(max_t, dc / dn);
+    }
+    for (int a = 0; a < 3; a++) {
+        r_meshlet.cone_apex[a] = r_meshlet.center[a] - axis[a] * max_t;
+        r_meshlet.cone_axis[a] = axis[a];
+    }
+    r_meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
+
+
+std::vector<Meshlet> build_meshlets(const std::vector<uint32_t> &p_indices, const std::vector<float> &p_positions) {
+    std::vector<Meshlet> meshlets;
+    // Meshlet that last used every vertex, so a vertex is counted once per meshlet.
+    std::vector<uint32_t> used_by(p_positions.size() / 3, UINT32_MAX);
+    Meshlet meshlet = {};
+
+    for (uint32_t i = 0; i < p_indices.size(); i += 3) {
+        uint32_t current = uint32_t(meshlets.size());
+        uint32_t new_vertices {0};
+        for (int k = 0; k < 3; k++) {
+            new_vertices += used_by[p_indices[i + k]] != current ? 1 : 0;
+        }
+        if (meshlet.index_count / 3 + 1 > MESHLET_MAX_TRIANGLES || meshlet.vertex_count + new_vertices > MESHLET_MAX_VERTICES) {
+            compute_meshlet_bounds(p_indices, p_positions, meshlet);
+            meshlets.push_back(meshlet);
+            meshlet = {};
+            meshlet.first_index = i;
+            current++;
+        }
+        for (int k = 0; k < 3; k++) {
+            if (used_by[p_indices[i + k]] != current) {
+                used_by[p_indices[i + k]] = current;
+                meshlet.vertex_count++;
+            }
+        }
+        meshlet.index_count += 3;
+    }
+    if (meshlet.index_count > 0) {
+        compute_meshlet_bounds(p_indices, p_positions, meshlet);
+        meshlets.push_back(meshlet);
+    }
+    return meshlets;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "mesh_format.h"
+
+// Cache size the triangle order is optimized for. Post-transform caches are not FIFOs of a fixed
+// size on current GPUs, but an order that is good for this one is good for them too.
+constexpr uint32_t VERTEX_CACHE_SIZE{ 32 };
+
+// Reorders the triangles of a list without degenerate triangles so vertices are reused while
+// they are still in the post-transform cache, following Tom Forsyth's "Linear-Speed Vertex
+// Cache Optimisation": every vertex is scored by its cache position and the number of triangles
+// it still has, and the triangle with the highest total is emitted next.
+std::vector<uint32_t> optimize_vertex_cache(const std::vector<uint32_t> &p_indices, uint32_t p_vertex_count);
+
+// Numbers vertices in the order the indices first use them and rewrites r_indices to match, so
+// vertex fetches walk memory forwards. Returns the new index of every old vertex, UINT32_MAX for
+// unused ones, and the number of used vertices in r_vertex_count.
+std::vector<uint32_t> optimize_vertex_fetch(std::vector<uint32_t> &r_indices, uint32_t &r_vertex_count);
+
+// Vertex shader invocations of the triangle list on a FIFO post-transform cache of p_cache_size entries.
+uint64_t count_vertex_transforms(const std::vector<uint32_t> &p_indices, uint32_t p_vertex_count, uint32_t p_cache_size);
+
+// Splits the triangle list into meshlets of consecutive triangles within MESHLET_MAX_VERTICES and
+// MESHLET_MAX_TRIANGLES, with bounding spheres and normal cones. p_positions holds xyz per vertex.
+std::vector<Meshlet> build_meshlets(const std::vector<uint32_t> &p_indices, const std::vector<float> &p_positions);
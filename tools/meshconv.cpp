@@ -0,0 +1,463 @@
+// Converts Wavefront OBJ meshes into the binary format of src/mesh_format.h.
+//
+//     meshconv INPUT.obj OUTPUT.mesh [--no-optimize]
+//
+// Triangles are reordered for the post-transform vertex cache and vertices for fetch locality,
+// attributes are quantized, and the index buffer is split into meshlets with normal cones.
+// --no-optimize keeps the order of the OBJ file, as a baseline for the renderer's statistics.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_file.h"
+#include "mesh_format.h"
+#include "mesh_optimizer.h"
+
+// Cache sizes the vertex shader invocations are simulated for.
+constexpr uint32_t SIMULATED_CACHE_SIZES[]{ 16, 32 };
+
+struct SourceVertex {
+    float position[3];
+    float normal[3];
+    float uv[2];
+};
+
+struct SourceMesh {
+    std::vector<SourceVertex> vertices;
+    std::vector<uint32_t> indices;
+    bool has_normals{ false };
+};
+
+// One corner of an OBJ face: position, texture coordinate and normal index, 0 if absent.
+struct FaceCorner {
+    int32_t position;
+    int32_t uv;
+    int32_t normal;
+
+    bool operator==(const FaceCorner &p_other) const {
+        return position == p_other.position && uv == p_other.uv && normal == p_other.normal;
+    }
+};
+
+struct FaceCornerHash {
+    size_t operator()(const FaceCorner &p_corner) const {
+        uint64_t hash = uint64_t(uint32_t(p_corner.position)) * 0x9e3779b97f4a7c15ull;
+        hash ^= (uint64_t(uint32_t(p_corner.uv)) + (hash << 6) + (hash >> 2)) * 0xff51afd7ed558ccdull;
+        hash ^= (uint64_t(uint32_t(p_corner.normal)) + (hash << 6) + (hash >> 2)) * 0xc4ceb9fe1a85ec53ull;
+        return size_t(hash);
+    }
+};
+
+
+static double elapsed_ms(std::chrono::steady_clock::time_point p_start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - p_start).count();
+}
+
+
+static bool read_text_file(const std::string &p_path, std::string &r_text) {
+    std::ifstream file(p_path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::ostringstream stream;
+    stream << file.rdbuf();
+    r_text = stream.str();
+    return true;
+}
+
+
+static const char* skip_spaces(const char* p_cursor) {
+    while (*p_cursor == ' ' || *p_cursor == '\t') {
+        p_cursor++;
+    }
+    return p_cursor;
+}
+
+
+// OBJ indices start at 1 and negative ones count back from the last element.
+static int32_t resolve_obj_index(long p_index, size_t p_count) {
+    if (p_index < 0) {
+        p_index += long(p_count) + 1;
+    }
+    return p_index > 0 && size_t(p_index) <= p_count ? int32_t(p_index) : 0;
+}
+
+
+static bool parse_obj(const std::string &p_text, SourceMesh &r_mesh) {
+    std::vector<float> positions;
+    std::vector<float> uvs;
+    std::vector<float> normals;
+    std::unordered_map<FaceCorner, uint32_t, FaceCornerHash> corner_vertices;
+    std::vector<uint32_t> polygon;
+    bool missing_normals {false};
+
+    const char* cursor = p_text.c_str();
+    while (*cursor != '\0') {
+        cursor = skip_spaces(cursor);
+        const char* line_end = cursor + strcspn(cursor, "\r\n");
+        char* end;
+
+        if (cursor[0] == 'v' && (cursor[1] == ' ' || cursor[1] == '\t')) {
+            cursor += 1;
+            for (int i = 0; i < 3; i++) {
+                positions.push_back(strtof(cursor, &end));
+                cursor = end;
+            }
+        } else if (cursor[0] == 'v' && cursor[1] == 't') {
+            cursor += 2;
+            for (int i = 0; i < 2; i++) {
+                uvs.push_back(strtof(cursor, &end));
+                cursor = end;
+            }
+        } else if (cursor[0] == 'v' && cursor[1] == 'n') {
+            cursor += 2;
+            for (int i = 0; i < 3; i++) {
+                normals.push_back(strtof(cursor, &end));
+                cursor = end;
+            }
+        } else if (cursor[0] == 'f' && (cursor[1] == ' ' || cursor[1] == '\t')) {
+            // v, v/vt, v//vn or v/vt/vn per corner, as many corners as the polygon has.
+            polygon.clear();
+            cursor = skip_spaces(cursor + 1);
+            while (cursor < line_end) {
+                FaceCorner corner = {0, 0, 0};
+                corner.position = resolve_obj_index(strtol(cursor, &end, 10), positions.size() / 3);
+                cursor = end;
+                if (*cursor == '/') {
+                    cursor++;
+                    if (*cursor != '/') {
+                        corner.uv = resolve_obj_index(strtol(cursor, &end, 10), uvs.size() / 2);
+                        cursor = end;
+                    }
+                    if (*cursor == '/') {
+                        corner.normal = resolve_obj_index(strtol(cursor + 1, &end, 10), normals.size() / 3);
+                        cursor = end;
+                    }
+                }
+                if (corner.position == 0) {
+                    std::fprintf(stderr, "Invalid face '%.*s'!\n", int(line_end - cursor), cursor);
+                    return false;
+                }
+                missing_normals |= corner.normal == 0;
+
+                auto [entry, inserted] = corner_vertices.try_emplace(corner, uint32_t(r_mesh.vertices.size()));
+                if (inserted) {
+                    SourceVertex vertex = {};
+                    memcpy(vertex.position, &positions[size_t(corner.position - 1) * 3], sizeof(vertex.position));
+                    if (corner.normal != 0) {
+                        memcpy(vertex.normal, &normals[size_t(corner.normal - 1) * 3], sizeof(vertex.normal));
+                    }
+                    if (corner.uv != 0) {
+                        // OBJ puts v = 0 at the bottom of the image, Vulkan at the top.
+                        vertex.uv[0] = uvs[size_t(corner.uv - 1) * 2];
+                        vertex.uv[1] = 1.0f - uvs[size_t(corner.uv - 1) * 2 + 1];
+                    }
+                    r_mesh.vertices.push_back(vertex);
+                }
+                polygon.push_back(entry->second);
+                cursor = skip_spaces(cursor);
+            }
+            // Fan triangulation, which is exact for the convex polygons exporters write.
+            for (size_t i = 2; i < polygon.size(); i++) {
+                r_mesh.indices.insert(r_mesh.indices.end(), {polygon[0], polygon[i - 1], polygon[i]});
+            }
+        }
+        // Everything else (groups, materials, smoothing groups, comments) is ignored.
+
+        cursor = line_end;
+        while (*cursor == '\r' || *cursor == '\n') {
+            cursor++;
+        }
+    }
+
+    r_mesh.has_normals = !missing_normals;
+    return !r_mesh.indices.empty();
+}
+
+
+static void remove_degenerate_triangles(std::vector<uint32_t> &r_indices) {
+    size_t kept {0};
+    for (size_t i = 0; i < r_indices.size(); i += 3) {
+        uint32_t a = r_indices[i];
+        uint32_t b = r_indices[i + 1];
+        uint32_t c = r_indices[i + 2];
+        if (a != b && b != c && a != c) {
+            r_indices[kept++] = a;
+            r_indices[kept++] = b;
+            r_indices[kept++] = c;
+        }
+    }
+    r_indices.resize(kept);
+}
+
+
+// Area weighted face normals, summed per position so vertices split by UV seams stay smooth.
+static void compute_normals(SourceMesh &r_mesh) {
+    struct PositionKey {
+        float position[3];
+        bool operator==(const PositionKey &p_other) const { return memcmp(position, p_other.position, sizeof(position)) == 0; }
+    };
+    struct PositionKeyHash {
+        size_t operator()(const PositionKey &p_key) const {
+            uint32_t bits[3];
+            memcpy(bits, p_key.position, sizeof(bits));
+            return size_t((uint64_t(bits[0]) * 73856093ull) ^ (uint64_t(bits[1]) * 19349663ull) ^ (uint64_t(bits[2]) * 83492791ull));
+        }
+    };
+    std::unordered_map<PositionKey, uint32_t, PositionKeyHash> position_ids;
+    std::vector<uint32_t> vertex_position(r_mesh.vertices.size());
+    for (size_t i = 0; i < r_mesh.vertices.size(); i++) {
+        PositionKey key;
+        memcpy(key.position, r_mesh.vertices[i].position, sizeof(key.position));
+        vertex_position[i] = position_ids.try_emplace(key, uint32_t(position_ids.size())).first->second;
+    }
+
+    std::vector<float> sums(position_ids.size() * 3, 0.0f);
+    for (size_t i = 0; i < r_mesh.indices.size(); i += 3) {
+        const float* p0 = r_mesh.vertices[r_mesh.indices[i]].position;
+        const float* p1 = r_mesh.vertices[r_mesh.indices[i + 1]].position;
+        const float* p2 = r_mesh.vertices[r_mesh.indices[i + 2]].position;
+        float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+        for (int k = 0; k < 3; k++) {
+            float* sum = &sums[size_t(vertex_position[r_mesh.indices[i + k]]) * 3];
+            sum[0] += n[0];
+            sum[1] += n[1];
+            sum[2] += n[2];
+        }
+    }
+    for (size_t i = 0; i < r_mesh.vertices.size(); i++) {
+        memcpy(r_mesh.vertices[i].normal, &sums[size_t(vertex_position[i]) * 3], sizeof(float) * 3);
+    }
+}
+
+
+static uint16_t float_to_half(float p_value) {
+    uint32_t bits;
+    memcpy(&bits, &p_value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t float_exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (float_exponent == 0xff) {
+        return uint16_t(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+    }
+    int32_t exponent = int32_t(float_exponent) - 127 + 15;
+    if (exponent >= 31) {
+        return uint16_t(sign | 0x7c00);
+    }
+    if (exponent <= 0) {
+        // Subnormal half, or zero.
+        if (exponent < -10) {
+            return uint16_t(sign);
+        }
+        mantissa |= 0x800000;
+        uint32_t shift = uint32_t(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        half += (mantissa >> (shift - 1)) & 1;
+        return uint16_t(sign | half);
+    }
+    // Rounding may carry into the exponent, which is still the right result.
+    uint32_t half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+    half += (mantissa >> 12) & 1;
+    return uint16_t(half);
+}
+
+
+static int8_t quantize_snorm8(float p_value) {
+    return int8_t(std::lround(std::fmax(-1.0f, std::fmin(1.0f, p_value)) * 127.0f));
+}
+
+
+static void print_cache_statistics(const char* p_label, const std::vector<uint32_t> &p_indices, uint32_t p_vertex_count) {
+    size_t triangle_count = p_indices.size() / 3;
+    for (uint32_t cache_size : SIMULATED_CACHE_SIZES) {
+        uint64_t transforms = count_vertex_transforms(p_indices, p_vertex_count, cache_size);
+        // ACMR: transforms per triangle, ATVR: transforms per unique vertex (1.0 is the optimum).
+        std::printf("%s: %llu vertex shader invocations with a %u entry FIFO cache (ACMR %.3f, ATVR %.3f)\n", p_label,
+            (unsigned long long)transforms, cache_size, double(transforms) / double(triangle_count), double(transforms) / double(p_vertex_count));
+    }
+}
+
+
+static uint64_t align_offset(uint64_t p_offset) {
+    return (p_offset + MESH_SECTION_ALIGNMENT - 1) & ~(MESH_SECTION_ALIGNMENT - 1);
+}
+
+
+static bool write_mesh_file(const std::string &p_path, const MeshFileHeader &p_header, const std::vector<MeshVertex> &p_vertices,
+    const void* p_indices, const std::vector<Meshlet> &p_meshlets) {
+    std::vector<char> data(p_header.file_size, 0);
+    memcpy(data.data(), &p_header, sizeof(p_header));
+    memcpy(data.data() + p_header.vertex_offset, p_vertices.data(), p_vertices.size() * sizeof(MeshVertex));
+    memcpy(data.data() + p_header.index_offset, p_indices, size_t(p_header.index_count) * p_header.index_size);
+    memcpy(data.data() + p_header.meshlet_offset, p_meshlets.data(), p_meshlets.size() * sizeof(Meshlet));
+
+    std::ofstream file(p_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    file.write(data.data(), std::streamsize(data.size()));
+    return file.good();
+}
+
+
+int main(int argc, char** argv) {
+    std::string input_path;
+    std::string output_path;
+    bool optimize {true};
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-optimize") == 0) {
+            optimize = false;
+        } else if (input_path.empty()) {
+            input_path = argv[i];
+        } else if (output_path.empty()) {
+            output_path = argv[i];
+        } else {
+            std::fprintf(stderr, "Ignoring unknown argument '%s'.\n", argv[i]);
+        }
+    }
+    if (input_path.empty() || output_path.empty()) {
+        std::fprintf(stderr, "Usage: meshconv INPUT.obj OUTPUT.mesh [--no-optimize]\n");
+        return EXIT_FAILURE;
+    }
+
+    auto parse_start = std::chrono::steady_clock::now();
+    std::string text;
+    SourceMesh mesh;
+    if (!read_text_file(input_path, text)) {
+        std::fprintf(stderr, "Could not open file '%s'!\n", input_path.c_str());
+        return EXIT_FAILURE;
+    }
+    if (!parse_obj(text, mesh)) {
+        std::fprintf(stderr, "No triangles in '%s'!\n", input_path.c_str());
+        return EXIT_FAILURE;
+    }
+    double parse_ms = elapsed_ms(parse_start);
+    text.clear();
+
+    remove_degenerate_triangles(mesh.indices);
+    if (!mesh.has_normals) {
+        compute_normals(mesh);
+    }
+    uint32_t vertex_count = uint32_t(mesh.vertices.size());
+    std::printf("'%s': %u vertices, %zu triangles, parsed in %.3f ms\n", input_path.c_str(), vertex_count, mesh.indices.size() / 3, parse_ms);
+
+    print_cache_statistics("Input order", mesh.indices, vertex_count);
+    if (optimize) {
+        auto optimize_start = std::chrono::steady_clock::now();
+        mesh.indices = optimize_vertex_cache(mesh.indices, vertex_count);
+        std::printf("Vertex cache optimization took %.3f ms\n", elapsed_ms(optimize_start));
+        print_cache_statistics("Optimized", mesh.indices, vertex_count);
+    }
+
+    // Unused vertices are dropped either way; only the optimized file is renumbered in fetch order.
+    std::vector<uint32_t> remap(vertex_count, UINT32_MAX);
+    if (optimize) {
+        remap = optimize_vertex_fetch(mesh.indices, vertex_count);
+    } else {
+        uint32_t used {0};
+        std::vector<bool> referenced(vertex_count, false);
+        for (uint32_t index : mesh.indices) {
+            referenced[index] = true;
+        }
+        for (uint32_t i = 0; i < vertex_count; i++) {
+            remap[i] = referenced[i] ? used++ : UINT32_MAX;
+        }
+        for (uint32_t &index : mesh.indices) {
+            index = remap[index];
+        }
+        vertex_count = used;
+    }
+    std::vector<SourceVertex> vertices(vertex_count);
+    for (size_t i = 0; i < remap.size(); i++) {
+        if (remap[i] != UINT32_MAX) {
+            vertices[remap[i]] = mesh.vertices[i];
+        }
+    }
+
+    std::vector<float> positions(size_t(vertex_count) * 3);
+    MeshFileHeader header = {};
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.vertex_count = vertex_count;
+    header.index_count = uint32_t(mesh.indices.size());
+    float bounds_max[3];
+    for (int axis = 0; axis < 3; axis++) {
+        header.bounds_min[axis] = INFINITY;
+        bounds_max[axis] = -INFINITY;
+    }
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            positions[size_t(i) * 3 + axis] = vertices[i].position[axis];
+            header.bounds_min[axis] = std::fmin(header.bounds_min[axis], vertices[i].position[axis]);
+            bounds_max[axis] = std::fmax(bounds_max[axis], vertices[i].position[axis]);
+        }
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        header.bounds_extent[axis] = bounds_max[axis] - header.bounds_min[axis];
+    }
+
+    std::vector<Meshlet> meshlets = build_meshlets(mesh.indices, positions);
+    uint32_t cone_count {0};
+    for (const Meshlet &meshlet : meshlets) {
+        cone_count += meshlet.cone_cutoff < 1.0f ? 1 : 0;
+    }
+    std::printf("%zu meshlets, %u of them with a normal cone that can cull them\n", meshlets.size(), cone_count);
+
+    std::vector<MeshVertex> packed(vertex_count);
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        const SourceVertex &vertex = vertices[i];
+        MeshVertex &result = packed[i];
+        float normal_length = std::sqrt(vertex.normal[0] * vertex.normal[0] + vertex.normal[1] * vertex.normal[1] + vertex.normal[2] * vertex.normal[2]);
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = header.bounds_extent[axis] > 0.0f ? header.bounds_extent[axis] : 1.0f;
+            result.position[axis] = uint16_t(std::lround((vertex.position[axis] - header.bounds_min[axis]) / extent * 65535.0f));
+            result.normal[axis] = quantize_snorm8(normal_length > 0.0f ? vertex.normal[axis] / normal_length : 0.0f);
+        }
+        result.uv[0] = float_to_half(vertex.uv[0]);
+        result.uv[1] = float_to_half(vertex.uv[1]);
+    }
+
+    // 16-bit indices whenever they are enough.
+    std::vector<uint16_t> short_indices;
+    header.index_size = vertex_count <= 0x10000 ? 2 : 4;
+    if (header.index_size == 2) {
+        short_indices.assign(mesh.indices.begin(), mesh.indices.end());
+    }
+    header.meshlet_count = uint32_t(meshlets.size());
+    header.vertex_offset = align_offset(sizeof(MeshFileHeader));
+    header.index_offset = align_offset(header.vertex_offset + uint64_t(vertex_count) * sizeof(MeshVertex));
+    header.meshlet_offset = align_offset(header.index_offset + uint64_t(header.index_count) * header.index_size);
+    header.file_size = header.meshlet_offset + uint64_t(header.meshlet_count) * sizeof(Meshlet);
+
+    const void* indices = header.index_size == 2 ? static_cast<const void*>(short_indices.data()) : static_cast<const void*>(mesh.indices.data());
+    if (!write_mesh_file(output_path, header, packed, indices, meshlets)) {
+        std::fprintf(stderr, "Could not write file '%s'!\n", output_path.c_str());
+        return EXIT_FAILURE;
+    }
+
+    // Loading the result costs a mapping plus reading it once, which is what an upload does.
+    auto load_start = std::chrono::steady_clock::now();
+    MappedFile file;
+    uint64_t checksum {0};
+    if (file.open(output_path)) {
+        const uint64_t* words = reinterpret_cast<const uint64_t*>(file.get_data());
+        for (size_t i = 0; i < file.get_size() / sizeof(uint64_t); i++) {
+            checksum += words[i];
+        }
+    }
+    double load_ms = elapsed_ms(load_start);
+    std::printf("Wrote '%s': %llu bytes (%.1f bytes per triangle), mapped and read in %.3f ms, %.1fx faster than parsing the OBJ (checksum %llx)\n",
+        output_path.c_str(), (unsigned long long)header.file_size, double(header.file_size) / double(header.index_count / 3), load_ms,
+        parse_ms / std::fmax(load_ms, 0.001), (unsigned long long)checksum);
+    return EXIT_SUCCESS;
+}
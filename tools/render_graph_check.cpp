@@ -0,0 +1,129 @@
+// Compiles a synthetic render graph without a device and checks the barriers, layouts and
+// transient memory offsets it derives, see src/render_graph.h. Run by ctest.
+//
+//     render_graph_check
+//
+// Exits with EXIT_FAILURE and lists every mismatch if the graph is not what the passes imply.
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "render_graph.h"
+
+constexpr VkPipelineStageFlags2 DEPTH_STAGES{ VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT };
+constexpr VkPipelineStageFlags2 SAMPLED_STAGES{ VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT };
+constexpr VkAccessFlags2 COLOR_ACCESS{ VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT };
+constexpr VkAccessFlags2 DEPTH_ACCESS{ VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT };
+
+static int failures {0};
+
+
+static void check(bool p_condition, const char* p_what) {
+    if (!p_condition) {
+        std::fprintf(stderr, "FAILED: %s\n", p_what);
+        failures++;
+    }
+}
+
+
+static void check_barriers(const std::vector<GraphBarrier> &p_barriers, const std::vector<GraphBarrier> &p_expected, const char* p_where) {
+    if (p_barriers.size() != p_expected.size()) {
+        std::fprintf(stderr, "FAILED: %s has %zu barriers instead of %zu\n", p_where, p_barriers.size(), p_expected.size());
+        failures++;
+        return;
+    }
+    for (size_t i = 0; i < p_barriers.size(); i++) {
+        const GraphBarrier &barrier = p_barriers[i];
+        const GraphBarrier &expected = p_expected[i];
+        if (barrier.resource != expected.resource || barrier.src_stage != expected.src_stage || barrier.src_access != expected.src_access
+            || barrier.dst_stage != expected.dst_stage || barrier.dst_access != expected.dst_access
+            || barrier.old_layout != expected.old_layout || barrier.new_layout != expected.new_layout) {
+            std::fprintf(stderr, "FAILED: barrier %zu of %s: resource %u, stages 0x%llx -> 0x%llx, access 0x%llx -> 0x%llx, layout %d -> %d;"
+                " expected resource %u, stages 0x%llx -> 0x%llx, access 0x%llx -> 0x%llx, layout %d -> %d\n", i, p_where,
+                barrier.resource, (unsigned long long)barrier.src_stage, (unsigned long long)barrier.dst_stage,
+                (unsigned long long)barrier.src_access, (unsigned long long)barrier.dst_access, int(barrier.old_layout), int(barrier.new_layout),
+                expected.resource, (unsigned long long)expected.src_stage, (unsigned long long)expected.dst_stage,
+                (unsigned long long)expected.src_access, (unsigned long long)expected.dst_access, int(expected.old_layout), int(expected.new_layout));
+            failures++;
+        }
+    }
+}
+
+
+int main() {
+    // A deferred frame: the G-buffer dies after lighting, so bloom can take its memory, and a
+    // debug pass whose output nothing reads is culled.
+    RenderGraph graph;
+    RenderResource color = graph.import_image("color", VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, ResourceUsage::PRESENT);
+    RenderResource gbuffer = graph.create_image("gbuffer", {VK_FORMAT_R16G16B16A16_SFLOAT, {64, 64}});
+    RenderResource depth = graph.create_image("depth", {VK_FORMAT_D32_SFLOAT, {64, 64}}, VK_IMAGE_ASPECT_DEPTH_BIT);
+    RenderResource bloom = graph.create_image("bloom", {VK_FORMAT_R8G8B8A8_UNORM, {32, 32}});
+    RenderResource unused = graph.create_image("unused", {VK_FORMAT_R8G8B8A8_UNORM, {64, 64}});
+
+    uint32_t geometry = graph.add_pass("geometry", nullptr);
+    graph.write(geometry, gbuffer, ResourceUsage::COLOR_ATTACHMENT);
+    graph.write(geometry, depth, ResourceUsage::DEPTH_ATTACHMENT);
+    uint32_t lighting = graph.add_pass("lighting", nullptr);
+    graph.read(lighting, gbuffer, ResourceUsage::SAMPLED);
+    graph.write(lighting, color, ResourceUsage::COLOR_ATTACHMENT);
+    uint32_t bright = graph.add_pass("bloom", nullptr);
+    graph.write(bright, bloom, ResourceUsage::COLOR_ATTACHMENT);
+    uint32_t composite = graph.add_pass("composite", nullptr);
+    graph.read(composite, bloom, ResourceUsage::SAMPLED);
+    graph.write(composite, color, ResourceUsage::COLOR_ATTACHMENT);
+    uint32_t debug = graph.add_pass("debug", nullptr);
+    graph.write(debug, unused, ResourceUsage::COLOR_ATTACHMENT);
+
+    check(graph.compile(), "compile");
+    // Requirements in creation order of the transient images.
+    std::vector<VkMemoryRequirements> requirements = {{8192, 256, ~0u}, {4096, 256, ~0u}, {2048, 256, ~0u}, {4096, 256, ~0u}};
+    VkDeviceSize heap_size = graph.plan_memory(requirements);
+
+    check(!graph.is_culled(geometry) && !graph.is_culled(lighting) && !graph.is_culled(bright) && !graph.is_culled(composite), "used passes survive");
+    check(graph.is_culled(debug), "the debug pass is culled");
+
+    // Depth lives alongside the G-buffer, bloom reuses the G-buffer's memory.
+    check(graph.get_memory_offset(gbuffer) == 0, "gbuffer at offset 0");
+    check(graph.get_memory_offset(depth) == 8192, "depth after the gbuffer");
+    check(graph.get_memory_offset(bloom) == 0, "bloom aliases the gbuffer");
+    check(heap_size == 12288 && graph.get_heap_size() == heap_size, "heap of 12288 bytes");
+
+    // First uses wait for what last used their memory in the previous frame, or earlier in this one.
+    check_barriers(graph.get_barriers(geometry), {
+        {gbuffer, SAMPLED_STAGES, VK_ACCESS_2_NONE, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, COLOR_ACCESS,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+        {depth, DEPTH_STAGES, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, DEPTH_STAGES, DEPTH_ACCESS,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL},
+    }, "geometry");
+    check_barriers(graph.get_barriers(lighting), {
+        {gbuffer, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, SAMPLED_STAGES, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+        {color, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, COLOR_ACCESS,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+    }, "lighting");
+    check_barriers(graph.get_barriers(bright), {
+        {bloom, SAMPLED_STAGES, VK_ACCESS_2_NONE, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, COLOR_ACCESS,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+    }, "bloom");
+    check_barriers(graph.get_barriers(composite), {
+        {bloom, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, SAMPLED_STAGES, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+        {color, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, COLOR_ACCESS,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+    }, "composite");
+    check_barriers(graph.get_barriers(debug), {}, "debug");
+    check_barriers(graph.get_final_barriers(), {
+        {color, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR},
+    }, "the end of the frame");
+
+    if (failures > 0) {
+        for (const std::string &line : graph.describe()) {
+            std::fprintf(stderr, "%s\n", line.c_str());
+        }
+        return EXIT_FAILURE;
+    }
+    std::printf("Render graph check passed\n");
+    return EXIT_SUCCESS;
+}
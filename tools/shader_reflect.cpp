@@ -0,0 +1,188 @@
+// Writes the reflection of a SPIR-V module as a C++ header, see src/shader_reflection.h.
+//
+//     shader_reflect NAME INPUT.spv OUTPUT.h
+//
+// shaders/compile.sh runs it for every shader, next to the header slangc embeds the SPIR-V in.
+// The header defines NAME_reflection, a constexpr ShaderReflection.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "shader_reflection.h"
+
+
+static bool read_spirv_file(const std::string &p_path, std::vector<uint32_t> &r_words) {
+    std::ifstream file(p_path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::streamsize size = file.tellg();
+    if (size <= 0 || size % sizeof(uint32_t) != 0) {
+        return false;
+    }
+    r_words.resize(size_t(size) / sizeof(uint32_t));
+    file.seekg(0);
+    return bool(file.read(reinterpret_cast<char*>(r_words.data()), size));
+}
+
+
+static const char* get_descriptor_type_name(VkDescriptorType p_type) {
+    switch (p_type) {
+        case VK_DESCRIPTOR_TYPE_SAMPLER: return "VK_DESCRIPTOR_TYPE_SAMPLER";
+        case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER: return "VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER";
+        case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE: return "VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE";
+        case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE: return "VK_DESCRIPTOR_TYPE_STORAGE_IMAGE";
+        case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER: return "VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER";
+        case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER: return "VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER";
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER: return "VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER";
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER: return "VK_DESCRIPTOR_TYPE_STORAGE_BUFFER";
+        case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT: return "VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT";
+        case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR: return "VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR";
+        default: return "VK_DESCRIPTOR_TYPE_MAX_ENUM";
+    }
+}
+
+
+static const char* get_stage_name(VkShaderStageFlagBits p_stage) {
+    switch (p_stage) {
+        case VK_SHADER_STAGE_VERTEX_BIT: return "VK_SHADER_STAGE_VERTEX_BIT";
+        case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT: return "VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT";
+        case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT: return "VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT";
+        case VK_SHADER_STAGE_GEOMETRY_BIT: return "VK_SHADER_STAGE_GEOMETRY_BIT";
+        case VK_SHADER_STAGE_FRAGMENT_BIT: return "VK_SHADER_STAGE_FRAGMENT_BIT";
+        case VK_SHADER_STAGE_COMPUTE_BIT: return "VK_SHADER_STAGE_COMPUTE_BIT";
+        default: return "0";
+    }
+}
+
+
+static std::string get_stages_name(VkShaderStageFlags p_stages) {
+    std::string name;
+    for (uint32_t bit = 1; bit <= VK_SHADER_STAGE_COMPUTE_BIT; bit <<= 1) {
+        if (p_stages & bit) {
+            name += (name.empty() ? "" : " | ") + std::string(get_stage_name(VkShaderStageFlagBits(bit)));
+        }
+    }
+    return name.empty() ? "0" : name;
+}
+
+
+static const char* get_format_name(VkFormat p_format) {
+    switch (p_format) {
+        case VK_FORMAT_R32_SFLOAT: return "VK_FORMAT_R32_SFLOAT";
+        case VK_FORMAT_R32G32_SFLOAT: return "VK_FORMAT_R32G32_SFLOAT";
+        case VK_FORMAT_R32G32B32_SFLOAT: return "VK_FORMAT_R32G32B32_SFLOAT";
+        case VK_FORMAT_R32G32B32A32_SFLOAT: return "VK_FORMAT_R32G32B32A32_SFLOAT";
+        case VK_FORMAT_R32_SINT: return "VK_FORMAT_R32_SINT";
+        case VK_FORMAT_R32G32_SINT: return "VK_FORMAT_R32G32_SINT";
+        case VK_FORMAT_R32G32B32_SINT: return "VK_FORMAT_R32G32B32_SINT";
+        case VK_FORMAT_R32G32B32A32_SINT: return "VK_FORMAT_R32G32B32A32_SINT";
+        case VK_FORMAT_R32_UINT: return "VK_FORMAT_R32_UINT";
+        case VK_FORMAT_R32G32_UINT: return "VK_FORMAT_R32G32_UINT";
+        case VK_FORMAT_R32G32B32_UINT: return "VK_FORMAT_R32G32B32_UINT";
+        case VK_FORMAT_R32G32B32A32_UINT: return "VK_FORMAT_R32G32B32A32_UINT";
+        default: return "VK_FORMAT_UNDEFINED";
+    }
+}
+
+
+// Slang names are identifiers joined by dots, but nothing stops a module from naming things otherwise.
+static std::string quote(const char* p_string) {
+    std::string quoted = "\"";
+    for (const char* c = p_string; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            quoted += '\\';
+        }
+        quoted += *c >= ' ' ? *c : '?';
+    }
+    return quoted + "\"";
+}
+
+
+// "NAME_SUFFIX, COUNT" for arrays that were written, "nullptr, 0" for empty ones.
+static std::string get_array_reference(const std::string &p_name, const char* p_suffix, uint32_t p_count) {
+    return p_count > 0 ? p_name + "_" + p_suffix + ", " + std::to_string(p_count) : "nullptr, 0";
+}
+
+
+int main(int argc, char** argv) {
+    if (argc != 4) {
+        std::fprintf(stderr, "Usage: shader_reflect NAME INPUT.spv OUTPUT.h\n");
+        return EXIT_FAILURE;
+    }
+    std::string name = argv[1];
+    std::string input_path = argv[2];
+    std::string output_path = argv[3];
+
+    std::vector<uint32_t> code;
+    if (!read_spirv_file(input_path, code)) {
+        std::fprintf(stderr, "Could not read SPIR-V from '%s'!\n", input_path.c_str());
+        return EXIT_FAILURE;
+    }
+    ReflectedShader shader;
+    std::string error;
+    if (!shader.reflect(name, code.data(), code.size() * sizeof(uint32_t), error)) {
+        std::fprintf(stderr, "Could not reflect '%s': %s!\n", input_path.c_str(), error.c_str());
+        return EXIT_FAILURE;
+    }
+    ShaderReflection reflection = shader.get();
+
+    FILE* output = std::fopen(output_path.c_str(), "w");
+    if (output == nullptr) {
+        std::fprintf(stderr, "Could not open file '%s'!\n", output_path.c_str());
+        return EXIT_FAILURE;
+    }
+    std::fprintf(output, "// Generated by tools/shader_reflect from %s.spv, do not edit.\n#pragma once\n\n#include \"shader_reflection.h\"\n", name.c_str());
+
+    std::fprintf(output, "\nconstexpr ShaderEntryPoint %s_entry_points[] = {\n", name.c_str());
+    for (uint32_t i = 0; i < reflection.entry_point_count; i++) {
+        const ShaderEntryPoint &entry_point = reflection.entry_points[i];
+        std::fprintf(output, "    {%s, %s, {%u, %u, %u}},\n", quote(entry_point.name).c_str(), get_stage_name(entry_point.stage),
+            entry_point.local_size[0], entry_point.local_size[1], entry_point.local_size[2]);
+    }
+    std::fprintf(output, "};\n");
+
+    if (reflection.binding_count > 0) {
+        std::fprintf(output, "\n// Set, binding, type, count (0: unbounded), stages, name.\nconstexpr ShaderBinding %s_bindings[] = {\n", name.c_str());
+        for (uint32_t i = 0; i < reflection.binding_count; i++) {
+            const ShaderBinding &binding = reflection.bindings[i];
+            std::fprintf(output, "    {%u, %u, %s, %u, %s, %s},\n", binding.set, binding.binding, get_descriptor_type_name(binding.type),
+                binding.count, get_stages_name(binding.stages).c_str(), quote(binding.name).c_str());
+        }
+        std::fprintf(output, "};\n");
+    }
+
+    if (reflection.vertex_input_count > 0) {
+        std::fprintf(output, "\nconstexpr ShaderVertexInput %s_vertex_inputs[] = {\n", name.c_str());
+        for (uint32_t i = 0; i < reflection.vertex_input_count; i++) {
+            const ShaderVertexInput &input = reflection.vertex_inputs[i];
+            std::fprintf(output, "    {%u, %s, %s},\n", input.location, get_format_name(input.format), quote(input.name).c_str());
+        }
+        std::fprintf(output, "};\n");
+    }
+
+    if (reflection.specialization_constant_count > 0) {
+        std::fprintf(output, "\nconstexpr ShaderSpecializationConstant %s_specialization_constants[] = {\n", name.c_str());
+        for (uint32_t i = 0; i < reflection.specialization_constant_count; i++) {
+            const ShaderSpecializationConstant &constant = reflection.specialization_constants[i];
+            std::fprintf(output, "    {%u, 0x%08x, %s},\n", constant.id, constant.default_value, quote(constant.name).c_str());
+        }
+        std::fprintf(output, "};\n");
+    }
+
+    std::fprintf(output, "\nconstexpr ShaderReflection %s_reflection = {\n    %s,\n", name.c_str(), quote(name.c_str()).c_str());
+    std::fprintf(output, "    %s,\n", get_array_reference(name, "entry_points", reflection.entry_point_count).c_str());
+    std::fprintf(output, "    %s,\n", get_array_reference(name, "bindings", reflection.binding_count).c_str());
+    std::fprintf(output, "    %s,\n", get_array_reference(name, "vertex_inputs", reflection.vertex_input_count).c_str());
+    std::fprintf(output, "    %s,\n", get_array_reference(name, "specialization_constants", reflection.specialization_constant_count).c_str());
+    std::fprintf(output, "    %u, %s,\n};\n", reflection.push_constant_size, get_stages_name(reflection.push_constant_stages).c_str());
+
+    if (std::fclose(output) != 0) {
+        std::fprintf(stderr, "Could not write '%s'!\n", output_path.c_str());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}